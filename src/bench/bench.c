@@ -0,0 +1,847 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Offline benchmark of the dmconfig handlers.
+ *
+ * The agent is linked against replacements of libdmconfig, netlink.c,
+ * exec.c and systemd.c (see the other files in this directory) and runs
+ * its complete startup against a synthetic configuration of a number of
+ * interfaces, or against recorded answers, once per iteration.
+ * Every answer callback and every interface state request is measured.
+ *
+ * All files are written below a temporary directory, which is the working
+ * directory of the benchmark: the prefixes of the agent are relative,
+ * see Makefile.am.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#include <ev.h>
+
+#ifdef HAVE_TALLOC_TALLOC_H
+# include <talloc/talloc.h>
+#else
+# include <talloc.h>
+#endif
+
+#include <libdmconfig/codes.h>
+#include <libdmconfig/dmmsg.h>
+#include <libdmconfig/dmcontext.h>
+#include <libdmconfig/dm_dmclient_rpc_impl.h>
+
+#include "comm.h"
+#include "exec.h"
+#include "systemd.h"
+#include "worker.h"
+#include "ptp.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "log.h"
+#include "bench.h"
+
+/* cfgd.c is built with its main() renamed, see Makefile.am */
+#undef main
+
+unsigned int bench_interfaces = 100;
+unsigned int bench_neighbors = 4;
+
+/* interfaces with a DHCP client */
+#define BENCH_DHCP_EVERY 10
+
+/*
+ * Allocation counting
+ *
+ * glibc allows replacing malloc() and friends, the replacements count and
+ * forward to the glibc implementation. This includes the allocations
+ * of talloc and libnl.
+ */
+
+#ifdef __GLIBC__
+
+#define BENCH_COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t alloc_calls;
+static uint64_t alloc_bytes;
+
+static inline void
+count_alloc(size_t size)
+{
+	/* worker threads allocate as well */
+	__atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+	count_alloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	count_alloc(nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	count_alloc(size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+#else
+
+#define BENCH_COUNT_ALLOCS 0
+
+static uint64_t alloc_calls;
+static uint64_t alloc_bytes;
+
+#endif
+
+/*
+ * Measurements
+ */
+
+struct bench_counter {
+	char *name;
+	unsigned long calls;
+	uint64_t *ns;
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+static struct bench_counter *counters;
+static unsigned int ncounters;
+
+/** measurements of the warm-up iteration are discarded */
+static bool recording;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Start measuring a handler call.
+ *
+ * @param mark Filled with the current time and allocation counters.
+ */
+void
+bench_begin(struct bench_mark *mark)
+{
+	mark->allocs = __atomic_load_n(&alloc_calls, __ATOMIC_RELAXED);
+	mark->bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+	mark->ns = now_ns();
+}
+
+static struct bench_counter *
+counter_get(const char *name)
+{
+	struct bench_counter *c;
+
+	for (unsigned int i = 0; i < ncounters; i++)
+		if (!strcmp(counters[i].name, name))
+			return counters + i;
+
+	if (!(c = realloc(counters, (ncounters + 1) * sizeof(struct bench_counter))))
+		return NULL;
+	counters = c;
+
+	c = counters + ncounters;
+	memset(c, 0, sizeof(struct bench_counter));
+	if (!(c->name = strdup(name)))
+		return NULL;
+	ncounters++;
+
+	return c;
+}
+
+/**
+ * Record a handler call.
+ *
+ * @param name Name of the handler, calls of the same name are aggregated.
+ * @param mark The start of the call, see bench_begin().
+ */
+void
+bench_end(const char *name, const struct bench_mark *mark)
+{
+	uint64_t ns = now_ns() - mark->ns;
+	uint64_t allocs = __atomic_load_n(&alloc_calls, __ATOMIC_RELAXED) - mark->allocs;
+	uint64_t bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - mark->bytes;
+	struct bench_counter *c;
+	uint64_t *samples;
+
+	if (!recording || !(c = counter_get(name)))
+		return;
+
+	if (!(samples = realloc(c->ns, (c->calls + 1) * sizeof(uint64_t))))
+		return;
+	c->ns = samples;
+	c->ns[c->calls++] = ns;
+	c->allocs += allocs;
+	c->bytes += bytes;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+cmp_counter(const void *a, const void *b)
+{
+	return strcmp(((const struct bench_counter *)a)->name,
+	              ((const struct bench_counter *)b)->name);
+}
+
+static double
+percentile_us(const struct bench_counter *c, unsigned int percent)
+{
+	size_t rank = (c->calls * percent + 99) / 100;
+
+	return c->ns[rank ? rank - 1 : 0] / 1000.;
+}
+
+static void
+report(unsigned int iterations, bool warm)
+{
+	unsigned long commands, unit_jobs, neigh_syncs;
+
+	printf("# %u interfaces, %u neighbors, %u iterations, %s start\n",
+	       bench_interfaces, bench_neighbors, iterations, warm ? "warm" : "cold");
+	printf("%-40s %8s %10s %10s %10s %10s %12s %12s\n", "# handler", "calls",
+	       "mean_us", "p50_us", "p95_us", "max_us", "allocs/call", "bytes/call");
+
+	qsort(counters, ncounters, sizeof(struct bench_counter), cmp_counter);
+	for (unsigned int i = 0; i < ncounters; i++) {
+		struct bench_counter *c = counters + i;
+		uint64_t total = 0;
+
+		qsort(c->ns, c->calls, sizeof(uint64_t), cmp_u64);
+		for (unsigned long j = 0; j < c->calls; j++)
+			total += c->ns[j];
+
+		printf("%-40s %8lu %10.1f %10.1f %10.1f %10.1f", c->name, c->calls,
+		       total / 1000. / c->calls, percentile_us(c, 50), percentile_us(c, 95),
+		       c->ns[c->calls - 1] / 1000.);
+		if (BENCH_COUNT_ALLOCS)
+			printf(" %12.1f %12.0f\n", (double)c->allocs / c->calls,
+			       (double)c->bytes / c->calls);
+		else
+			printf(" %12s %12s\n", "-", "-");
+	}
+
+	/* the agent's own instrumentation, which includes the warm-up */
+	printf("%-40s %8s %10s %10s %10s\n", "# agent counter", "calls", "errors",
+	       "p50_us<=", "p99_us<=");
+	for (int h = 0; h < STATS_HANDLERS; h++) {
+		const struct stats_counter *sc = stats_get(h);
+
+		if (!sc->calls)
+			continue;
+		printf("%-40s %8" PRIu64 " %10" PRIu64 " %10u %10u\n", stats_name(h),
+		       sc->calls, sc->errors, stats_percentile(sc, 50), stats_percentile(sc, 99));
+	}
+
+	sysstub_counts(&commands, &unit_jobs);
+	netlink_stub_counts(&neigh_syncs);
+	printf("# side effects (all iterations): %lu commands, %lu unit jobs, %lu neighbor syncs\n",
+	       commands, unit_jobs, neigh_syncs);
+}
+
+/*
+ * Synthetic configuration
+ *
+ * Interface i is named bench<i> and has 10.<i/256>.<i%256>.1/24,
+ * fd00:0:0:<i>::1/64 and the IPv4 neighbors BENCH_NEIGH_HOST and up.
+ */
+
+int
+bench_ifindex(unsigned int i)
+{
+	/* 1 is the loopback interface */
+	return i + 2;
+}
+
+void
+bench_if_name(unsigned int i, char *buf, size_t size)
+{
+	snprintf(buf, size, "bench%u", i);
+}
+
+void
+bench_ip(unsigned int i, int family, unsigned int host, void *addr)
+{
+	if (family == AF_INET) {
+		uint8_t *a = addr;
+
+		a[0] = 10;
+		a[1] = i >> 8;
+		a[2] = i;
+		a[3] = host;
+	} else {
+		struct in6_addr *a = addr;
+
+		memset(a, 0, sizeof(*a));
+		a->s6_addr[0] = 0xfd;
+		a->s6_addr[6] = i >> 8;
+		a->s6_addr[7] = i;
+		a->s6_addr[15] = host;
+	}
+}
+
+void
+bench_lladdr(unsigned int i, unsigned int host, uint8_t *mac)
+{
+	mac[0] = 0x02;
+	mac[1] = 0;
+	mac[2] = i >> 8;
+	mac[3] = i;
+	mac[4] = host >> 8;
+	mac[5] = host;
+}
+
+static DM2_REQUEST *
+answer_new(void)
+{
+	DM2_REQUEST *req = dmstub_request_new(NULL);
+
+	dm_add_uint32(req, AVP_RC, VP_TRAVELPING, RC_OK);
+	return req;
+}
+
+static void
+node_begin(DM2_REQUEST *req, uint32_t code, const char *name)
+{
+	dmstub_add_group(req, code);
+	dm_add_string(req, AVP_NAME, VP_TRAVELPING, name);
+}
+
+static void
+instance_begin(DM2_REQUEST *req, uint16_t id)
+{
+	dmstub_add_group(req, AVP_INSTANCE);
+	dm_add_uint16(req, AVP_NAME, VP_TRAVELPING, id);
+}
+
+/** an element, whose value is added by the caller before dm_finalize_group() */
+static void
+element_begin(DM2_REQUEST *req, const char *name, uint32_t type)
+{
+	node_begin(req, AVP_ELEMENT, name);
+	dm_add_uint32(req, AVP_TYPE, VP_TRAVELPING, type);
+}
+
+static void
+add_string_element(DM2_REQUEST *req, const char *name, uint32_t type, const char *value)
+{
+	element_begin(req, name, type);
+	dm_add_string(req, type, VP_TRAVELPING, value);
+	dm_finalize_group(req);
+}
+
+static void
+add_uint8_element(DM2_REQUEST *req, const char *name, uint32_t type, uint8_t value)
+{
+	element_begin(req, name, type);
+	dm_add_uint8(req, type, VP_TRAVELPING, value);
+	dm_finalize_group(req);
+}
+
+static void
+add_uint32_element(DM2_REQUEST *req, const char *name, uint32_t value)
+{
+	element_begin(req, name, AVP_UINT32);
+	dm_add_uint32(req, AVP_UINT32, VP_TRAVELPING, value);
+	dm_finalize_group(req);
+}
+
+static void
+add_address_element(DM2_REQUEST *req, const char *name, int family, const void *addr)
+{
+	element_begin(req, name, AVP_ADDRESS);
+	dm_add_address(req, AVP_ADDRESS, VP_TRAVELPING, family, addr);
+	dm_finalize_group(req);
+}
+
+static void
+set_answer(const char *request, const char *path, DM2_REQUEST *req)
+{
+	dmstub_set_answer(request, path, req);
+	talloc_free(req);
+}
+
+static void
+synthetic_ntp(void)
+{
+	DM2_REQUEST *req = answer_new();
+	char server[32];
+
+	node_begin(req, AVP_OBJECT, "ntp");
+	add_uint8_element(req, "enabled", AVP_BOOL, 1);
+	node_begin(req, AVP_TABLE, "server");
+	for (unsigned int i = 0; i < 2; i++) {
+		snprintf(server, sizeof(server), "%u.pool.ntp.org", i);
+		instance_begin(req, i + 1);
+		node_begin(req, AVP_OBJECT, "udp");
+		add_string_element(req, "address", AVP_STRING, server);
+		dm_finalize_group(req);
+		dm_finalize_group(req);
+	}
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+
+	set_answer("LIST", "system.ntp", req);
+}
+
+static void
+synthetic_ptp(void)
+{
+	DM2_REQUEST *req = answer_new();
+	char name[16];
+
+	bench_if_name(0, name, sizeof(name));
+
+	node_begin(req, AVP_OBJECT, "ptp");
+	add_string_element(req, "state", AVP_ENUM, "slave");
+	add_string_element(req, "interface", AVP_STRING, name);
+	dm_finalize_group(req);
+
+	set_answer("LIST", "system.ptp", req);
+}
+
+static void
+synthetic_dns(void)
+{
+	DM2_REQUEST *req = answer_new();
+
+	node_begin(req, AVP_OBJECT, "dns-resolver");
+	node_begin(req, AVP_ARRAY, "search");
+	dm_add_uint32(req, AVP_TYPE, VP_TRAVELPING, AVP_STRING);
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "example.com");
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "example.net");
+	dm_finalize_group(req);
+	node_begin(req, AVP_TABLE, "server");
+	instance_begin(req, 1);
+	node_begin(req, AVP_OBJECT, "udp-and-tcp");
+	add_string_element(req, "address", AVP_STRING, "192.0.2.53");
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+
+	set_answer("LIST", "system.dns-resolver", req);
+}
+
+static void
+synthetic_authentication(void)
+{
+	static const uint8_t key[32] = { 0xbe, 0x4c };
+	DM2_REQUEST *req = answer_new();
+
+	node_begin(req, AVP_TABLE, "user");
+	instance_begin(req, 1);
+	add_string_element(req, "name", AVP_STRING, "admin");
+	add_string_element(req, "password", AVP_STRING, "$6$bench$");
+	node_begin(req, AVP_TABLE, "ssh-key");
+	instance_begin(req, 1);
+	add_string_element(req, "name", AVP_STRING, "bench");
+	add_string_element(req, "algorithm", AVP_STRING, "ssh-ed25519");
+	element_begin(req, "key-data", AVP_BINARY);
+	dm_add_raw(req, AVP_BINARY, VP_TRAVELPING, key, sizeof(key));
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+
+	set_answer("LIST", "system.authentication.user", req);
+}
+
+static void
+synthetic_ip(DM2_REQUEST *req, unsigned int i, int family)
+{
+	struct in6_addr addr;
+
+	node_begin(req, AVP_OBJECT, family == AF_INET ? "ipv4" : "ipv6");
+	add_uint8_element(req, "enabled", AVP_BOOL, 1);
+	add_uint8_element(req, "forwarding", AVP_BOOL, 0);
+	add_uint32_element(req, "mtu", 1500);
+
+	node_begin(req, AVP_TABLE, "address");
+	instance_begin(req, 1);
+	bench_ip(i, family, 1, &addr);
+	add_address_element(req, "ip", family, &addr);
+	add_uint32_element(req, "prefix-length", family == AF_INET ? 24 : 64);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+
+	if (family == AF_INET) {
+		node_begin(req, AVP_TABLE, "neighbor");
+		for (unsigned int n = 0; n < bench_neighbors; n++) {
+			uint8_t mac[6];
+			char lladdr[18];
+
+			bench_ip(i, family, BENCH_NEIGH_HOST + n, &addr);
+			bench_lladdr(i, 1 + n, mac);
+			snprintf(lladdr, sizeof(lladdr), "%02x:%02x:%02x:%02x:%02x:%02x",
+			         mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+			instance_begin(req, n + 1);
+			add_address_element(req, "ip", family, &addr);
+			add_string_element(req, "link-layer-address", AVP_STRING, lladdr);
+			dm_finalize_group(req);
+		}
+		dm_finalize_group(req);
+	}
+
+	node_begin(req, AVP_ARRAY, "gateway-ip");
+	dm_add_uint32(req, AVP_TYPE, VP_TRAVELPING, AVP_ADDRESS);
+	bench_ip(i, family, 254, &addr);
+	dm_add_address(req, AVP_ADDRESS, VP_TRAVELPING, family, &addr);
+	dm_finalize_group(req);
+
+	dm_finalize_group(req);
+}
+
+static void
+synthetic_interfaces(void)
+{
+	DM2_REQUEST *req = answer_new();
+	char name[16];
+
+	node_begin(req, AVP_TABLE, "interface");
+	for (unsigned int i = 0; i < bench_interfaces; i++) {
+		bench_if_name(i, name, sizeof(name));
+
+		instance_begin(req, i + 1);
+		add_string_element(req, "name", AVP_STRING, name);
+		synthetic_ip(req, i, AF_INET);
+		synthetic_ip(req, i, AF_INET6);
+		dm_finalize_group(req);
+	}
+	dm_finalize_group(req);
+
+	set_answer("LIST", "interfaces.interface", req);
+
+	req = answer_new();
+	node_begin(req, AVP_TABLE, "interfaces");
+	for (unsigned int i = BENCH_DHCP_EVERY - 1; i < bench_interfaces; i += BENCH_DHCP_EVERY) {
+		char path[48];
+
+		snprintf(path, sizeof(path), "interfaces.interface.%u", i + 1);
+		instance_begin(req, i + 1);
+		add_string_element(req, "interface", AVP_PATH, path);
+		dm_finalize_group(req);
+	}
+	dm_finalize_group(req);
+
+	set_answer("LIST", "dhcp.client.interfaces", req);
+}
+
+static void
+synthetic_optional(void)
+{
+	DM2_REQUEST *req;
+
+	req = answer_new();
+	dm_add_uint8(req, AVP_BOOL, VP_TRAVELPING, 1);
+	set_answer("GET", "pulsarlr.autoid-enabled", req);
+
+	req = answer_new();
+	node_begin(req, AVP_OBJECT, "sparkplug");
+	add_string_element(req, "current-server", AVP_PATH, "sparkplug.server.1");
+	add_string_element(req, "username", AVP_STRING, "bench");
+	add_string_element(req, "password", AVP_STRING, "bench-password");
+	node_begin(req, AVP_TABLE, "server");
+	instance_begin(req, 1);
+	add_string_element(req, "host", AVP_STRING, "broker.example.com");
+	add_uint32_element(req, "port", 1883);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	dm_finalize_group(req);
+	set_answer("LIST", "sparkplug", req);
+
+	/* disabled, the modem port does not exist */
+	req = answer_new();
+	dm_add_uint8(req, AVP_BOOL, VP_TRAVELPING, 0);
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "internet");
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "");
+	dm_add_string(req, AVP_ENUM, VP_TRAVELPING, "auto");
+	dm_add_string(req, AVP_ENUM, VP_TRAVELPING, "auto");
+	dmstub_add_group(req, AVP_ARRAY);
+	dm_add_uint32(req, AVP_UINT32, VP_TRAVELPING, 3);
+	dm_add_uint32(req, AVP_UINT32, VP_TRAVELPING, 20);
+	dm_finalize_group(req);
+	set_answer("GET", "wwan.enabled", req);
+
+	req = answer_new();
+	dm_add_uint8(req, AVP_BOOL, VP_TRAVELPING, 1);
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "bench");
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "bench-passphrase");
+	dm_add_string(req, AVP_ENUM, VP_TRAVELPING, "wpa2-personal");
+	dm_add_string(req, AVP_STRING, VP_TRAVELPING, "DE");
+	set_answer("GET", "wifi.enabled", req);
+}
+
+/*
+ * Driver
+ */
+
+static void
+run_until_idle(void)
+{
+	do
+		ev_run(EV_DEFAULT, EVRUN_NOWAIT);
+	while (dmstub_pending() || sysstub_pending());
+}
+
+static void
+get_interface_states(void)
+{
+	DMCONTEXT *ctx = dmstub_context();
+	struct bench_mark mark;
+	DM2_REQUEST *answer;
+	char name[16];
+
+	for (unsigned int i = 0; i < bench_interfaces; i++) {
+		bench_if_name(i, name, sizeof(name));
+		answer = dmstub_request_new(NULL);
+
+		bench_begin(&mark);
+		rpc_client_get_interface_state(ctx, name, answer);
+		bench_end("rpc_client_get_interface_state", &mark);
+
+		talloc_free(answer);
+	}
+
+#if HAVE_DECL_RPC_CLIENT_GET_INTERFACES_STATE
+	answer = dmstub_request_new(NULL);
+
+	bench_begin(&mark);
+	rpc_client_get_interfaces_state(ctx, answer);
+	bench_end("rpc_client_get_interfaces_state", &mark);
+
+	talloc_free(answer);
+#endif
+}
+
+static int
+remove_cb(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static char prefix[] = "/tmp/mand-metropolisd-bench.XXXXXX";
+static bool keep_prefix;
+
+static void
+prefix_cleanup(void)
+{
+	if (!keep_prefix)
+		nftw(prefix, remove_cb, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * Create the temporary directory all files are written to.
+ */
+static int
+prefix_setup(void)
+{
+	static const char *dirs[] = { "systemd", "etc", "etc/default", "etc/netconf", "run", "dev" };
+
+	if (!mkdtemp(prefix) || chdir(prefix) < 0)
+		return -1;
+	atexit(prefix_cleanup);
+
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+		if (mkdir(dirs[i], 0755) < 0)
+			return -1;
+
+	return 0;
+}
+
+static unsigned int
+parse_uint(const char *arg, const char *what, unsigned int max)
+{
+	char *end;
+	unsigned long v = strtoul(arg, &end, 10);
+
+	if (*arg == '\0' || *end != '\0' || v > max) {
+		fprintf(stderr, "Invalid %s: '%s'\n", what, arg);
+		exit(EXIT_FAILURE);
+	}
+
+	return v;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: mand-metropolisd-bench [options] [recording...]\n"
+	       "\n"
+	       "Options:\n"
+	       "  -h                        this help\n"
+	       "  -i, --interfaces N        synthetic interfaces (default 100)\n"
+	       "  -n, --neighbors N         IPv4 neighbors per interface (default 4)\n"
+	       "  -c, --iterations N        measured iterations (default 10)\n"
+	       "  -W, --warm                start warm from the snapshot of the previous iteration\n"
+	       "  -w, --write DIR           write the answers as recordings to DIR\n"
+	       "  -k, --keep                keep the temporary directory\n"
+	       "  -x                        debug logging\n"
+	       "\n"
+	       "Recordings replace the synthetic answers to their requests.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int iterations = 10;
+	const char *write_dir = NULL;
+	bool warm = false;
+	int c;
+
+	logx_level = LOG_WARNING;
+
+	while (1) {
+		int option_index = 0;
+		static struct option long_options[] = {
+			{"interfaces", 1, 0, 'i'},
+			{"neighbors",  1, 0, 'n'},
+			{"iterations", 1, 0, 'c'},
+			{"warm",       0, 0, 'W'},
+			{"write",      1, 0, 'w'},
+			{"keep",       0, 0, 'k'},
+			{0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "hi:n:c:Ww:kx",
+				long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'h':
+			usage();
+			break;
+		case 'i':
+			/* the addressing scheme supports 2^16 interfaces */
+			bench_interfaces = parse_uint(optarg, "number of interfaces", UINT16_MAX);
+			break;
+		case 'n':
+			bench_neighbors = parse_uint(optarg, "number of neighbors", 254 - BENCH_NEIGH_HOST);
+			break;
+		case 'c':
+			iterations = parse_uint(optarg, "number of iterations", 1000000);
+			break;
+		case 'W':
+			warm = true;
+			break;
+		case 'w':
+			write_dir = optarg;
+			break;
+		case 'k':
+			keep_prefix = true;
+			break;
+		case 'x':
+			logx_level = LOG_DEBUG;
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	logx_open("mand-metropolisd-bench", LOG_CONS | LOG_PERROR, LOG_USER);
+
+	synthetic_ntp();
+	synthetic_ptp();
+	synthetic_dns();
+	synthetic_authentication();
+	synthetic_interfaces();
+	synthetic_optional();
+
+	for (int i = optind; i < argc; i++)
+		if (dmstub_load_answer(argv[i]) < 0) {
+			fprintf(stderr, "Cannot load %s: %s\n", argv[i], strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+	if (write_dir && dmstub_save_answers(write_dir) < 0) {
+		fprintf(stderr, "Cannot write recordings to %s: %s\n", write_dir, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (prefix_setup() < 0) {
+		fprintf(stderr, "Cannot create %s: %s\n", prefix, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	if (keep_prefix)
+		fprintf(stderr, "Writing to %s\n", prefix);
+
+	init_log(EV_DEFAULT);
+
+	/* active notifications are not simulated */
+	notify_debounce = 0;
+
+	init_exec(EV_DEFAULT);
+	init_worker(EV_DEFAULT);
+	init_ptp(EV_DEFAULT);
+	init_systemd(EV_DEFAULT);
+	init_comm(EV_DEFAULT);
+
+	/* the first iteration is a warm-up and not reported */
+	for (unsigned int i = 0; i <= iterations; i++) {
+		recording = i > 0;
+
+		if (i > 0) {
+			/* socketConnected() rearms the snapshot for warm starts */
+			if (!warm)
+				for (int s = 0; s < SNAPSHOT_SUBSYSTEMS; s++)
+					snapshot_invalidate(s);
+			dmstub_connect();
+		}
+
+		run_until_idle();
+		get_interface_states();
+	}
+
+	report(iterations, warm);
+
+	return 0;
+}
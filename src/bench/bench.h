@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libdmconfig/dmcontext.h>
+
+/** Synthetic configuration, see bench.c */
+extern unsigned int bench_interfaces;
+extern unsigned int bench_neighbors;
+
+/** host part of the first neighbor of an interface */
+#define BENCH_NEIGH_HOST 10
+
+int bench_ifindex(unsigned int i);
+void bench_if_name(unsigned int i, char *buf, size_t size);
+void bench_ip(unsigned int i, int family, unsigned int host, void *addr);
+void bench_lladdr(unsigned int i, unsigned int host, uint8_t *mac);
+
+/**
+ * Start of a measurement, see bench_begin().
+ */
+struct bench_mark {
+	uint64_t ns;
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+void bench_begin(struct bench_mark *mark);
+void bench_end(const char *name, const struct bench_mark *mark);
+
+/* libdmconfig replacement, see dmstub.c */
+
+DMCONTEXT *dmstub_context(void);
+void dmstub_connect(void);
+bool dmstub_pending(void);
+
+DM2_REQUEST *dmstub_request_new(void *ctx);
+uint32_t dmstub_add_group(DM2_REQUEST *req, uint32_t code);
+
+void dmstub_set_answer(const char *request, const char *path, const DM2_REQUEST *answer);
+int dmstub_load_answer(const char *file);
+int dmstub_save_answers(const char *dir);
+
+/* exec.c and systemd.c replacement, see sysstub.c */
+
+bool sysstub_pending(void);
+void sysstub_counts(unsigned long *commands, unsigned long *unit_jobs);
+
+/* netlink.c replacement, see netlink_stub.c */
+
+void netlink_stub_counts(unsigned long *neigh_syncs);
+
+#endif
@@ -0,0 +1,923 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * libdmconfig replacement of the benchmark.
+ *
+ * There is no connection to mand: requests of the agent are queued and
+ * answered from the event loop in the order they were sent, as mand does.
+ * LIST and GET requests are answered with the payload registered for
+ * their path by dmstub_set_answer() or dmstub_load_answer(), all other
+ * requests succeed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <sys/queue.h>
+
+#include <ev.h>
+
+#ifdef HAVE_TALLOC_TALLOC_H
+# include <talloc/talloc.h>
+#else
+# include <talloc.h>
+#endif
+
+#include <libdmconfig/codes.h>
+#include <libdmconfig/dmmsg.h>
+#include <libdmconfig/dmcontext.h>
+#include <libdmconfig/dmconfig.h>
+#include <libdmconfig/dm_dmconfig_rpc_stub.h>
+#include <libdmconfig/dm_dmclient_rpc_impl.h>
+
+#include "bench.h"
+
+#define AVP_FLAG_VENDOR	0x80
+#define AVP_HDR_SIZE	12
+
+/* diameter address families */
+#define AVP_ADDRESS_IPV4	1
+#define AVP_ADDRESS_IPV6	2
+
+#define AVP_PAD(len) (((len) + 3) & ~(size_t)3)
+
+/**
+ * A request of the agent waiting for its answer.
+ */
+struct dm_request {
+	TAILQ_ENTRY(dm_request) entry;
+
+	/** request type, e.g. "LIST", see queue() */
+	const char *request;
+	/** first path of the request, NULL if it has none */
+	char *path;
+
+	DMCONFIG_CALLBACK cb;
+	void *data;
+};
+
+/**
+ * The answer to a LIST or GET request of a path.
+ */
+struct dm_answer {
+	LIST_ENTRY(dm_answer) entry;
+
+	char *request;
+	char *path;
+	void *data;
+	size_t size;
+};
+
+static DMCONTEXT *dm_ctx;
+static bool dm_connect_pending;
+static TAILQ_HEAD(, dm_request) dm_queue = TAILQ_HEAD_INITIALIZER(dm_queue);
+static LIST_HEAD(, dm_answer) dm_answers = LIST_HEAD_INITIALIZER(dm_answers);
+static ev_idle dm_dispatch_watcher;
+
+/*
+ * Encoding
+ */
+
+static uint32_t
+req_reserve(DM2_REQUEST *req, size_t size)
+{
+	size_t alloc = req->alloc ? : 256;
+
+	if (req->size + size <= req->alloc)
+		return RC_OK;
+
+	while (alloc < req->size + size)
+		alloc *= 2;
+	if (!(req->data = talloc_realloc(req, req->data, uint8_t, alloc)))
+		return RC_ERR_ALLOC;
+	req->alloc = alloc;
+
+	return RC_OK;
+}
+
+static void
+put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void
+put_header(uint8_t *p, uint32_t code, uint32_t vendor_id, size_t len)
+{
+	put_be32(p, code);
+	put_be32(p + 4, len);
+	p[4] = AVP_FLAG_VENDOR;
+	put_be32(p + 8, vendor_id);
+}
+
+uint32_t
+dm_add_raw(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const void *data, size_t size)
+{
+	size_t len = AVP_HDR_SIZE + size;
+	uint32_t rc;
+
+	if (len > 0xffffff)
+		return RC_ERR_VALUE;
+	if ((rc = req_reserve(req, AVP_PAD(len))) != RC_OK)
+		return rc;
+
+	put_header(req->data + req->size, code, vendor_id, len);
+	if (size)
+		memcpy(req->data + req->size + AVP_HDR_SIZE, data, size);
+	memset(req->data + req->size + len, 0, AVP_PAD(len) - len);
+	req->size += AVP_PAD(len);
+
+	return RC_OK;
+}
+
+uint32_t
+dm_add_string(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const char *value)
+{
+	return dm_add_raw(req, code, vendor_id, value, strlen(value));
+}
+
+uint32_t
+dm_add_uint8(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint8_t value)
+{
+	return dm_add_raw(req, code, vendor_id, &value, sizeof(value));
+}
+
+uint32_t
+dm_add_uint16(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint16_t value)
+{
+	uint16_t v = htons(value);
+
+	return dm_add_raw(req, code, vendor_id, &v, sizeof(v));
+}
+
+uint32_t
+dm_add_uint32(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint32_t value)
+{
+	uint8_t v[4];
+
+	put_be32(v, value);
+	return dm_add_raw(req, code, vendor_id, v, sizeof(v));
+}
+
+uint32_t
+dm_add_int32(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, int32_t value)
+{
+	return dm_add_uint32(req, code, vendor_id, (uint32_t)value);
+}
+
+uint32_t
+dm_add_uint64(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint64_t value)
+{
+	uint8_t v[8];
+
+	put_be32(v, value >> 32);
+	put_be32(v + 4, value);
+	return dm_add_raw(req, code, vendor_id, v, sizeof(v));
+}
+
+uint32_t
+dm_add_address(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, int af, const void *addr)
+{
+	uint8_t v[2 + sizeof(struct in6_addr)];
+	size_t size;
+
+	switch (af) {
+	case AF_INET:
+		v[1] = AVP_ADDRESS_IPV4;
+		size = sizeof(struct in_addr);
+		break;
+	case AF_INET6:
+		v[1] = AVP_ADDRESS_IPV6;
+		size = sizeof(struct in6_addr);
+		break;
+	default:
+		return RC_ERR_VALUE;
+	}
+
+	v[0] = 0;
+	memcpy(v + 2, addr, size);
+	return dm_add_raw(req, code, vendor_id, v, 2 + size);
+}
+
+/**
+ * Open a group, closed by dm_finalize_group().
+ *
+ * @param req The request to add the group to.
+ * @param code AVP code of the group, e.g. AVP_TABLE.
+ * @returns According dmconfig RC.
+ */
+uint32_t
+dmstub_add_group(DM2_REQUEST *req, uint32_t code)
+{
+	uint32_t rc;
+
+	if (req->level == DM_REQUEST_MAX_DEPTH)
+		return RC_ERR_MISC;
+	if ((rc = req_reserve(req, AVP_HDR_SIZE)) != RC_OK)
+		return rc;
+
+	req->grp[req->level++] = req->size;
+	put_header(req->data + req->size, code, VP_TRAVELPING, AVP_HDR_SIZE);
+	req->size += AVP_HDR_SIZE;
+
+	return RC_OK;
+}
+
+uint32_t
+dm_add_object(DM2_REQUEST *req)
+{
+	return dmstub_add_group(req, AVP_CONTAINER);
+}
+
+uint32_t
+dm_finalize_group(DM2_REQUEST *req)
+{
+	uint8_t *hdr;
+	size_t len;
+
+	if (req->level == 0)
+		return RC_ERR_MISC;
+
+	hdr = req->data + req->grp[--req->level];
+	/* members are padded, so the group is as well */
+	len = req->data + req->size - hdr;
+	if (len > 0xffffff)
+		return RC_ERR_VALUE;
+
+	hdr[5] = len >> 16;
+	hdr[6] = len >> 8;
+	hdr[7] = len;
+
+	return RC_OK;
+}
+
+/**
+ * Create an empty answer.
+ *
+ * @param ctx talloc context of the answer.
+ * @returns The answer or NULL.
+ */
+DM2_REQUEST *
+dmstub_request_new(void *ctx)
+{
+	DM2_REQUEST *req;
+
+	if (!(req = talloc_zero(ctx, DM2_REQUEST)))
+		return NULL;
+	req->ctx = req;
+
+	return req;
+}
+
+/*
+ * Decoding
+ */
+
+void
+dm_init_avpgrp(void *ctx, void *data, size_t size, DM2_AVPGRP *grp)
+{
+	grp->ctx = ctx;
+	grp->data = data;
+	grp->size = size;
+	grp->pos = 0;
+}
+
+uint32_t
+dm_expect_avp(DM2_AVPGRP *grp, uint32_t *code, uint32_t *vendor_id, void **data, size_t *size)
+{
+	const uint8_t *p = (const uint8_t *)grp->data + grp->pos;
+	size_t hdr, len;
+
+	if (grp->size - grp->pos < 8)
+		return RC_ERR_MISC;
+
+	hdr = (p[4] & AVP_FLAG_VENDOR) ? AVP_HDR_SIZE : 8;
+	len = get_be32(p + 4) & 0xffffff;
+	if (len < hdr || len > grp->size - grp->pos)
+		return RC_ERR_MISC;
+
+	*code = get_be32(p);
+	*vendor_id = hdr == AVP_HDR_SIZE ? get_be32(p + 8) : 0;
+	*data = (void *)(p + hdr);
+	*size = len - hdr;
+
+	grp->pos += AVP_PAD(len);
+	if (grp->pos > grp->size)
+		grp->pos = grp->size;
+
+	return RC_OK;
+}
+
+/**
+ * Get the next AVP, which must have the given code and size.
+ *
+ * @param size Expected size or 0 for any size.
+ */
+static uint32_t
+expect_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, size_t size,
+            void **data, size_t *len)
+{
+	uint32_t c, v, rc;
+
+	if ((rc = dm_expect_avp(grp, &c, &v, data, len)) != RC_OK)
+		return rc;
+	if (c != code || v != vendor_id || (size && *len != size))
+		return RC_ERR_MISC;
+
+	return RC_OK;
+}
+
+uint32_t
+dm_expect_string_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, char **value)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, 0, &data, &size)) != RC_OK)
+		return rc;
+	if (!(*value = talloc_strndup(grp->ctx, data, size)))
+		return RC_ERR_ALLOC;
+
+	return RC_OK;
+}
+
+uint8_t
+dm_get_uint8_avp(const void *data)
+{
+	return *(const uint8_t *)data;
+}
+
+uint16_t
+dm_get_uint16_avp(const void *data)
+{
+	const uint8_t *p = data;
+
+	return p[0] << 8 | p[1];
+}
+
+uint32_t
+dm_get_uint32_avp(const void *data)
+{
+	return get_be32(data);
+}
+
+uint64_t
+dm_get_uint64_avp(const void *data)
+{
+	return (uint64_t)get_be32(data) << 32 | get_be32((const uint8_t *)data + 4);
+}
+
+int32_t
+dm_get_int32_avp(const void *data)
+{
+	return (int32_t)get_be32(data);
+}
+
+uint32_t
+dm_expect_uint8_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint8_t *value)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, sizeof(*value), &data, &size)) == RC_OK)
+		*value = dm_get_uint8_avp(data);
+	return rc;
+}
+
+uint32_t
+dm_expect_uint16_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint16_t *value)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, sizeof(*value), &data, &size)) == RC_OK)
+		*value = dm_get_uint16_avp(data);
+	return rc;
+}
+
+uint32_t
+dm_expect_uint32_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint32_t *value)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, sizeof(*value), &data, &size)) == RC_OK)
+		*value = dm_get_uint32_avp(data);
+	return rc;
+}
+
+uint32_t
+dm_expect_uint64_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint64_t *value)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, sizeof(*value), &data, &size)) == RC_OK)
+		*value = dm_get_uint64_avp(data);
+	return rc;
+}
+
+uint32_t
+dm_expect_group(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, DM2_AVPGRP *obj)
+{
+	void *data;
+	size_t size;
+	uint32_t rc;
+
+	if ((rc = expect_type(grp, code, vendor_id, 0, &data, &size)) == RC_OK)
+		dm_init_avpgrp(grp->ctx, data, size, obj);
+	return rc;
+}
+
+uint32_t
+dm_expect_object(DM2_AVPGRP *grp, DM2_AVPGRP *obj)
+{
+	return dm_expect_group(grp, AVP_CONTAINER, VP_TRAVELPING, obj);
+}
+
+uint32_t
+dm_expect_value(DM2_AVPGRP *grp, struct dm2_avp *avp)
+{
+	return dm_expect_avp(grp, &avp->code, &avp->vendor_id, &avp->data, &avp->size);
+}
+
+uint32_t
+dm_expect_group_end(DM2_AVPGRP *grp)
+{
+	return grp->pos < grp->size ? RC_ERR_MISC : RC_OK;
+}
+
+uint32_t
+dm_expect_end(DM2_AVPGRP *grp)
+{
+	return dm_expect_group_end(grp);
+}
+
+void *
+dm_get_address_avp(int *af, void *addr, socklen_t size, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t addr_len;
+
+	if (len < 2)
+		return NULL;
+
+	switch (p[0] << 8 | p[1]) {
+	case AVP_ADDRESS_IPV4:
+		*af = AF_INET;
+		addr_len = sizeof(struct in_addr);
+		break;
+	case AVP_ADDRESS_IPV6:
+		*af = AF_INET6;
+		addr_len = sizeof(struct in6_addr);
+		break;
+	default:
+		return NULL;
+	}
+
+	if (len != 2 + addr_len || size < addr_len)
+		return NULL;
+
+	memcpy(addr, p + 2, addr_len);
+	return addr;
+}
+
+uint32_t
+dm_decode_unknown_as_string(uint32_t type, void *data, size_t size, char **value)
+{
+	char buf[INET6_ADDRSTRLEN];
+	struct in6_addr addr;
+	int af;
+
+	switch (type) {
+	case AVP_STRING:
+	case AVP_ENUM:
+	case AVP_PATH:
+		*value = talloc_strndup(NULL, data, size);
+		break;
+	case AVP_BOOL:
+		*value = talloc_strdup(NULL, size == 1 && dm_get_uint8_avp(data) ? "true" : "false");
+		break;
+	case AVP_UINT8:
+		*value = size != 1 ? NULL : talloc_asprintf(NULL, "%u", dm_get_uint8_avp(data));
+		break;
+	case AVP_UINT16:
+		*value = size != 2 ? NULL : talloc_asprintf(NULL, "%u", dm_get_uint16_avp(data));
+		break;
+	case AVP_UINT32:
+		*value = size != 4 ? NULL : talloc_asprintf(NULL, "%u", dm_get_uint32_avp(data));
+		break;
+	case AVP_INT32:
+		*value = size != 4 ? NULL : talloc_asprintf(NULL, "%d", dm_get_int32_avp(data));
+		break;
+	case AVP_UINT64:
+		*value = size != 8 ? NULL : talloc_asprintf(NULL, "%" PRIu64, dm_get_uint64_avp(data));
+		break;
+	case AVP_INT64:
+		*value = size != 8 ? NULL : talloc_asprintf(NULL, "%" PRId64,
+		                                             (int64_t)dm_get_uint64_avp(data));
+		break;
+	case AVP_ADDRESS:
+		if (!dm_get_address_avp(&af, &addr, sizeof(addr), data, size))
+			return RC_ERR_VALUE;
+		*value = talloc_strdup(NULL, inet_ntop(af, &addr, buf, sizeof(buf)));
+		break;
+	default:
+		return RC_ERR_VALUE;
+	}
+
+	return *value ? RC_OK : RC_ERR_VALUE;
+}
+
+/*
+ * Packets are only passed to the request callback of the agent, which
+ * is never called: requests from mand are simulated by calling the
+ * rpc_client_*() functions directly.
+ */
+
+uint32_t dm_hop2hop_id(DM_PACKET *pkt) { return 0; }
+uint32_t dm_end2end_id(DM_PACKET *pkt) { return 0; }
+uint32_t dm_packet_code(DM_PACKET *pkt) { return 0; }
+uint32_t dm_packet_flags(DM_PACKET *pkt) { return 0; }
+void dump_dm_packet(DM_PACKET *pkt) { }
+
+uint32_t
+rpc_dmclient_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQUEST **answer)
+{
+	*answer = NULL;
+	return RC_ERR_MISC;
+}
+
+/*
+ * Answers
+ */
+
+static struct dm_answer *
+answer_lookup(const char *request, const char *path)
+{
+	struct dm_answer *a;
+
+	if (!path)
+		return NULL;
+
+	LIST_FOREACH(a, &dm_answers, entry)
+		if (!strcmp(a->request, request) && !strcmp(a->path, path))
+			return a;
+
+	return NULL;
+}
+
+static void
+answer_set(const char *request, const char *path, const void *data, size_t size)
+{
+	struct dm_answer *a;
+
+	if (!(a = answer_lookup(request, path))) {
+		if (!(a = talloc_zero(NULL, struct dm_answer)))
+			return;
+		a->request = talloc_strdup(a, request);
+		a->path = talloc_strdup(a, path);
+		LIST_INSERT_HEAD(&dm_answers, a, entry);
+	}
+
+	talloc_free(a->data);
+	a->data = talloc_memdup(a, data, size);
+	a->size = size;
+}
+
+/**
+ * Register the answer to the LIST or GET requests of a path.
+ *
+ * @param request "LIST" or "GET".
+ * @param path The listed path or the first path of the GET.
+ * @param answer The answer, starting with its AVP_RC.
+ */
+void
+dmstub_set_answer(const char *request, const char *path, const DM2_REQUEST *answer)
+{
+	answer_set(request, path, answer->data, answer->size);
+}
+
+/**
+ * Register a recorded answer.
+ *
+ * Recordings consist of a line with the request and the path,
+ * e.g. "LIST interfaces.interface", followed by the AVPs of the answer.
+ *
+ * @param file The recording.
+ * @returns 0 or -1 with errno set.
+ */
+int
+dmstub_load_answer(const char *file)
+{
+	char request[16], path[256];
+	uint8_t *buf = NULL;
+	size_t size = 0, len;
+	FILE *fin;
+	int r = -1;
+
+	if (!(fin = fopen(file, "r")))
+		return -1;
+
+	if (fscanf(fin, "%15s %255[^\n]", request, path) != 2 || fgetc(fin) != '\n') {
+		errno = EINVAL;
+		goto exit;
+	}
+
+	do {
+		if (!(buf = talloc_realloc(NULL, buf, uint8_t, size + 4096))) {
+			errno = ENOMEM;
+			goto exit;
+		}
+		size += len = fread(buf + size, 1, 4096, fin);
+	} while (len == 4096);
+
+	if (ferror(fin))
+		goto exit;
+
+	answer_set(request, path, buf, size);
+	r = 0;
+
+exit:
+	talloc_free(buf);
+	fclose(fin);
+	return r;
+}
+
+/**
+ * Write all registered answers as recordings, see dmstub_load_answer().
+ *
+ * @param dir Directory to write to, one file per answer.
+ * @returns 0 or -1 with errno set.
+ */
+int
+dmstub_save_answers(const char *dir)
+{
+	struct dm_answer *a;
+
+	LIST_FOREACH(a, &dm_answers, entry) {
+		char file[PATH_MAX];
+		FILE *fout;
+		bool ok;
+
+		snprintf(file, sizeof(file), "%s/%s-%s.avp", dir, a->request, a->path);
+		if (!(fout = fopen(file, "w")))
+			return -1;
+
+		ok = fprintf(fout, "%s %s\n", a->request, a->path) > 0 &&
+		     fwrite(a->data, 1, a->size, fout) == a->size;
+		if (fclose(fout) != 0 || !ok)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Requests
+ */
+
+static void
+dispatch(struct dm_request *rq)
+{
+	struct dm_answer *a = answer_lookup(rq->request, rq->path);
+	void *ctx = talloc_new(NULL);
+	struct bench_mark mark;
+	DM2_AVPGRP grp;
+	char name[288];
+	void *data;
+	size_t size;
+
+	if (a) {
+		/* the agent gets a copy, as if it had been received */
+		data = talloc_memdup(ctx, a->data, a->size);
+		size = a->size;
+	} else {
+		DM2_REQUEST *answer = dmstub_request_new(ctx);
+		bool lookup = !strcmp(rq->request, "LIST") || !strcmp(rq->request, "GET");
+
+		/* paths without answer do not exist */
+		dm_add_uint32(answer, AVP_RC, VP_TRAVELPING, lookup ? RC_ERR_VALUE : RC_OK);
+		data = answer->data;
+		size = answer->size;
+	}
+	dm_init_avpgrp(ctx, data, size, &grp);
+
+	snprintf(name, sizeof(name), "%s%s%s", rq->request, rq->path ? ":" : "", rq->path ? : "");
+
+	bench_begin(&mark);
+	rq->cb(dm_ctx, DMCONFIG_ANSWER_READY, &grp, rq->data);
+	bench_end(name, &mark);
+
+	talloc_free(ctx);
+}
+
+static void
+dispatch_cb(EV_P_ ev_idle *w, int revents __attribute__((unused)))
+{
+	struct dm_request *rq;
+
+	if (dm_connect_pending) {
+		struct bench_mark mark;
+
+		dm_connect_pending = false;
+		bench_begin(&mark);
+		dm_ctx->connect_cb(DMCONFIG_CONNECTED, dm_ctx, dm_ctx->userdata);
+		bench_end("CONNECT", &mark);
+	}
+
+	/* answers may queue further requests, which are answered in turn */
+	while ((rq = TAILQ_FIRST(&dm_queue))) {
+		TAILQ_REMOVE(&dm_queue, rq, entry);
+		if (rq->cb)
+			dispatch(rq);
+		talloc_free(rq);
+	}
+
+	ev_idle_stop(EV_A_ w);
+}
+
+static uint32_t
+queue(DMCONTEXT *ctx, const char *request, const char *path, DMCONFIG_CALLBACK cb, void *data)
+{
+	struct dm_request *rq;
+
+	if (!(rq = talloc_zero(NULL, struct dm_request)))
+		return RC_ERR_ALLOC;
+
+	rq->request = request;
+	if (path && !(rq->path = talloc_strdup(rq, path))) {
+		talloc_free(rq);
+		return RC_ERR_ALLOC;
+	}
+	rq->cb = cb;
+	rq->data = data;
+
+	TAILQ_INSERT_TAIL(&dm_queue, rq, entry);
+	ev_idle_start(ctx->ev, &dm_dispatch_watcher);
+
+	return RC_OK;
+}
+
+uint32_t
+rpc_startsession_async(DMCONTEXT *ctx, uint32_t flags, int32_t timeout,
+                       DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "STARTSESSION", NULL, cb, data);
+}
+
+uint32_t
+rpc_register_role_async(DMCONTEXT *ctx, const char *role, DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "REGISTER_ROLE", NULL, cb, data);
+}
+
+uint32_t
+rpc_subscribe_notify_async(DMCONTEXT *ctx, DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "SUBSCRIBE_NOTIFY", NULL, cb, data);
+}
+
+uint32_t
+rpc_param_notify_async(DMCONTEXT *ctx, uint32_t notify, int count, const char **paths,
+                       DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "PARAM_NOTIFY", NULL, cb, data);
+}
+
+uint32_t
+rpc_recursive_param_notify_async(DMCONTEXT *ctx, uint32_t notify, const char *path,
+                                 DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "RECURSIVE_PARAM_NOTIFY", NULL, cb, data);
+}
+
+uint32_t
+rpc_db_set_async(DMCONTEXT *ctx, int count, const struct rpc_db_set_path_value *values,
+                 DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "SET", NULL, cb, data);
+}
+
+uint32_t
+rpc_db_get_async(DMCONTEXT *ctx, int count, const char **paths,
+                 DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "GET", count ? paths[0] : NULL, cb, data);
+}
+
+uint32_t
+rpc_db_list_async(DMCONTEXT *ctx, int level, const char *path,
+                  DMCONFIG_CALLBACK cb, void *data)
+{
+	return queue(ctx, "LIST", path, cb, data);
+}
+
+/*
+ * Context
+ */
+
+DMCONTEXT *
+dm_context_new(void)
+{
+	if (!dm_ctx) {
+		dm_ctx = talloc_zero(NULL, DMCONTEXT);
+		ev_idle_init(&dm_dispatch_watcher, dispatch_cb);
+	}
+	return dm_ctx;
+}
+
+void
+dm_context_init(DMCONTEXT *socket, struct ev_loop *loop, int type, void *userdata,
+                DMCONFIG_CONNECT_CALLBACK connect_cb, DMCONFIG_REQUEST_CALLBACK request_cb)
+{
+	socket->ev = loop;
+	socket->socket = -1;
+	socket->userdata = userdata;
+	socket->connect_cb = connect_cb;
+	socket->request_cb = request_cb;
+}
+
+uint32_t
+dm_connect_async(DMCONTEXT *socket)
+{
+	dm_connect_pending = true;
+	ev_idle_start(socket->ev, &dm_dispatch_watcher);
+
+	return RC_OK;
+}
+
+/**
+ * Drops all unanswered requests.
+ */
+void
+dm_context_shutdown(DMCONTEXT *socket, DMCONFIG_EVENT event)
+{
+	struct dm_request *rq;
+
+	dm_connect_pending = false;
+	while ((rq = TAILQ_FIRST(&dm_queue))) {
+		TAILQ_REMOVE(&dm_queue, rq, entry);
+		talloc_free(rq);
+	}
+}
+
+void dm_context_reference(DMCONTEXT *socket) { }
+void dm_context_release(DMCONTEXT *socket) { }
+
+/** answers to requests from mand, never sent, see rpc_dmclient_switch() */
+uint32_t
+dm_enqueue(DMCONTEXT *socket, DM2_REQUEST *req, int flags, DMCONFIG_CALLBACK cb, void *data)
+{
+	return RC_OK;
+}
+
+DMCONTEXT *
+dmstub_context(void)
+{
+	return dm_ctx;
+}
+
+/**
+ * Connect again, which runs the complete startup of the agent.
+ */
+void
+dmstub_connect(void)
+{
+	dm_connect_async(dm_ctx);
+}
+
+/**
+ * @returns true while requests (or the connect) wait for their answers.
+ */
+bool
+dmstub_pending(void)
+{
+	return dm_connect_pending || !TAILQ_EMPTY(&dm_queue);
+}
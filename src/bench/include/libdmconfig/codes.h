@@ -0,0 +1,67 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ *
+ * Only the parts used by the agent are declared. The values are private
+ * to the benchmark, recorded answers are written and read by it alone.
+ */
+
+#ifndef __LIBDMCONFIG_CODES_H
+#define __LIBDMCONFIG_CODES_H
+
+#define RC_OK			0
+#define RC_ERR_MISC		1
+#define RC_ERR_ALLOC		2
+#define RC_ERR_VALUE		3
+#define RC_ERR_REQUIRES_NOTIFY	4
+
+#define VP_TRAVELPING		18681
+
+enum {
+	AVP_RC = 1,
+	AVP_PATH,
+	AVP_TABLE,
+	AVP_INSTANCE,
+	AVP_OBJECT,
+	AVP_ELEMENT,
+	AVP_ARRAY,
+	AVP_NAME,
+	AVP_TYPE,
+	AVP_STRING,
+	AVP_ENUM,
+	AVP_BOOL,
+	AVP_UINT8,
+	AVP_UINT16,
+	AVP_UINT32,
+	AVP_UINT64,
+	AVP_INT32,
+	AVP_INT64,
+	AVP_ADDRESS,
+	AVP_BINARY,
+	AVP_NOTIFY_TYPE,
+	AVP_CONTAINER,
+	AVP_ABSTICKS,
+	AVP_RELTICKS,
+	AVP_DATE,
+	AVP_UNKNOWN
+};
+
+enum {
+	NOTIFY_INSTANCE_CREATED,
+	NOTIFY_INSTANCE_DELETED,
+	NOTIFY_PARAMETER_CHANGED
+};
+
+enum {
+	NOTIFY_NOTHING,
+	NOTIFY_PASSIVE,
+	NOTIFY_ACTIVE
+};
+
+#define CMD_FLAG_READWRITE	0x01
+#define CMD_FLAG_REQUEST	0x80
+
+#endif
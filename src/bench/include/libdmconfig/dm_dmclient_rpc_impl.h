@@ -0,0 +1,24 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ *
+ * Requests from mand are not simulated, the benchmark calls the
+ * rpc_client_*() implementations of the agent directly.
+ */
+
+#ifndef __LIBDMCONFIG_DM_DMCLIENT_RPC_IMPL_H
+#define __LIBDMCONFIG_DM_DMCLIENT_RPC_IMPL_H
+
+#include "dmconfig.h"
+
+uint32_t rpc_dmclient_switch(void *ctx, const DMC_REQUEST *req, DM2_AVPGRP *obj, DM2_REQUEST **answer);
+
+uint32_t rpc_client_active_notify(void *ctx, DM2_AVPGRP *obj);
+uint32_t rpc_client_event_broadcast(void *ctx, const char *path, uint32_t type);
+uint32_t rpc_client_get_interface_state(void *ctx, const char *if_name, DM2_REQUEST *answer);
+uint32_t rpc_client_get_interfaces_state(void *ctx, DM2_REQUEST *answer);
+
+#endif
@@ -0,0 +1,30 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ */
+
+#ifndef __LIBDMCONFIG_DM_DMCONFIG_RPC_STUB_H
+#define __LIBDMCONFIG_DM_DMCONFIG_RPC_STUB_H
+
+#include "dmconfig.h"
+
+uint32_t rpc_startsession_async(DMCONTEXT *ctx, uint32_t flags, int32_t timeout,
+                                DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_register_role_async(DMCONTEXT *ctx, const char *role,
+                                 DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_subscribe_notify_async(DMCONTEXT *ctx, DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_param_notify_async(DMCONTEXT *ctx, uint32_t notify, int count, const char **paths,
+                                DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_recursive_param_notify_async(DMCONTEXT *ctx, uint32_t notify, const char *path,
+                                          DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_db_set_async(DMCONTEXT *ctx, int count, const struct rpc_db_set_path_value *values,
+                          DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_db_get_async(DMCONTEXT *ctx, int count, const char **paths,
+                          DMCONFIG_CALLBACK cb, void *data);
+uint32_t rpc_db_list_async(DMCONTEXT *ctx, int level, const char *path,
+                           DMCONFIG_CALLBACK cb, void *data);
+
+#endif
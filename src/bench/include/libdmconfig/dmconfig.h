@@ -0,0 +1,19 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ */
+
+#ifndef __LIBDMCONFIG_DMCONFIG_H
+#define __LIBDMCONFIG_DMCONFIG_H
+
+#include "dmcontext.h"
+
+struct rpc_db_set_path_value {
+	const char *path;
+	struct dm2_avp value;
+};
+
+#endif
@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ */
+
+#ifndef __LIBDMCONFIG_DMCONTEXT_H
+#define __LIBDMCONFIG_DMCONTEXT_H
+
+#include <stdint.h>
+#include <ev.h>
+
+#include "dmmsg.h"
+
+typedef enum {
+	DMCONFIG_OK,
+	DMCONFIG_ERROR_CONNECTING,
+	DMCONFIG_CONNECTED,
+	DMCONFIG_ANSWER_READY,
+	DMCONFIG_ERROR_WRITING,
+	DMCONFIG_ERROR_READING
+} DMCONFIG_EVENT;
+
+typedef struct dmcontext DMCONTEXT;
+
+typedef struct {
+	uint32_t hop2hop;
+	uint32_t end2end;
+	uint32_t code;
+} DMC_REQUEST;
+
+typedef uint32_t (*DMCONFIG_CONNECT_CALLBACK)(DMCONFIG_EVENT event, DMCONTEXT *socket, void *userdata);
+typedef void (*DMCONFIG_CALLBACK)(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata);
+typedef void (*DMCONFIG_REQUEST_CALLBACK)(DMCONTEXT *socket, DM_PACKET *pkt, DM2_AVPGRP *grp, void *userdata);
+
+struct dmcontext {
+	struct ev_loop *ev;
+	int socket;
+
+	DMCONFIG_CONNECT_CALLBACK connect_cb;
+	DMCONFIG_REQUEST_CALLBACK request_cb;
+	void *userdata;
+};
+
+#define REPLY 1
+
+DMCONTEXT *dm_context_new(void);
+void dm_context_init(DMCONTEXT *socket, struct ev_loop *loop, int type, void *userdata,
+                     DMCONFIG_CONNECT_CALLBACK connect_cb,
+                     DMCONFIG_REQUEST_CALLBACK request_cb);
+uint32_t dm_connect_async(DMCONTEXT *socket);
+void dm_context_shutdown(DMCONTEXT *socket, DMCONFIG_EVENT event);
+void dm_context_reference(DMCONTEXT *socket);
+void dm_context_release(DMCONTEXT *socket);
+uint32_t dm_enqueue(DMCONTEXT *socket, DM2_REQUEST *req, int flags,
+                    DMCONFIG_CALLBACK cb, void *data);
+
+#endif
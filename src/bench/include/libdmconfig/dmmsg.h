@@ -0,0 +1,91 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark replacement of libdmconfig, see bench/dmstub.c.
+ *
+ * AVPs use the diameter encoding: code, flags, 24 bit length and
+ * vendor id in network byte order, followed by the data padded to
+ * 4 bytes. Groups contain their members as data.
+ */
+
+#ifndef __LIBDMCONFIG_DMMSG_H
+#define __LIBDMCONFIG_DMMSG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define DM_REQUEST_MAX_DEPTH 16
+
+typedef struct dm_packet DM_PACKET;
+
+/** A received AVP group, decoded from @a pos on */
+typedef struct dm2_avpgrp {
+	void *ctx;
+	void *data;
+	size_t size;
+	size_t pos;
+} DM2_AVPGRP;
+
+/** An AVP group being built, see dm_add_object() */
+typedef struct dm2_request {
+	void *ctx;
+	uint8_t *data;
+	size_t size;
+	size_t alloc;
+
+	/** offsets of the headers of the open groups */
+	size_t grp[DM_REQUEST_MAX_DEPTH];
+	int level;
+} DM2_REQUEST;
+
+struct dm2_avp {
+	uint32_t code;
+	uint32_t vendor_id;
+	void *data;
+	size_t size;
+};
+
+uint32_t dm_hop2hop_id(DM_PACKET *pkt);
+uint32_t dm_end2end_id(DM_PACKET *pkt);
+uint32_t dm_packet_code(DM_PACKET *pkt);
+uint32_t dm_packet_flags(DM_PACKET *pkt);
+void dump_dm_packet(DM_PACKET *pkt);
+
+void dm_init_avpgrp(void *ctx, void *data, size_t size, DM2_AVPGRP *grp);
+
+uint32_t dm_expect_avp(DM2_AVPGRP *grp, uint32_t *code, uint32_t *vendor_id,
+                       void **data, size_t *size);
+uint32_t dm_expect_string_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, char **value);
+uint32_t dm_expect_uint8_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint8_t *value);
+uint32_t dm_expect_uint16_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint16_t *value);
+uint32_t dm_expect_uint32_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint32_t *value);
+uint32_t dm_expect_uint64_type(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, uint64_t *value);
+uint32_t dm_expect_group(DM2_AVPGRP *grp, uint32_t code, uint32_t vendor_id, DM2_AVPGRP *obj);
+uint32_t dm_expect_object(DM2_AVPGRP *grp, DM2_AVPGRP *obj);
+uint32_t dm_expect_value(DM2_AVPGRP *grp, struct dm2_avp *avp);
+uint32_t dm_expect_group_end(DM2_AVPGRP *grp);
+uint32_t dm_expect_end(DM2_AVPGRP *grp);
+
+uint8_t dm_get_uint8_avp(const void *data);
+uint16_t dm_get_uint16_avp(const void *data);
+uint32_t dm_get_uint32_avp(const void *data);
+uint64_t dm_get_uint64_avp(const void *data);
+int32_t dm_get_int32_avp(const void *data);
+void *dm_get_address_avp(int *af, void *addr, socklen_t size, const void *data, size_t len);
+uint32_t dm_decode_unknown_as_string(uint32_t type, void *data, size_t size, char **value);
+
+uint32_t dm_add_object(DM2_REQUEST *req);
+uint32_t dm_add_address(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, int af, const void *addr);
+uint32_t dm_add_string(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const char *value);
+uint32_t dm_add_uint8(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint8_t value);
+uint32_t dm_add_uint16(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint16_t value);
+uint32_t dm_add_uint32(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint32_t value);
+uint32_t dm_add_int32(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, int32_t value);
+uint32_t dm_add_uint64(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, uint64_t value);
+uint32_t dm_add_raw(DM2_REQUEST *req, uint32_t code, uint32_t vendor_id, const void *data, size_t size);
+uint32_t dm_finalize_group(DM2_REQUEST *req);
+
+#endif
@@ -0,0 +1,216 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * netlink.c replacement of the benchmark.
+ *
+ * The caches hold the links, addresses and neighbors of the synthetic
+ * interfaces instead of the kernel's, and nothing is ever written to
+ * the kernel.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/neighbour.h>
+
+#include <ev.h>
+
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/neighbour.h>
+
+#include "netlink.h"
+#include "log.h"
+#include "bench.h"
+
+static struct nl_cache *link_cache;
+static struct nl_cache *addr_cache;
+static struct nl_cache *neigh_cache;
+
+static unsigned long neigh_syncs;
+
+static void
+add_link(unsigned int i)
+{
+	struct rtnl_link *link;
+	struct nl_addr *lladdr;
+	uint8_t mac[6];
+	char name[IFNAMSIZ];
+
+	if (!(link = rtnl_link_alloc()))
+		return;
+
+	bench_if_name(i, name, sizeof(name));
+	bench_lladdr(i, 0, mac);
+
+	rtnl_link_set_ifindex(link, bench_ifindex(i));
+	rtnl_link_set_name(link, name);
+	rtnl_link_set_flags(link, IFF_UP | IFF_RUNNING | IFF_LOWER_UP);
+	rtnl_link_set_operstate(link, IF_OPER_UP);
+	rtnl_link_set_mtu(link, 1500);
+	if ((lladdr = nl_addr_build(AF_LLC, mac, sizeof(mac)))) {
+		rtnl_link_set_addr(link, lladdr);
+		nl_addr_put(lladdr);
+	}
+
+	nl_cache_add(link_cache, (struct nl_object *)link);
+	rtnl_link_put(link);
+}
+
+static void
+add_addr(unsigned int i, int family)
+{
+	struct rtnl_addr *addr;
+	struct nl_addr *local;
+	struct in6_addr buf;
+	int prefixlen = family == AF_INET ? 24 : 64;
+
+	if (!(addr = rtnl_addr_alloc()))
+		return;
+
+	bench_ip(i, family, 1, &buf);
+
+	rtnl_addr_set_ifindex(addr, bench_ifindex(i));
+	rtnl_addr_set_family(addr, family);
+	rtnl_addr_set_prefixlen(addr, prefixlen);
+	rtnl_addr_set_flags(addr, IFA_F_PERMANENT);
+	if ((local = nl_addr_build(family, &buf, family == AF_INET ? 4 : 16))) {
+		nl_addr_set_prefixlen(local, prefixlen);
+		rtnl_addr_set_local(addr, local);
+		nl_addr_put(local);
+	}
+
+	nl_cache_add(addr_cache, (struct nl_object *)addr);
+	rtnl_addr_put(addr);
+}
+
+static void
+add_neigh(unsigned int i, unsigned int n)
+{
+	struct rtnl_neigh *neigh;
+	struct nl_addr *dst, *lladdr;
+	struct in_addr buf;
+	uint8_t mac[6];
+
+	if (!(neigh = rtnl_neigh_alloc()))
+		return;
+
+	bench_ip(i, AF_INET, BENCH_NEIGH_HOST + n, &buf);
+	bench_lladdr(i, 1 + n, mac);
+
+	rtnl_neigh_set_ifindex(neigh, bench_ifindex(i));
+	rtnl_neigh_set_family(neigh, AF_INET);
+	rtnl_neigh_set_state(neigh, NUD_PERMANENT);
+	if ((dst = nl_addr_build(AF_INET, &buf, sizeof(buf)))) {
+		rtnl_neigh_set_dst(neigh, dst);
+		nl_addr_put(dst);
+	}
+	if ((lladdr = nl_addr_build(AF_LLC, mac, sizeof(mac)))) {
+		rtnl_neigh_set_lladdr(neigh, lladdr);
+		nl_addr_put(lladdr);
+	}
+
+	nl_cache_add(neigh_cache, (struct nl_object *)neigh);
+	rtnl_neigh_put(neigh);
+}
+
+int netlink_init(struct ev_loop *loop)
+{
+	int err;
+
+	if ((err = nl_cache_alloc_name("route/link", &link_cache)) < 0 ||
+	    (err = nl_cache_alloc_name("route/addr", &addr_cache)) < 0 ||
+	    (err = nl_cache_alloc_name("route/neigh", &neigh_cache)) < 0) {
+		logx(LOG_ERR, "Cannot allocate caches: %s", nl_geterror(err));
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < bench_interfaces; i++) {
+		add_link(i);
+		add_addr(i, AF_INET);
+		add_addr(i, AF_INET6);
+		for (unsigned int n = 0; n < bench_neighbors; n++)
+			add_neigh(i, n);
+	}
+
+	return 0;
+}
+
+void netlink_update(void)
+{
+}
+
+/* the synthetic interfaces never change */
+void netlink_set_change_cb(NETLINK_CHANGE_CB cb, void *data)
+{
+}
+
+struct nl_cache *netlink_link_cache(void)
+{
+	return link_cache;
+}
+
+struct nl_cache *netlink_addr_cache(void)
+{
+	return addr_cache;
+}
+
+struct nl_cache *netlink_neigh_cache(void)
+{
+	return neigh_cache;
+}
+
+struct nl_cache *netlink_netconf_cache(void)
+{
+	return NULL;
+}
+
+int netlink_get_forwarding(int family, int ifindex, int *forwarding)
+{
+	*forwarding = 0;
+	return 0;
+}
+
+void netlink_link_stats_from(struct rtnl_link *link, struct netlink_link_stats *stats)
+{
+	stats->rx_bytes   = rtnl_link_get_stat(link, RTNL_LINK_RX_BYTES);
+	stats->rx_packets = rtnl_link_get_stat(link, RTNL_LINK_RX_PACKETS);
+	stats->rx_errors  = rtnl_link_get_stat(link, RTNL_LINK_RX_ERRORS);
+	stats->rx_dropped = rtnl_link_get_stat(link, RTNL_LINK_RX_DROPPED);
+	stats->tx_bytes   = rtnl_link_get_stat(link, RTNL_LINK_TX_BYTES);
+	stats->tx_packets = rtnl_link_get_stat(link, RTNL_LINK_TX_PACKETS);
+	stats->tx_errors  = rtnl_link_get_stat(link, RTNL_LINK_TX_ERRORS);
+	stats->tx_dropped = rtnl_link_get_stat(link, RTNL_LINK_TX_DROPPED);
+}
+
+void netlink_get_link_stats(struct rtnl_link *link, struct netlink_link_stats *stats)
+{
+	netlink_link_stats_from(link, stats);
+}
+
+struct nl_cache *netlink_link_snapshot(void)
+{
+	return link_cache ? nl_cache_clone(link_cache) : NULL;
+}
+
+int netlink_sync_neigh(const struct interface_list *info)
+{
+	neigh_syncs++;
+	return 0;
+}
+
+void netlink_stub_counts(unsigned long *syncs)
+{
+	*syncs = neigh_syncs;
+}
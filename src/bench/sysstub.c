@@ -0,0 +1,142 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * exec.c and systemd.c replacement of the benchmark.
+ *
+ * Commands and unit jobs are counted instead of executed. They complete
+ * successfully from the event loop, so their callbacks run after the
+ * handler that queued them, as they would on a target.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include <ev.h>
+
+#include "exec.h"
+#include "systemd.h"
+#include "log.h"
+#include "bench.h"
+
+struct sys_job {
+	TAILQ_ENTRY(sys_job) entry;
+
+	/** NULL for commands */
+	char *unit;
+	EXEC_CB exec_cb;
+	UNIT_JOB_CB unit_cb;
+	void *data;
+};
+
+static TAILQ_HEAD(, sys_job) sys_jobs = TAILQ_HEAD_INITIALIZER(sys_jobs);
+static struct ev_loop *sys_loop;
+static ev_idle sys_done_watcher;
+
+static unsigned long sys_commands;
+static unsigned long sys_unit_jobs;
+
+static void
+sys_done_cb(EV_P_ ev_idle *w, int revents __attribute__((unused)))
+{
+	struct sys_job *job;
+
+	while ((job = TAILQ_FIRST(&sys_jobs))) {
+		TAILQ_REMOVE(&sys_jobs, job, entry);
+
+		if (job->unit && job->unit_cb)
+			job->unit_cb(job->unit, "done", job->data);
+		else if (!job->unit && job->exec_cb)
+			job->exec_cb(0, job->data);
+
+		free(job->unit);
+		free(job);
+	}
+
+	ev_idle_stop(EV_A_ w);
+}
+
+static int
+sys_queue(const char *unit, EXEC_CB exec_cb, UNIT_JOB_CB unit_cb, void *data)
+{
+	struct sys_job *job;
+
+	if (!(job = calloc(1, sizeof(struct sys_job))))
+		return -1;
+	if (unit && !(job->unit = strdup(unit))) {
+		free(job);
+		return -1;
+	}
+	job->exec_cb = exec_cb;
+	job->unit_cb = unit_cb;
+	job->data = data;
+
+	TAILQ_INSERT_TAIL(&sys_jobs, job, entry);
+	ev_idle_start(sys_loop, &sys_done_watcher);
+
+	return 0;
+}
+
+void init_exec(struct ev_loop *loop)
+{
+	sys_loop = loop;
+	ev_idle_init(&sys_done_watcher, sys_done_cb);
+}
+
+int exec_async_lane(const char *lane, const char *cmd, EXEC_CB cb, void *data)
+{
+	logx(LOG_DEBUG, "exec [%s]: %s", lane, cmd);
+
+	sys_commands++;
+	return sys_queue(NULL, cb, NULL, data);
+}
+
+int exec_async(const char *cmd, EXEC_CB cb, void *data)
+{
+	return exec_async_lane("", cmd, cb, data);
+}
+
+void init_systemd(struct ev_loop *loop)
+{
+}
+
+int systemd_unit_job(enum unit_job_type type, const char *unit,
+                     UNIT_JOB_CB cb, void *data)
+{
+	logx(LOG_DEBUG, "unit=[%s], job %d", unit, type);
+
+	sys_unit_jobs++;
+	return sys_queue(unit, NULL, cb, data);
+}
+
+int systemd_set_ntp(bool enabled)
+{
+	sys_unit_jobs++;
+	return 0;
+}
+
+char *systemd_get_timezone(void)
+{
+	return strdup("UTC");
+}
+
+/**
+ * @returns true while commands or unit jobs wait for their completion.
+ */
+bool sysstub_pending(void)
+{
+	return !TAILQ_EMPTY(&sys_jobs);
+}
+
+void sysstub_counts(unsigned long *commands, unsigned long *unit_jobs)
+{
+	*commands = sys_commands;
+	*unit_jobs = sys_unit_jobs;
+}
@@ -20,11 +20,16 @@
 #include <time.h>
 #include <limits.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/queue.h>
 #include <sys/tree.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <poll.h>
+#include <termios.h>
+#include <net/if.h>
 #include <arpa/inet.h>
+#include <dirent.h>
 #include <errno.h>
 #include <ctype.h>
 #include <signal.h>
@@ -37,7 +42,6 @@
 
 #include <ev.h>
 
-#include <mand/logx.h>
 #include <mand/binary.h>
 
 #ifdef HAVE_TALLOC_TALLOC_H
@@ -48,46 +52,82 @@
 
 #include "cfgd.h"
 #include "comm.h"
+#include "netlink.h"
+#include "exec.h"
+#include "systemd.h"
+#include "render.h"
+#include "stats.h"
+#include "wpa_psk.h"
+#include "worker.h"
+#include "ptp.h"
+#include "snapshot.h"
+#include "log.h"
+
+/*
+ * All prefixes can be overridden at build time (e.g. in CPPFLAGS),
+ * so the handlers can be exercised against a scratch directory
+ * without touching the configuration of the host.
+ */
 
 /**
  * The prefix of the systemd config directory.
  * Since systemd files are managed by mand-metropolisd,
  * all files written by it can be in the volatile filesystem.
  */
+#ifndef SYSTEMD_PREFIX
 #define SYSTEMD_PREFIX "/run/systemd"
+#endif
+
+/**
+ * The PTP interface if the data model does not specify one.
+ */
+#ifndef PTP_DEFAULT_INTERFACE
+#define PTP_DEFAULT_INTERFACE "eth0"
+#endif
+
+/**
+ * The prefix of generated service configurations.
+ */
+#ifndef RUN_PREFIX
+#define RUN_PREFIX "/var/run"
+#endif
 
 static const char _build[] = "build on " __DATE__ " " __TIME__ " with gcc " __VERSION__;
 
 static int vsystem(const char *cmd);
 static int vasystem(const char *fmt, ...) __attribute__ ((__format__ (__printf__, 1, 2)));
 
+/**
+ * Execute a shell command asynchronously.
+ *
+ * Commands are executed in the order they were issued,
+ * but without blocking the event loop.
+ * The exit status is logged.
+ *
+ * @param cmd The command line.
+ * @returns 0 if the command has been queued, -1 otherwise.
+ */
 static int vsystem(const char *cmd)
 {
-	int rc = 0;
-	int _errno;
-
-	logx(LOG_INFO, "cmd=[%s]", cmd);
-
-	errno = 0;
-	rc = system(cmd);
-
-	_errno = errno;
-	logx(LOG_INFO, "cmd=[%s], rc=%d, error=%s", cmd, rc, strerror(_errno));
-	errno = _errno;
-
-	return rc;
+	return exec_async(cmd, NULL, NULL);
 }
 
 static int vasystem(const char *fmt, ...)
 {
 	va_list args;
-	char    buf[1024];
+	char    *buf;
+	int     rc;
 
 	va_start(args, fmt);
-	vsnprintf(buf, sizeof(buf), fmt, args);
+	rc = vasprintf(&buf, fmt, args);
 	va_end(args);
+	if (rc < 0)
+		return -1;
+
+	rc = vsystem(buf);
+	free(buf);
 
-	return vsystem(buf);
+	return rc;
 }
 
 /**
@@ -114,13 +154,11 @@ static char *quote_shell_arg(const char *arg)
 
 void set_ntp_server(const struct ntp_servers *servers)
 {
+	struct render_file rf;
 	FILE *fout;
 
-	fout = fopen(SYSTEMD_PREFIX "/timesyncd.conf", "w");
-	if (!fout) {
-		/* FIXME: Error handling */
+	if (!(fout = render_open(&rf, SYSTEMD_PREFIX "/timesyncd.conf")))
 		return;
-	}
 	fprintf(fout, "# AUTOGENERATED BY %s\n"
 	              "[Time]", PACKAGE_STRING);
 
@@ -130,26 +168,125 @@ void set_ntp_server(const struct ntp_servers *servers)
 		fputs(servers->server[i], fout);
 	}
 
-	fclose(fout);
+	switch (render_commit(&rf)) {
+	case 1:
+		/*
+		 * This seems to be the only way to enforce a reload
+		 * of the NTP configuration.
+		 */
+		systemd_set_ntp(false);
+		systemd_set_ntp(servers->enabled);
+		break;
 
-	/*
-	 * This seems to be the only way to enforce a reload
-	 * of the NTP configuration.
-	 */
-	vsystem("timedatectl set-ntp 0");
-	vasystem("timedatectl set-ntp %d", servers->enabled);
+	case 0:
+		systemd_set_ntp(servers->enabled);
+		break;
+	}
 }
 
-void set_ptp_state(const char *state)
+/**
+ * Interface ptp4l was last started on, empty if it is not running,
+ * see set_ptp_state().
+ */
+static char ptp_interface[IFNAMSIZ];
+
+/** delay before a failed phc2sys is started again */
+#define PHC2SYS_RETRY_S 10.
+
+static ev_timer phc2sys_retry_timer;
+
+static void phc2sys_job_cb(const char *unit, const char *result, void *data);
+
+static void phc2sys_retry_cb(EV_P_ ev_timer *w, int revents)
+{
+	if (*ptp_interface)
+		systemd_unit_job(UNIT_RESTART, "phc2sys.service", phc2sys_job_cb, NULL);
+}
+
+/**
+ * Supervises phc2sys, which fails e.g. if the PHC is not ready yet.
+ */
+static void phc2sys_job_cb(const char *unit, const char *result, void *data)
 {
+	if (!strcmp(result, "done") || !*ptp_interface ||
+	    ev_is_active(&phc2sys_retry_timer))
+		return;
+
+	logx(LOG_WARNING, "Restarting %s in %.0f s", unit, PHC2SYS_RETRY_S);
+	ev_timer_init(&phc2sys_retry_timer, phc2sys_retry_cb, PHC2SYS_RETRY_S, 0.);
+	ev_timer_start(EV_DEFAULT_ &phc2sys_retry_timer);
+}
+
+/**
+ * Check whether a data model value may be used as an interface name.
+ *
+ * The name is rendered into ptp4l.conf sections and phc2sys arguments,
+ * so characters that would end either are rejected as well.
+ *
+ * @returns true if @p name has 1 to IFNAMSIZ-1 safe characters.
+ */
+bool valid_if_name(const char *name)
+{
+	size_t len = name ? strlen(name) : 0;
+
+	if (len == 0 || len >= IFNAMSIZ)
+		return false;
+
+	for (const char *p = name; *p; p++)
+		if (!isgraph((unsigned char)*p) || strchr("/\"'[]", *p))
+			return false;
+
+	return true;
+}
+
+/**
+ * Restarts ptp4l if it did not apply the priority1 of set_ptp_state().
+ */
+static void ptp_priority1_cb(int result, void *data)
+{
+	unsigned int priority1 = (uintptr_t)data;
+
+	/* PTP has been disabled in the meantime */
+	if (!*ptp_interface)
+		return;
+
+	if (result == 0) {
+		logx(LOG_INFO, "ptp4l priority1 set to %u without restart", priority1);
+		return;
+	}
+
+	logx(LOG_WARNING, "ptp4l did not apply priority1 %u, restarting it", priority1);
+	systemd_unit_job(UNIT_RELOAD_OR_RESTART, "ptp4l.service", NULL, NULL);
+}
+
+/**
+ * Configure ptp4l and phc2sys.
+ *
+ * Role changes of a running ptp4l are applied through its management
+ * socket, so the clock keeps its servo lock.
+ * ptp4l is only restarted when the interface changes or it does not
+ * apply the change, see ptp_priority1_cb().
+ *
+ * @param state "disabled", "master" or "slave".
+ * @param interface The PTP interface, NULL or empty for PTP_DEFAULT_INTERFACE.
+ */
+void set_ptp_state(const char *state, const char *interface)
+{
+	struct render_file rf;
 	FILE *fout;
 	int is_master = !strcmp(state, "master");
+	uint8_t priority1 = is_master ? 128 : 255;
+	int changed, phc2sys_changed;
+
+	if (!interface || !*interface) {
+		interface = PTP_DEFAULT_INTERFACE;
+	} else if (!valid_if_name(interface)) {
+		logx(LOG_ERR, "Invalid PTP interface, using " PTP_DEFAULT_INTERFACE);
+		interface = PTP_DEFAULT_INTERFACE;
+	}
 
-	fout = fopen("/etc/ptp4l.conf", "w");
-	if (!fout) {
-		/* FIXME: Error handling */
+	if (!(fout = render_open(&rf, SYSCONF_PREFIX "/ptp4l.conf")))
 		return;
-	}
 
 	/*
 	 * The "master" state is currently interpreted as
@@ -159,11 +296,12 @@ void set_ptp_state(const char *state)
 	 */
 	fprintf(fout, "# AUTOGENERATED BY %s\n"
 	              "[global]\n"
-	              "priority1 %d\n"
-	              "[eth0]\n",
-	        PACKAGE_STRING, is_master ? 128 : 255);
+	              "priority1 %u\n"
+	              "[%s]\n",
+	        PACKAGE_STRING, priority1, interface);
 
-	fclose(fout);
+	if ((changed = render_commit(&rf)) < 0)
+		return;
 
 	/*
 	 * NOTE: We could start `phc2sys -a -rr` to synchronize
@@ -173,33 +311,47 @@ void set_ptp_state(const char *state)
 	 * we must prevent the system clock which may be manually or NTP-synced
 	 * to be overwritten by phc2sys.
 	 */
-	fout = fopen("/etc/default/phc2sys", "w");
-	if (!fout) {
-		/* FIXME: Error handling */
+	if (!(fout = render_open(&rf, SYSCONF_PREFIX "/default/phc2sys")))
 		return;
-	}
 
 	fprintf(fout, "# AUTOGENERATED BY %s\n"
 	              "PHC2SYS_EXTRA_ARGS=\"-w -s %s -c %s\"\n",
 	        PACKAGE_STRING,
-	        is_master ? "CLOCK_REALTIME" : "eth0",	/* master clock */
-	        is_master ? "eth0" : "CLOCK_REALTIME"	/* slave clock */);
+	        is_master ? "CLOCK_REALTIME" : interface,	/* master clock */
+	        is_master ? interface : "CLOCK_REALTIME"	/* slave clock */);
 
-	fclose(fout);
+	if ((phc2sys_changed = render_commit(&rf)) < 0)
+		return;
+
+	if (!strcmp(state, "disabled")) {
+		systemd_unit_job(UNIT_STOP, "ptp4l.service", NULL, NULL);
+		systemd_unit_job(UNIT_STOP, "phc2sys.service", NULL, NULL);
+		ev_timer_stop(EV_DEFAULT_ &phc2sys_retry_timer);
+		*ptp_interface = '\0';
+		return;
+	}
+
+	/* the configuration file only differs in priority1 */
+	if (changed && !strcmp(ptp_interface, interface) &&
+	    ptp_set_priority1(priority1, ptp_priority1_cb, (void *)(uintptr_t)priority1) == 0)
+		changed = 0;
 
-	vasystem("systemctl %s ptp4l phc2sys",
-	         !strcmp(state, "disabled") ? "stop" : "reload-or-restart");
+	systemd_unit_job(changed ? UNIT_RELOAD_OR_RESTART : UNIT_START,
+	                 "ptp4l.service", NULL, NULL);
+	/* phc2sys only has to follow changes of the clock direction */
+	systemd_unit_job(phc2sys_changed ? UNIT_RELOAD_OR_RESTART : UNIT_START,
+	                 "phc2sys.service", phc2sys_job_cb, NULL);
+
+	snprintf(ptp_interface, sizeof(ptp_interface), "%s", interface);
 }
 
 void set_dns(const struct string_list *search, const struct string_list *servers)
 {
+	struct render_file rf;
 	FILE *fout;
 
-	fout = fopen(SYSTEMD_PREFIX "/resolved.conf", "w");
-	if (!fout) {
-		/* FIXME: Error handling */
+	if (!(fout = render_open(&rf, SYSTEMD_PREFIX "/resolved.conf")))
 		return;
-	}
 	fprintf(fout, "# AUTOGENERATED BY %s\n"
 	              "[Resolve]", PACKAGE_STRING);
 
@@ -223,9 +375,8 @@ void set_dns(const struct string_list *search, const struct string_list *servers
 		fputs(search->s[i], fout);
 	}
 
-	fclose(fout);
-
-	vsystem("systemctl reload-or-restart systemd-resolved");
+	if (render_commit(&rf) > 0)
+		systemd_unit_job(UNIT_RELOAD_OR_RESTART, "systemd-resolved.service", NULL, NULL);
 }
 
 #if 0
@@ -238,7 +389,7 @@ set_ssh_keys(const char *name, const struct auth_ssh_key_list *list)
 	char *auth_file;
 
 	if (strcmp(name, "netconfd") == 0) {
-		auth_file = strdup("/etc/netconf/authorized_keys");
+		auth_file = strdup(SYSCONF_PREFIX "/netconf/authorized_keys");
 	} else {
 		struct passwd *pw;
 
@@ -282,8 +433,8 @@ void set_authentication(const struct auth_list *auth)
 
 	logx(LOG_DEBUG, "Users: %d", auth->count);
 	for (i = 0; i < auth->count; i++) {
-		logx(LOG_INFO, "User: %s, pass: %s, ssh: %d",
-		     auth->user[i].name, auth->user[i].password, auth->user[i].ssh.count);
+		logx(LOG_INFO, "User: %s, ssh: %d",
+		     auth->user[i].name, auth->user[i].ssh.count);
 
 		set_ssh_keys(auth->user[i].name, &auth->user[i].ssh);
 	}
@@ -302,156 +453,300 @@ systemd_ip_setting(int ipv4, int ipv6)
 	return "no";
 }
 
-void set_if_addr(struct interface_list *info)
+/**
+ * Render the systemd-networkd configuration of an interface.
+ *
+ * @param fout Stream to write to.
+ * @param iface The interface.
+ */
+static void
+render_network_file(FILE *fout, const struct interface *iface)
+{
+	const char *dhcp_setting;
+	uint32_t mtu;
+
+	/*
+	 * NOTE: The Metropolis network configuration can
+	 * be only in two states: either static or DHCP+AutoIP
+	 * Thus we do not write the static addresses since
+	 * that would be interpreted as a fallback by Systemd
+	 * in case that dynamic address assignment does not work.
+	 * Enforcing this here means that the UI and any external
+	 * configuration is consistent.
+	 *
+	 * FIXME: The current model does NOT allow DHCP and static
+	 * addressing to be configured independently on IPv4/IPv6.
+	 * This is a restriction of the IETF DHCP yang module which
+	 * would have to be replaced with a custom Metropolis extension.
+	 */
+	dhcp_setting = systemd_ip_setting(iface->ipv4.enabled && iface->dhcp.enabled,
+		                          iface->ipv6.enabled && iface->dhcp.enabled);
+	fprintf(fout, "# AUTOGENERATED BY %s\n"
+	              "[Match]\n"
+	              "Name=%s\n"
+	              "[Network]\n"
+	              "DHCP=%s\n"
+	              "LinkLocalAddressing=%s\n"
+	              "IPForward=%s\n",
+	        PACKAGE_STRING, iface->name,
+	        dhcp_setting, dhcp_setting,
+	        systemd_ip_setting(iface->ipv4.enabled && iface->ipv4.forwarding,
+	                           iface->ipv6.enabled && iface->ipv6.forwarding));
+
+	if (iface->ipv4.enabled && !iface->dhcp.enabled) {
+		for (int j = 0; j < iface->ipv4.addr.count; j++)
+			fprintf(fout, "Address=%s/%s\n",
+			        iface->ipv4.addr.ip[j].address, iface->ipv4.addr.ip[j].value);
+	}
+
+	if (iface->ipv6.enabled && !iface->dhcp.enabled) {
+		for (int j = 0; j < iface->ipv6.addr.count; j++)
+			fprintf(fout, "Address=%s/%s\n",
+			        iface->ipv6.addr.ip[j].address, iface->ipv6.addr.ip[j].value);
+	}
+
+#if 0
+	/*
+	 * A high route metric ensures a low priority of the default routes.
+	 * This ensures that any WWAN connection's rules will have a
+	 * higher priority, so traffic goes through the ethernet interface
+	 * only as a fallback.
+	 */
+	fputs("[DHCP]\n"
+	      "RouteMetric=4096\n", fout);
+#endif
+
+	if (!iface->dhcp.enabled && (iface->ipv4.enabled || iface->ipv6.enabled)) {
+		fputs("[Route]\n"
+		      /*"Metric=4096\n"*/, fout);
+
+		if (iface->ipv4.enabled) {
+			for (int j = 0; j < iface->ipv4.gateway.count; j++)
+				fprintf(fout, "Gateway=%s\n", iface->ipv4.gateway.ip[j].address);
+		}
+
+		if (iface->ipv6.enabled) {
+			for (int j = 0; j < iface->ipv6.gateway.count; j++)
+				fprintf(fout, "Gateway=%s\n", iface->ipv6.gateway.ip[j].address);
+		}
+	}
+
+	/*
+	 * The data model supports distinct MTUs for IPv4 and IPv6
+	 * while Systemd only allows us to configure one MTU per link.
+	 * Thus we take the minimum of both MTUs.
+	 */
+	mtu = iface->ipv6.mtu && iface->ipv4.mtu > iface->ipv6.mtu
+		? iface->ipv6.mtu : iface->ipv4.mtu;
+	if (mtu)
+		fprintf(fout, "[Link]\n"
+		              "MTUBytes=%u\n", mtu);
+}
+
+/**
+ * Append a link to a `networkctl reconfigure` command line
+ * unless it does not exist (anymore).
+ */
+static void
+append_reconfigure_link(FILE *args, const char *name, unsigned int *count)
 {
+	char *name_quoted;
+
+	if (!if_nametoindex(name))
+		return;
+
+	name_quoted = quote_shell_arg(name);
+	assert(name_quoted != NULL);
+	fprintf(args, " \"%s\"", name_quoted);
+	free(name_quoted);
+
+	(*count)++;
+}
+
+struct networkd_reload {
+	APPLY_CB cb;
+	void *data;
+};
+
+static void
+networkd_restart_cb(const char *unit, const char *result, void *data)
+{
+	struct networkd_reload *reload = data;
+
+	if (reload->cb)
+		reload->cb(reload->data);
+	free(reload);
+}
+
+static void
+networkd_reload_cb(int status, void *data)
+{
+	struct networkd_reload *reload = data;
+
+	if (status == 0 ||
+	    systemd_unit_job(UNIT_RELOAD_OR_RESTART, "systemd-networkd.service",
+	                     networkd_restart_cb, reload) < 0)
+		networkd_restart_cb(NULL, NULL, reload);
+}
+
+/**
+ * Apply the IP configuration of all interfaces.
+ *
+ * @param info The interface configuration.
+ * @param cb Called once networkd has picked up the configuration, may be NULL.
+ *           It is called right away if nothing changed.
+ * @param data User data for @p cb.
+ */
+void set_if_addr(struct interface_list *info, APPLY_CB cb, void *data)
+{
+	struct networkd_reload *reload;
+	char *link_args = NULL, *cmd;
+	size_t link_args_size;
+	FILE *args;
+	DIR *dir;
+	struct dirent *ent;
+	unsigned int changed = 0, links = 0;
+
+	if (mkdir(SYSTEMD_PREFIX "/network", 0755) < 0 && errno != EEXIST) {
+		logx(LOG_ERR, "Cannot create " SYSTEMD_PREFIX "/network: %s", strerror(errno));
+		goto done;
+	}
+
+	if (!(args = open_memstream(&link_args, &link_args_size)))
+		goto done;
+
 	/*
 	 * NOTE: It does not seem to be possible to configure multiple
 	 * interfaces in a single *.network file, so we create one
 	 * file per interface.
+	 * Only files whose content changes are rewritten, so that
+	 * unaffected links are not reconfigured.
 	 */
-	vsystem("rm -rf " SYSTEMD_PREFIX "/network");
-	vsystem("mkdir -p " SYSTEMD_PREFIX "/network");
-
 	for (int i = 0; i < info->count; i++) {
 		struct interface *iface = info->iface + i;
 		char systemd_cfg[PATH_MAX];
+		struct render_file rf;
 		FILE *fout;
-		const char *dhcp_setting;
-		uint32_t mtu;
 
 		snprintf(systemd_cfg, sizeof(systemd_cfg),
 		         "%s/network/%s.network",
 		         SYSTEMD_PREFIX, iface->name);
-		fout = fopen(systemd_cfg, "w");
-		if (!fout) {
-			/* FIXME: Error handling? */
-			return;
-		}
 
-		/*
-		 * NOTE: The Metropolis network configuration can
-		 * be only in two states: either static or DHCP+AutoIP
-		 * Thus we do not write the static addresses since
-		 * that would be interpreted as a fallback by Systemd
-		 * in case that dynamic address assignment does not work.
-		 * Enforcing this here means that the UI and any external
-		 * configuration is consistent.
-		 *
-		 * FIXME: The current model does NOT allow DHCP and static
-		 * addressing to be configured independently on IPv4/IPv6.
-		 * This is a restriction of the IETF DHCP yang module which
-		 * would have to be replaced with a custom Metropolis extension.
-		 */
-		dhcp_setting = systemd_ip_setting(iface->ipv4.enabled && iface->dhcp.enabled,
-			                          iface->ipv6.enabled && iface->dhcp.enabled);
-		fprintf(fout, "# AUTOGENERATED BY %s\n"
-		              "[Match]\n"
-		              "Name=%s\n"
-		              "[Network]\n"
-		              "DHCP=%s\n"
-		              "LinkLocalAddressing=%s\n"
-		              "IPForward=%s\n",
-		        PACKAGE_STRING, iface->name,
-		        dhcp_setting, dhcp_setting,
-		        systemd_ip_setting(iface->ipv4.enabled && iface->ipv4.forwarding,
-		                           iface->ipv6.enabled && iface->ipv6.forwarding));
-
-		if (iface->ipv4.enabled && !iface->dhcp.enabled) {
-			for (int j = 0; j < iface->ipv4.addr.count; j++)
-				fprintf(fout, "Address=%s/%s\n",
-				        iface->ipv4.addr.ip[j].address, iface->ipv4.addr.ip[j].value);
+		if (!(fout = render_open(&rf, systemd_cfg))) {
+			/* FIXME: Error handling? */
+			continue;
 		}
+		render_network_file(fout, iface);
 
-		if (iface->ipv6.enabled && !iface->dhcp.enabled) {
-			for (int j = 0; j < iface->ipv6.addr.count; j++)
-				fprintf(fout, "Address=%s/%s\n",
-				        iface->ipv6.addr.ip[j].address, iface->ipv6.addr.ip[j].value);
+		if (render_commit(&rf) > 0) {
+			logx(LOG_DEBUG, "Network configuration of %s changed", iface->name);
+			changed++;
+			append_reconfigure_link(args, iface->name, &links);
 		}
+	}
 
-#if 0
-		/*
-		 * A high route metric ensures a low priority of the default routes.
-		 * This ensures that any WWAN connection's rules will have a
-		 * higher priority, so traffic goes through the ethernet interface
-		 * only as a fallback.
-		 */
-		fputs("[DHCP]\n"
-		      "RouteMetric=4096\n", fout);
-#endif
-
-		if (!iface->dhcp.enabled && (iface->ipv4.enabled || iface->ipv6.enabled)) {
-			fputs("[Route]\n"
-			      /*"Metric=4096\n"*/, fout);
-
-			if (iface->ipv4.enabled) {
-				for (int j = 0; j < iface->ipv4.gateway.count; j++)
-					fprintf(fout, "Gateway=%s\n", iface->ipv4.gateway.ip[j].address);
+	/* remove the files of interfaces that are no longer configured */
+	if ((dir = opendir(SYSTEMD_PREFIX "/network"))) {
+		while ((ent = readdir(dir))) {
+			char systemd_cfg[PATH_MAX];
+			char *suffix = strrchr(ent->d_name, '.');
+
+			if (!suffix || strcmp(suffix, ".network") != 0)
+				continue;
+			*suffix = '\0';
+
+			if (interface_by_name(info, ent->d_name))
+				continue;
+
+			snprintf(systemd_cfg, sizeof(systemd_cfg),
+			         "%s/network/%s.network",
+			         SYSTEMD_PREFIX, ent->d_name);
+			if (unlink(systemd_cfg) < 0) {
+				logx(LOG_ERR, "Cannot remove %s: %s", systemd_cfg, strerror(errno));
+				continue;
 			}
 
-			if (iface->ipv6.enabled) {
-				for (int j = 0; j < iface->ipv6.gateway.count; j++)
-					fprintf(fout, "Gateway=%s\n", iface->ipv6.gateway.ip[j].address);
-			}
+			logx(LOG_DEBUG, "Network configuration of %s removed", ent->d_name);
+			changed++;
+			append_reconfigure_link(args, ent->d_name, &links);
 		}
+		closedir(dir);
+	}
 
-		/*
-		 * The data model supports distinct MTUs for IPv4 and IPv6
-		 * while Systemd only allows us to configure one MTU per link.
-		 * Thus we take the minimum of both MTUs.
-		 */
-		mtu = iface->ipv6.mtu && iface->ipv4.mtu > iface->ipv6.mtu
-			? iface->ipv6.mtu : iface->ipv4.mtu;
-		if (mtu)
-			fprintf(fout, "[Link]\n"
-			              "MTUBytes=%u\n", mtu);
+	fclose(args);
 
-		fclose(fout);
+	if (!changed) {
+		logx(LOG_DEBUG, "Network configuration unchanged");
+		free(link_args);
+		goto done;
 	}
 
-	vsystem("systemctl reload-or-restart systemd-networkd");
+	/*
+	 * Only the affected links are reconfigured.
+	 * `networkctl reload` and `networkctl reconfigure` require systemd v244,
+	 * so we fall back to restarting networkd.
+	 */
+	if (!(reload = malloc(sizeof(struct networkd_reload)))) {
+		free(link_args);
+		goto done;
+	}
+	reload->cb = cb;
+	reload->data = data;
+
+	if (asprintf(&cmd, "networkctl reload%s%s",
+	             links ? " && networkctl reconfigure" : "",
+	             links ? link_args : "") < 0) {
+		free(reload);
+		free(link_args);
+		goto done;
+	}
+
+	if (exec_async_lane("systemd-networkd.service", cmd, networkd_reload_cb, reload) < 0)
+		networkd_reload_cb(-1, reload);
+	free(cmd);
+	free(link_args);
+	return;
+
+done:
+	if (cb)
+		cb(data);
 }
 
 void set_if_neigh(struct interface_list *info)
 {
-	vsystem("ip neigh flush nud permanent");
-
-	for (int i = 0; i < info->count; i++) {
-		struct interface *iface = info->iface + i;
-
-		for (int j = 0; j < info->iface[i].ipv4.neigh.count; j++)
-			vasystem("ip neigh replace %s lladdr %s nud permanent dev %s",
-			         iface->ipv4.neigh.ip[j].address, iface->ipv4.neigh.ip[j].value,
-			         iface->name);
-
-		for (int j = 0; j < iface->ipv6.neigh.count; j++)
-			vasystem("ip neigh replace %s lladdr %s nud permanent dev %s",
-			         iface->ipv6.neigh.ip[j].address, iface->ipv6.neigh.ip[j].value,
-			         iface->name);
-	}
+	if (netlink_sync_neigh(info) < 0)
+		logx(LOG_ERR, "Failed to apply static neighbors");
 }
 
 void set_autoid_enabled(bool enabled)
 {
-	FILE *fout = fopen("/var/run/indy-chip-ascii-server.conf", "w");
-	if (!fout) {
-		logx(LOG_ERR, "Cannot open /var/run/indy-chip-ascii-server.conf for writing: %s",
-		     strerror(errno));
+	struct render_file rf;
+	FILE *fout;
+	int changed;
+
+	if (!(fout = render_open(&rf, RUN_PREFIX "/indy-chip-ascii-server.conf")))
 		return;
-	}
 
 	fprintf(fout, "# AUTOGENERATED BY %s\n"
 	              "INDY_CHIP_ASCII_SERVER_EXTRA_ARGS=\"%s\"\n",
 	        PACKAGE_STRING,
 	        enabled ? "127.0.0.1" : "0.0.0.0");
 
-	fclose(fout);
+	if ((changed = render_commit(&rf)) < 0)
+		return;
+
+	/*
+	 * The ASCII server only has to be restarted if its configuration
+	 * changed, otherwise it is merely made sure that it is running.
+	 */
+	enum unit_job_type job = changed ? UNIT_RESTART : UNIT_START;
 
 	if (enabled) {
-		vasystem("systemctl restart indy-chip-ascii-server");
-		vasystem("systemctl start pulsarlr-autoid");
+		systemd_unit_job(job, "indy-chip-ascii-server.service", NULL, NULL);
+		systemd_unit_job(UNIT_START, "pulsarlr-autoid.service", NULL, NULL);
 	} else {
-		vasystem("systemctl stop pulsarlr-autoid");
-		vasystem("systemctl restart indy-chip-ascii-server");
+		systemd_unit_job(UNIT_STOP, "pulsarlr-autoid.service", NULL, NULL);
+		systemd_unit_job(job, "indy-chip-ascii-server.service", NULL, NULL);
 	}
 }
 
@@ -460,22 +755,20 @@ void set_mosquitto(const char *host, uint16_t port,
 {
 	if (!host || !*host) {
 		logx(LOG_WARNING, "Missing hostname, will not start Mosquitto");
-		vsystem("systemctl stop mosquitto");
+		systemd_unit_job(UNIT_STOP, "mosquitto.service", NULL, NULL);
 		return;
 	}
 
 	if (!username || !*username || strpbrk(username, " \t\n\r")) {
 		logx(LOG_WARNING, "Invalid username, will not start Mosquitto");
-		vsystem("systemctl stop mosquitto");
+		systemd_unit_job(UNIT_STOP, "mosquitto.service", NULL, NULL);
 		return;
 	}
 
-	FILE *fout = fopen("/var/run/mosquitto.conf", "w");
-	if (!fout) {
-		logx(LOG_ERR, "Cannot open mosquitto.conf for writing: %s",
-		     strerror(errno));
+	struct render_file rf;
+	FILE *fout = render_open(&rf, RUN_PREFIX "/mosquitto.conf");
+	if (!fout)
 		return;
-	}
 
 	fprintf(fout,
 	        "# AUTOGENERATED BY %s\n"
@@ -524,13 +817,121 @@ void set_mosquitto(const char *host, uint16_t port,
 	if (password && *password && !strpbrk(password, "\n\r"))
 		fprintf(fout, "remote_password %s\n", password);
 
-	fclose(fout);
+	switch (render_commit(&rf)) {
+	case 1:
+		/*
+		 * Apparently, reloading Mosquitto is insufficient to re-establish
+		 * the bridge connection.
+		 */
+		systemd_unit_job(UNIT_RESTART, "mosquitto.service", NULL, NULL);
+		break;
 
-	/*
-	 * Apparently, reloading Mosquitto is insufficient to re-establish
-	 * the bridge connection.
-	 */
-	vsystem("systemctl restart mosquitto");
+	case 0:
+		/* keep the bridge connection if nothing changed */
+		systemd_unit_job(UNIT_START, "mosquitto.service", NULL, NULL);
+		break;
+	}
+}
+
+/**
+ * A rendered configuration file that is committed by a worker thread,
+ * so the event loop is not blocked by fsync() and key derivation.
+ */
+struct commit_job {
+	struct render_file rf;
+	int changed;
+
+	/** applies the result of render_commit(), executed by the loop thread */
+	void (*apply)(const struct commit_job *job);
+	APPLY_CB cb;
+	void *data;
+
+	/** recorded in the snapshot once the file has been committed */
+	enum snapshot_subsystem subsystem;
+	uint64_t hash;
+
+	/** Wi-Fi network whose PSK completes the file, NULL if none */
+	char *ssid;
+	char *passphrase;
+
+	/** AT commands applying a WWAN change without a redial, NULL if none */
+	char *at_commands;
+	/** whether all AT commands succeeded */
+	bool live;
+};
+
+static bool wwan_at_send(const char *commands);
+
+static void
+commit_job_work(void *data)
+{
+	struct commit_job *job = data;
+
+	if (job->ssid) {
+		uint8_t psk[WPA_PSK_LEN];
+
+		/*
+		 * The key is derived in-process, like wpa_passphrase would,
+		 * so the configuration is written in one go.
+		 */
+		wpa_psk(job->ssid, job->passphrase, psk);
+		fputs("\tpsk=", job->rf.fout);
+		for (size_t i = 0; i < sizeof(psk); i++)
+			fprintf(job->rf.fout, "%02x", psk[i]);
+		fputs("\n}\n", job->rf.fout);
+	}
+
+	job->changed = render_commit(&job->rf);
+
+	if (job->at_commands && job->changed > 0)
+		job->live = wwan_at_send(job->at_commands);
+}
+
+static void
+commit_job_done(void *data)
+{
+	struct commit_job *job = data;
+
+	job->apply(job);
+	if (job->changed >= 0)
+		snapshot_applied(job->subsystem, job->hash);
+	else
+		snapshot_invalidate(job->subsystem);
+	if (job->cb)
+		job->cb(job->data);
+
+	free(job->at_commands);
+	free(job->passphrase);
+	free(job->ssid);
+	free(job);
+}
+
+/**
+ * Allocate a commit job and start rendering @p path.
+ *
+ * @param subsystem Snapshot subsystem of the file.
+ * @param hash Hash of the configuration, recorded once it is committed.
+ * @returns The job or NULL on error.
+ */
+static struct commit_job *
+commit_job_open(const char *path, enum snapshot_subsystem subsystem, uint64_t hash,
+                void (*apply)(const struct commit_job *job), APPLY_CB cb, void *data)
+{
+	struct commit_job *job = calloc(1, sizeof(struct commit_job));
+
+	if (!job)
+		return NULL;
+	if (!render_open(&job->rf, path)) {
+		free(job);
+		return NULL;
+	}
+
+	job->subsystem = subsystem;
+	job->hash = hash;
+	job->apply = apply;
+	job->cb = cb;
+	job->data = data;
+	return job;
 }
 
 static inline bool validate_at_param(const char *str)
@@ -538,8 +939,190 @@ static inline bool validate_at_param(const char *str)
 	return str && !strpbrk(str, "\n\r\",");
 }
 
+#ifndef WWAN_AT_PORT
+#define WWAN_AT_PORT "/dev/ttyUSB2"
+#endif
+
+/** time to wait for the result of an AT command, like TIMEOUT in the chat script */
+#define WWAN_AT_TIMEOUT_MS 5000
+
+/**
+ * The WWAN configuration the modem is dialed with.
+ */
+struct wwan_config {
+	/** hash of APN and PIN, changing them requires a redial */
+	uint64_t dial_hash;
+	unsigned int mode_id;
+	unsigned int lte_mode_id;
+	bool has_bands;
+	/** 0-terminated */
+	uint8_t lte_bands[32];
+};
+
+/*
+ * The last configuration handed to the "wwan" worker lane,
+ * only valid while metropolis-wwan is supposed to run.
+ */
+static struct wwan_config wwan_applied;
+static bool wwan_applied_valid;
+
+/**
+ * Send one AT command and wait for its final result code.
+ *
+ * @returns true if the modem answered OK.
+ */
+static bool
+wwan_at_command(int fd, const char *cmd, size_t cmd_len)
+{
+	char buf[512];
+	size_t len = 0;
+
+	logx(LOG_DEBUG, "WWAN: %.*s", (int)cmd_len, cmd);
+	if (dprintf(fd, "%.*s\r", (int)cmd_len, cmd) < 0)
+		return false;
+
+	while (len < sizeof(buf) - 1) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		ssize_t r;
+
+		if (poll(&pfd, 1, WWAN_AT_TIMEOUT_MS) <= 0 ||
+		    (r = read(fd, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			break;
+		len += r;
+		buf[len] = '\0';
+
+		/* the command itself may be echoed */
+		if (strstr(buf, "ERROR"))
+			break;
+		if (strstr(buf, "OK\r\n"))
+			return true;
+	}
+
+	logx(LOG_WARNING, "WWAN: %.*s failed", (int)cmd_len, cmd);
+	return false;
+}
+
+/**
+ * Send AT commands to the modem's control port.
+ *
+ * This blocks and must only be called by worker threads.
+ *
+ * @param commands Newline-terminated AT commands.
+ * @returns true if all commands succeeded.
+ */
+static bool
+wwan_at_send(const char *commands)
+{
+	struct termios tio;
+	bool ok = true;
+	int fd;
+
+	if ((fd = open(WWAN_AT_PORT, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0) {
+		logx(LOG_WARNING, "Cannot open %s: %s", WWAN_AT_PORT, strerror(errno));
+		return false;
+	}
+
+	if (tcgetattr(fd, &tio) < 0) {
+		close(fd);
+		return false;
+	}
+	cfmakeraw(&tio);
+	cfsetspeed(&tio, B115200);
+	tio.c_cflag |= CLOCAL | CREAD;
+	if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+		close(fd);
+		return false;
+	}
+	tcflush(fd, TCIOFLUSH);
+
+	for (const char *cmd = commands, *end; ok && (end = strchr(cmd, '\n')); cmd = end + 1)
+		ok = wwan_at_command(fd, cmd, end - cmd);
+
+	close(fd);
+	return ok;
+}
+
+/**
+ * Build the AT commands changing the modem from @p old to @p new
+ * without a redial.
+ *
+ * @returns The commands, NULL if a redial is necessary or on errors.
+ */
+static char *
+wwan_live_commands(const struct wwan_config *old, const struct wwan_config *new)
+{
+	char *buf = NULL;
+	size_t size;
+	FILE *fout;
+
+	if (old->dial_hash != new->dial_hash ||
+	    (old->has_bands && !new->has_bands))
+		return NULL;
+
+	if (!(fout = open_memstream(&buf, &size)))
+		return NULL;
+
+	if (old->mode_id != new->mode_id)
+		fprintf(fout, "AT+CNMP=%u\n", new->mode_id);
+	if (old->lte_mode_id != new->lte_mode_id)
+		fprintf(fout, "AT+CMNB=%u\n", new->lte_mode_id);
+	if (new->has_bands &&
+	    (!old->has_bands || strcmp((const char *)old->lte_bands,
+	                               (const char *)new->lte_bands) != 0)) {
+		fputs("AT+CBANDCFG=CAT-M", fout);
+		for (int i = 0; new->lte_bands[i] != 0; i++)
+			fprintf(fout, ",%u", new->lte_bands[i]);
+		fputs("\nAT+CBANDCFG=NB-IOT", fout);
+		for (int i = 0; new->lte_bands[i] != 0; i++)
+			fprintf(fout, ",%u", new->lte_bands[i]);
+		fputs("\n", fout);
+	}
+
+	if (fclose(fout) != 0 || !size) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static void apply_wwan(const struct commit_job *job)
+{
+	switch (job->changed) {
+	case 1:
+		if (!job->live) {
+			systemd_unit_job(UNIT_RESTART, "metropolis-wwan.service", NULL, NULL);
+			break;
+		}
+
+		logx(LOG_INFO, "WWAN reconfigured without redial");
+		/* fall through */
+	case 0:
+		/* do not redial the modem if nothing changed */
+		systemd_unit_job(UNIT_START, "metropolis-wwan.service", NULL, NULL);
+		break;
+
+	default:
+		/* the modem's state is unknown */
+		wwan_applied_valid = false;
+		break;
+	}
+}
+
+/**
+ * Configure the WWAN modem.
+ *
+ * Changes of the network mode and bands are sent to the running modem
+ * directly, only APN and PIN changes redial it.
+ *
+ * @param hash Hash of the configuration, recorded in the snapshot
+ *             once the chat script has been committed.
+ * @param cb Callback invoked once the configuration has been applied,
+ *           may be NULL.
+ * @param data User data passed to @p cb.
+ */
 void set_wwan(const char *apn, const char *pin, const char *mode, const char *lte_mode,
-              const uint8_t *lte_bands)
+              const uint8_t *lte_bands, uint64_t hash, APPLY_CB cb, void *data)
 {
 	/*
 	 * NOTE: It is apparently not possible to escape special characters in
@@ -548,35 +1131,46 @@ void set_wwan(const char *apn, const char *pin, const char *mode, const char *lt
 	 */
 	if (!validate_at_param(apn) || (pin && *pin && !validate_at_param(pin))) {
 		logx(LOG_ERR, "APN and/or PIN are malformed");
-		return;
+		snapshot_invalidate(SNAPSHOT_WWAN);
+		goto error;
 	}
 
-	FILE *fout = fopen("/var/run/sim7070-chat.dat", "w");
-	if (!fout) {
-		logx(LOG_ERR, "Cannot open sim7070-chat.dat for writing: %s",
-		     strerror(errno));
-		return;
+	struct commit_job *job = commit_job_open(RUN_PREFIX "/sim7070-chat.dat",
+	                                         SNAPSHOT_WWAN, hash, apply_wwan, cb, data);
+	if (!job) {
+		snapshot_invalidate(SNAPSHOT_WWAN);
+		goto error;
 	}
+	FILE *fout = job->rf.fout;
+
+	struct wwan_config config = { .mode_id = 2, .lte_mode_id = 3 };
 
-	unsigned int mode_id = 2;
+	/* the NUL separates APN and PIN */
+	config.dial_hash = render_hash(RENDER_HASH_INIT, apn, strlen(apn) + 1);
+	if (pin)
+		config.dial_hash = render_hash(config.dial_hash, pin, strlen(pin));
 
 	if (!strcmp(mode, "automatic"))
-		mode_id = 2;
+		config.mode_id = 2;
 	else if (!strcmp(mode, "gsm"))
-		mode_id = 13;
+		config.mode_id = 13;
 	else if (!strcmp(mode, "lte"))
-		mode_id = 38;
+		config.mode_id = 38;
 	else if (!strcmp(mode, "gsm-and-lte"))
-		mode_id = 51;
-
-	unsigned int lte_mode_id = 3;
+		config.mode_id = 51;
 
 	if (!strcmp(lte_mode, "cat-m"))
-		lte_mode_id = 1;
+		config.lte_mode_id = 1;
 	else if (!strcmp(lte_mode, "nb-iot"))
-		lte_mode_id = 2;
+		config.lte_mode_id = 2;
 	else if (!strcmp(lte_mode, "all"))
-		lte_mode_id = 3;
+		config.lte_mode_id = 3;
+
+	if (lte_bands) {
+		config.has_bands = true;
+		for (size_t i = 0; i < sizeof(config.lte_bands) - 1 && lte_bands[i] != 0; i++)
+			config.lte_bands[i] = lte_bands[i];
+	}
 
 	fprintf(fout,
 	        "# AUTOGENERATED BY %s\n"
@@ -595,10 +1189,10 @@ void set_wwan(const char *apn, const char *pin, const char *mode, const char *lt
 	        "OK AT+CGDCONT=1,\"IP\",\"%s\"\n"
 	        "OK AT+CNMP=%u\n"
 	        "OK AT+CMNB=%u\n",
-	        PACKAGE_STRING, apn, mode_id, lte_mode_id);
+	        PACKAGE_STRING, apn, config.mode_id, config.lte_mode_id);
 	if (pin && *pin)
 		fprintf(fout, "OK AT+CPIN=%s\n", pin);
-	if (lte_bands) {
+	if (config.has_bands) {
 		/*
 		 * NOTE: "The value of <band> must is in the band list of getting from AT+CBANDCFG=?"
 		 * (AT Command Manual, p.109).
@@ -606,41 +1200,87 @@ void set_wwan(const char *apn, const char *pin, const char *mode, const char *lt
 		 * responsible for configuring valid bands.
 		 */
 		fputs("OK AT+CBANDCFG=CAT-M", fout);
-		for (int i = 0; lte_bands[i] != 0; i++)
-			fprintf(fout, ",%u", lte_bands[i]);
+		for (int i = 0; config.lte_bands[i] != 0; i++)
+			fprintf(fout, ",%u", config.lte_bands[i]);
 		fputs("\n", fout);
 
 		fputs("OK AT+CBANDCFG=NB-IOT", fout);
-		for (int i = 0; lte_bands[i] != 0; i++)
-			fprintf(fout, ",%u", lte_bands[i]);
+		for (int i = 0; config.lte_bands[i] != 0; i++)
+			fprintf(fout, ",%u", config.lte_bands[i]);
 		fputs("\n", fout);
 	}
 	fputs("OK ATD*99#\n"
 	      "CONNECT ''\n", fout);
 
-	fclose(fout);
+	/*
+	 * The script is still updated, so the next dial
+	 * uses the new settings as well.
+	 */
+	if (wwan_applied_valid)
+		job->at_commands = wwan_live_commands(&wwan_applied, &config);
+	wwan_applied = config;
+	wwan_applied_valid = true;
+
+	worker_submit("wwan", commit_job_work, commit_job_done, job);
+	return;
+
+ error:
+	if (cb)
+		cb(data);
+}
+
+static void stop_wwan_cb(void *data __attribute__((unused)))
+{
+	systemd_unit_job(UNIT_STOP, "metropolis-wwan.service", NULL, NULL);
+}
+
+void stop_wwan(void)
+{
+	wwan_applied_valid = false;
 
-	vsystem("systemctl restart metropolis-wwan");
+	/* must not overtake a configuration that is still being written */
+	worker_submit("wwan", NULL, stop_wwan_cb, NULL);
 }
 
+static void apply_wifi(const struct commit_job *job)
+{
+	if (job->changed < 0)
+		return;
+
+	systemd_unit_job(job->changed ? UNIT_RESTART : UNIT_START,
+	                 "metropolis-wifi.service", NULL, NULL);
+}
+
+/**
+ * Configure the Wi-Fi client.
+ *
+ * @param hash Hash of the configuration, recorded in the snapshot
+ *             once wpa_supplicant.conf has been committed.
+ * @param cb Callback invoked once the configuration has been applied,
+ *           may be NULL.
+ * @param data User data passed to @p cb.
+ */
 void set_wifi(const char *ssid, const char *password,
-              const char *security, const char *country)
+              const char *security, const char *country,
+              uint64_t hash, APPLY_CB cb, void *data)
 {
 	size_t password_len = strlen(password);
 
 	if (strcmp(security, "none") != 0 &&
 	    (8 > password_len || password_len > 63)) {
 		logx(LOG_WARNING, "Invalid Wi-Fi passphrase");
-		vsystem("systemctl stop metropolis-wifi");
-		return;
+		stop_wifi();
+		snapshot_invalidate(SNAPSHOT_WIFI);
+		goto error;
 	}
 
-	FILE *fout = fopen("/var/run/wpa_supplicant.conf", "w");
-	if (!fout) {
-		logx(LOG_ERR, "Cannot open wpa_supplicant.conf for writing: %s",
-		     strerror(errno));
-		return;
+	struct commit_job *job = commit_job_open(RUN_PREFIX "/wpa_supplicant.conf",
+	                                         SNAPSHOT_WIFI, hash, apply_wifi, cb, data);
+	if (!job) {
+		snapshot_invalidate(SNAPSHOT_WIFI);
+		goto error;
 	}
+	FILE *fout = job->rf.fout;
 
 	fputs("# AUTOGENERATED BY " PACKAGE_STRING "\n", fout);
 
@@ -664,26 +1304,32 @@ void set_wifi(const char *ssid, const char *password,
 
 	if (!strcmp(security, "none")) {
 		fputs("}", fout);
-		fclose(fout);
-	} else {
-		fclose(fout);
+	} else if (!(job->ssid = strdup(ssid)) ||
+	           !(job->passphrase = strdup(password))) {
+		/* the PSK is appended by commit_job_work() */
+		render_abort(&job->rf);
+		job->changed = -1;
+		commit_job_done(job);
+		return;
+	}
 
-		char *ssid_quoted = quote_shell_arg(ssid);
-		char *password_quoted = quote_shell_arg(password);
-		assert(ssid_quoted != NULL && password_quoted != NULL);
+	worker_submit("wifi", commit_job_work, commit_job_done, job);
+	return;
 
-		/*
-		 * NOTE: SSIDs and passwords have a maximum length, so
-		 * vasystem() will definitely work here.
-		 */
-		vasystem("wpa_passphrase \"%s\" \"%s\" | tail -n -2 >>/var/run/wpa_supplicant.conf",
-		         ssid_quoted, password_quoted);
+ error:
+	if (cb)
+		cb(data);
+}
 
-		free(password_quoted);
-		free(ssid_quoted);
-	}
+static void stop_wifi_cb(void *data __attribute__((unused)))
+{
+	systemd_unit_job(UNIT_STOP, "metropolis-wifi.service", NULL, NULL);
+}
 
-	vsystem("systemctl restart metropolis-wifi");
+void stop_wifi(void)
+{
+	/* must not overtake a configuration that is still being written */
+	worker_submit("wifi", NULL, stop_wifi_cb, NULL);
 }
 
 void set_value(char *path, const char *str)
@@ -707,6 +1353,8 @@ void set_value(char *path, const char *str)
 
 static void sig_usr1(EV_P_ ev_signal *w, int revents)
 {
+	comm_log_stats();
+	stats_log();
 }
 
 static void sig_usr2(EV_P_ ev_signal *w, int revents)
@@ -742,7 +1390,13 @@ static void usage(void)
 	       "Options:\n\n"
 	       "  -h                        this help\n"
 	       "  -l, --log=IP              write log to syslog at this IP\n"
-	       "  -x                        debug logging\n\n");
+	       "  -d, --debounce=MS         delay before applying notified changes (default: %d ms)\n"
+	       "  -m, --monitor-interval=S  system monitoring sample interval (default: %g s)\n"
+	       "  -t, --monitor-threshold=PERCENT\n"
+	       "                            minimum change of monitored values to be reported (default: %u)\n"
+	       "  -x                        debug logging\n\n",
+	       (int)(NOTIFY_DEBOUNCE_DEFAULT_S * 1000),
+	       MONITORING_INTERVAL_DEFAULT_S, MONITORING_THRESHOLD_DEFAULT);
 
 	exit(EXIT_SUCCESS);
 }
@@ -760,10 +1414,13 @@ int main(int argc, char *argv[])
 		int option_index = 0;
 		static struct option long_options[] = {
 			{"log",       1, 0, 'l'},
+			{"debounce",  1, 0, 'd'},
+			{"monitor-interval",  1, 0, 'm'},
+			{"monitor-threshold", 1, 0, 't'},
 			{0, 0, 0, 0}
 		};
 
-		c = getopt_long(argc, argv, "hl:x",
+		c = getopt_long(argc, argv, "hl:d:m:t:x",
 				long_options, &option_index);
 		if (c == -1)
 			break;
@@ -784,6 +1441,42 @@ int main(int argc, char *argv[])
 			break;
 		}
 
+		case 'd': {
+			char *end;
+			long ms = strtol(optarg, &end, 10);
+
+			if (*optarg == '\0' || *end != '\0' || ms < 0) {
+				fprintf(stderr, "Invalid debounce interval: '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			notify_debounce = ms / 1000.;
+			break;
+		}
+
+		case 'm': {
+			char *end;
+			double interval = strtod(optarg, &end);
+
+			if (*optarg == '\0' || *end != '\0' || !(interval >= 1.)) {
+				fprintf(stderr, "Invalid monitoring interval: '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			monitoring_interval = interval;
+			break;
+		}
+
+		case 't': {
+			char *end;
+			unsigned long threshold = strtoul(optarg, &end, 10);
+
+			if (*optarg == '\0' || *end != '\0' || threshold > 100) {
+				fprintf(stderr, "Invalid monitoring threshold: '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			monitoring_threshold = threshold;
+			break;
+		}
+
 		case 'x':
 			logx_level = LOG_DEBUG;
 			break;
@@ -794,6 +1487,7 @@ int main(int argc, char *argv[])
 	}
 
 	logx_open(basename(argv[0]), LOG_CONS | LOG_PID | LOG_PERROR, LOG_DAEMON);
+	init_log(EV_DEFAULT);
 
 	ev_signal_init(&signal_usr1, sig_usr1, SIGUSR1);
 	ev_signal_start(EV_DEFAULT_ &signal_usr1);
@@ -820,6 +1514,10 @@ int main(int argc, char *argv[])
 	signal_term.data = "SIGTERM";
 	ev_signal_start(EV_DEFAULT_ &signal_term);
 
+	init_exec(EV_DEFAULT);
+	init_worker(EV_DEFAULT);
+	init_ptp(EV_DEFAULT);
+	init_systemd(EV_DEFAULT);
 	init_comm(EV_DEFAULT);
 
 	logx(LOG_NOTICE, "startup %s %s", PACKAGE_STRING, _build);
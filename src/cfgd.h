@@ -12,6 +12,13 @@
 #include <sys/tree.h>
 #include <ev.h>
 
+/**
+ * The prefix of persistent service configurations.
+ */
+#ifndef SYSCONF_PREFIX
+#define SYSCONF_PREFIX "/etc"
+#endif
+
 struct ntp_servers {
 	void *ctx;
 	int enabled;
@@ -29,6 +36,7 @@ struct auth_ssh_key_list {
 	void *ctx;
 	int count;
 	struct auth_ssh_key *ssh;
+	int alloc;
 };
 
 struct auth_user {
@@ -41,18 +49,25 @@ struct auth_list {
 	void *ctx;
 	int count;
 	struct auth_user *user;
+	int alloc;
 };
 
+/*
+ * All lists start with the same members as struct var_list,
+ * so they can be managed by the same functions.
+ */
 struct var_list {
 	void *ctx;
 	int count;
 	void *data;
+	int alloc;
 };
 
 struct string_list {
 	void *ctx;
 	int count;
 	char **s;
+	int alloc;
 };
 
 struct ipaddr {
@@ -65,6 +80,7 @@ struct ip_list {
 	void *ctx;
 	int count;
 	struct ipaddr *ip;
+	int alloc;
 };
 
 struct if_ip {
@@ -81,6 +97,9 @@ struct if_dhcp {
 };
 
 struct interface {
+	RB_ENTRY(interface) id_node;
+	RB_ENTRY(interface) name_node;
+
 	char *name;
 	unsigned int instance_id;
 
@@ -89,27 +108,55 @@ struct interface {
 	struct if_dhcp dhcp;
 };
 
+RB_HEAD(interface_id_tree, interface);
+RB_HEAD(interface_name_tree, interface);
+
+RB_PROTOTYPE(interface_id_tree, interface, id_node, interface_id_cmp);
+RB_PROTOTYPE(interface_name_tree, interface, name_node, interface_name_cmp);
+
 struct interface_list {
 	void *ctx;
 	int count;
 	struct interface *iface;
+	int alloc;
+
+	/* built by interface_list_index() once the list is complete */
+	struct interface_id_tree by_id;
+	struct interface_name_tree by_name;
 
 	unsigned int flags;
 };
 
+void interface_list_index(struct interface_list *info);
+struct interface *interface_by_id(struct interface_list *info, unsigned int instance_id);
+struct interface *interface_by_name(struct interface_list *info, const char *name);
+
+/**
+ * Completion callback of a configuration change that takes effect
+ * asynchronously.
+ *
+ * @param data User data passed along with the callback.
+ */
+typedef void (*APPLY_CB)(void *data);
+
 void set_ntp_server(const struct ntp_servers *servers);
-void set_ptp_state(const char *state);
+bool valid_if_name(const char *name);
+void set_ptp_state(const char *state, const char *interface);
 void set_autoid_enabled(bool enabled);
 void set_mosquitto(const char *host, uint16_t port,
                    const char *username, const char *password);
 void set_wwan(const char *apn, const char *pin,
               const char *mode, const char *lte_mode,
-              const uint8_t *lte_bands);
+              const uint8_t *lte_bands, uint64_t hash,
+              APPLY_CB cb, void *data);
+void stop_wwan(void);
 void set_wifi(const char *ssid, const char *password,
-              const char *security, const char *country);
+              const char *security, const char *country,
+              uint64_t hash, APPLY_CB cb, void *data);
+void stop_wifi(void);
 void set_dns(const struct string_list *search, const struct string_list *servers);
 void set_authentication(const struct auth_list *auth);
-void set_if_addr(struct interface_list *info);
+void set_if_addr(struct interface_list *info, APPLY_CB cb, void *data);
 void set_if_neigh(struct interface_list *info);
 void set_value(char *path, const char *str);
 
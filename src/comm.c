@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <endian.h>
 #include <fcntl.h>
 #include <time.h>
 #include <sys/types.h>
@@ -20,6 +21,8 @@
 #include <sys/tree.h>
 #include <sys/queue.h>
 #include <sys/ioctl.h>
+#include <sys/param.h>
+#include <sys/inotify.h>
 #include <net/if.h>
 #include <arpa/inet.h>
 #include <errno.h>
@@ -35,7 +38,6 @@
 
 #include <ev.h>
 
-#include <mand/logx.h>
 #include <mand/binary.h>
 
 #ifdef HAVE_TALLOC_TALLOC_H
@@ -53,6 +55,14 @@
 
 #include "cfgd.h"
 #include "comm.h"
+#include "netlink.h"
+#include "systemd.h"
+#include "monitor.h"
+#include "render.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "ptp.h"
+#include "log.h"
 
 #define IF_IP     (1 << 0)
 #define IF_NEIGH  (1 << 1)
@@ -60,11 +70,13 @@
 #define CB_ERR(...) \
 	do {					\
 		logx(LOG_ERR, __VA_ARGS__);	\
+		stats_error();			\
 		return;				\
 	} while (0)
 #define CB_ERR_RET(ret, ...)			\
 	do {					\
 		logx(LOG_ERR, __VA_ARGS__);	\
+		stats_error();			\
 		return ret;			\
 	} while (0)
 
@@ -75,9 +87,236 @@
 	s; \
 })
 
-#define MEGABYTE (1024U * 1024U)
 #define SYSTEM_MONITORING_REPORT_INTERVAL_S (10 * 60)
 
+/*
+ * Subsystems that have pending changes from active notifications.
+ */
+#define DIRTY_PTP       (1 << 0)
+#define DIRTY_AUTOID    (1 << 1)
+#define DIRTY_SPARKPLUG (1 << 2)
+#define DIRTY_WWAN      (1 << 3)
+#define DIRTY_WIFI      (1 << 4)
+
+ev_tstamp notify_debounce = NOTIFY_DEBOUNCE_DEFAULT_S;
+
+static ev_timer notify_debounce_timer;
+static unsigned int notify_dirty;
+static char pending_ptp_state[32];
+static char pending_ptp_interface[IFNAMSIZ];
+static bool pending_autoid_enabled;
+
+/*
+ * Scheduler for configuration changes at runtime.
+ *
+ * Every subsystem is listed and applied independently of the others,
+ * unless it depends on a subsystem that is being applied.
+ * Requests for a subsystem that arrive while it is being applied bump
+ * its generation. An answer of an older generation is discarded and
+ * the subsystem is listed again, instead of applying every
+ * intermediate configuration in turn.
+ */
+enum apply_subsystem {
+	APPLY_NTP,
+	APPLY_DNS,
+	APPLY_AUTHENTICATION,
+	APPLY_INTERFACES,
+	APPLY_SPARKPLUG,
+	APPLY_WWAN,
+	APPLY_WIFI,
+	APPLY_SUBSYSTEMS
+};
+
+#define APPLY_BIT(subsystem) (1 << (subsystem))
+
+static struct apply_task {
+	const char *name;
+	/** subsystems that must not be applied concurrently, APPLY_BIT()s */
+	unsigned int deps;
+
+	/** generation of the last request */
+	unsigned int generation;
+	/** generation being applied */
+	unsigned int started;
+	bool running;
+	bool queued;
+	/** IF_* flags of queued interface requests */
+	unsigned int if_flags;
+} apply_tasks[APPLY_SUBSYSTEMS] = {
+	[APPLY_NTP]            = { "system.ntp" },
+	/* resolved picks up per-link settings from networkd */
+	[APPLY_DNS]            = { "system.dns-resolver", APPLY_BIT(APPLY_INTERFACES) },
+	[APPLY_AUTHENTICATION] = { "system.authentication" },
+	[APPLY_INTERFACES]     = { "interfaces" },
+	[APPLY_SPARKPLUG]      = { "sparkplug" },
+	[APPLY_WWAN]           = { "wwan" },
+	[APPLY_WIFI]           = { "wifi" }
+};
+
+static DMCONTEXT *apply_ctx;
+
+/**
+ * The connection to mand is established, cleared by connection_lost().
+ */
+static bool dm_connected;
+
+static void apply_start(DMCONTEXT *dmCtx, enum apply_subsystem subsystem);
+static void connection_lost(DMCONTEXT *dmCtx, bool shutdown);
+
+/**
+ * Starts all queued subsystems whose dependencies are idle.
+ */
+static void
+apply_run_queued(void)
+{
+	/* the startup pipeline lists everything again after reconnecting */
+	if (!dm_connected)
+		return;
+
+	for (int i = 0; i < APPLY_SUBSYSTEMS; i++) {
+		struct apply_task *task = apply_tasks + i;
+		bool blocked = task->running;
+
+		for (int j = 0; !blocked && j < APPLY_SUBSYSTEMS; j++)
+			blocked = (task->deps & APPLY_BIT(j)) && apply_tasks[j].running;
+
+		if (task->queued && !blocked)
+			apply_start(apply_ctx, i);
+	}
+}
+
+/**
+ * Requests listing and applying a subsystem.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @param subsystem The subsystem.
+ * @param if_flags IF_* flags for APPLY_INTERFACES, 0 otherwise.
+ */
+static void
+apply_schedule(DMCONTEXT *dmCtx, enum apply_subsystem subsystem, unsigned int if_flags)
+{
+	struct apply_task *task = apply_tasks + subsystem;
+
+	apply_ctx = dmCtx;
+	task->generation++;
+	task->queued = true;
+	task->if_flags |= if_flags;
+
+	if (task->running)
+		logx(LOG_DEBUG, "%s: generation %u supersedes %u",
+		     task->name, task->generation, task->started);
+
+	apply_run_queued();
+}
+
+/**
+ * Checks whether the answer being processed has been superseded by
+ * a newer request.
+ */
+static bool
+apply_superseded(enum apply_subsystem subsystem)
+{
+	struct apply_task *task = apply_tasks + subsystem;
+
+	return task->running && task->started != task->generation;
+}
+
+/**
+ * Marks a subsystem as applied and starts queued requests.
+ *
+ * Subsystems that were not started by apply_schedule() are ignored,
+ * and so are completions of an older generation: they were started
+ * before the connection to mand was lost and the subsystem may be
+ * running again since.
+ *
+ * @param subsystem The subsystem.
+ * @param generation The generation that has been applied.
+ */
+static void
+apply_done(enum apply_subsystem subsystem, unsigned int generation)
+{
+	struct apply_task *task = apply_tasks + subsystem;
+
+	if (!task->running)
+		return;
+	if (task->started != generation) {
+		logx(LOG_DEBUG, "%s: ignoring completion of generation %u, applying %u",
+		     task->name, generation, task->started);
+		return;
+	}
+
+	logx(LOG_DEBUG, "%s: generation %u applied", task->name, task->started);
+	task->running = false;
+	apply_run_queued();
+}
+
+#define APPLY_SUBSYSTEM_BITS 4
+#define APPLY_SUBSYSTEM_MASK ((1 << APPLY_SUBSYSTEM_BITS) - 1)
+
+/**
+ * Encodes a subsystem and the generation being applied
+ * as user data for apply_done_cb().
+ *
+ * The generation is truncated to the remaining bits of a pointer.
+ */
+static void *
+apply_cb_data(enum apply_subsystem subsystem, unsigned int generation)
+{
+	return (void *)((uintptr_t)generation << APPLY_SUBSYSTEM_BITS | subsystem);
+}
+
+static void
+apply_done_cb(void *data)
+{
+	enum apply_subsystem subsystem = (uintptr_t)data & APPLY_SUBSYSTEM_MASK;
+	unsigned int generation = apply_tasks[subsystem].started;
+
+	/* compared in the encoded form, so a truncated generation still matches */
+	if (data != apply_cb_data(subsystem, generation))
+		generation = (uintptr_t)data >> APPLY_SUBSYSTEM_BITS;
+	apply_done(subsystem, generation);
+}
+
+/** see APPLY_SCOPE() */
+struct apply_scope {
+	enum apply_subsystem subsystem;
+	unsigned int generation;
+};
+
+static void
+apply_scope_end(struct apply_scope *scope)
+{
+	if (scope->subsystem != APPLY_SUBSYSTEMS)
+		apply_done(scope->subsystem, scope->generation);
+}
+
+/**
+ * Marks @p subsystem as applied when the enclosing block is left,
+ * including early returns, see apply_done().
+ *
+ * The answer being processed belongs to the generation currently
+ * being applied.
+ */
+#define APPLY_SCOPE(subsystem) \
+	struct apply_scope apply_scope __attribute__((cleanup(apply_scope_end))) = \
+		{ (subsystem), apply_tasks[(subsystem)].started }
+
+/**
+ * Hands the subsystem of APPLY_SCOPE() over to apply_done_cb(),
+ * for changes that take effect asynchronously.
+ *
+ * @param scope The apply_scope variable declared by APPLY_SCOPE().
+ * @returns User data for apply_done_cb().
+ */
+static void *
+apply_scope_defer(struct apply_scope *scope)
+{
+	void *data = apply_cb_data(scope->subsystem, scope->generation);
+
+	scope->subsystem = APPLY_SUBSYSTEMS;
+	return data;
+}
+
 static int sys_scan(const char *file, const char *fmt, ...)
 {
 	FILE *fin;
@@ -102,8 +341,61 @@ static int sys_scan(const char *file, const char *fmt, ...)
 	return rc;
 }
 
-typedef void (*DECODE_CB)(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-	                  void *data, size_t size, void *cb_data);
+struct decode_node;
+
+/**
+ * Called for every instance of a table node.
+ *
+ * @param ctx talloc context of the decoded data.
+ * @param obj The object the table belongs to (plus the node's offset).
+ * @param id The instance id.
+ * @returns The object the instance's children are decoded into,
+ *          NULL to skip the instance.
+ */
+typedef void *(*DECODE_ENTER)(void *ctx, void *obj, uint16_t id);
+
+/**
+ * Called for every value of an element or array node.
+ *
+ * @param ctx talloc context of the decoded data.
+ * @param obj The object the element belongs to.
+ * @param node The schema node, node->offset is usually the offset
+ *             of the field within @p obj.
+ * @param data The value.
+ * @param size Size of @p data.
+ */
+typedef void (*DECODE_SET)(void *ctx, void *obj, const struct decode_node *node,
+                           void *data, size_t size);
+
+/**
+ * Node of a static schema for decoding LIST answers.
+ *
+ * Schemas are arrays of nodes terminated by an empty node.
+ * The AVP names are matched against the schema while decoding,
+ * so no path strings have to be built or parsed and nodes
+ * the agent does not consume are skipped.
+ */
+struct decode_node {
+	const char *name;
+	/** children of objects and of the instances of tables */
+	const struct decode_node *children;
+	/** table nodes: creates the object of an instance */
+	DECODE_ENTER enter;
+	/** element and array nodes: stores a value */
+	DECODE_SET set;
+	/**
+	 * Table nodes: if set, the table is decoded into a struct var_list
+	 * of entries of this size, which is pre-sized to the number of instances.
+	 */
+	size_t entry_size;
+	/**
+	 * Offset of the decoded field within the parent object.
+	 * Objects and tables are decoded into the parent object plus offset.
+	 */
+	size_t offset;
+};
+
+#define DECODE_FIELD(obj, node, type) ((type *)((char *)(obj) + (node)->offset))
 
 static void new_var_list(void *ctx, struct var_list *list, size_t size)
 {
@@ -111,14 +403,31 @@ static void new_var_list(void *ctx, struct var_list *list, size_t size)
 	list->ctx = ctx;
 }
 
+/**
+ * Make room for at least @p count entries of @p size bytes.
+ */
+static bool reserve_var_list(struct var_list *list, size_t size, int count)
+{
+	void *data;
+
+	if (count <= list->alloc)
+		return true;
+
+	if (!(data = talloc_realloc_size(list->ctx, list->data, size * count)))
+		return false;
+	list->data = data;
+	list->alloc = count;
+
+	return true;
+}
+
 static void *add_var_list(struct var_list *list, size_t size)
 {
 	void *p;
 
-	if ((list->count % 16) == 0) {
-		if (!(list->data = talloc_realloc_size(list->ctx, list->data, size * (list->count + 16))))
-			return NULL;
-	}
+	if (list->count == list->alloc &&
+	    !reserve_var_list(list, size, list->alloc ? list->alloc * 2 : 16))
+		return NULL;
 	list->count++;
 
 	p = ((void *)list->data) + (list->count - 1) * size;
@@ -142,19 +451,144 @@ static void add_string_list(struct string_list *list, const void *data, size_t s
 	*d = talloc_strndup(list->ctx, data, size);
 }
 
+static void
+decode_uint8(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
+{
+	*DECODE_FIELD(obj, node, uint8_t) = dm_get_uint8_avp(data);
+}
+
+static void
+decode_uint32(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
+{
+	*DECODE_FIELD(obj, node, uint32_t) = dm_get_uint32_avp(data);
+}
+
+static void
+decode_string(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
+{
+	*DECODE_FIELD(obj, node, char *) = talloc_strndup(ctx, data, size);
+}
+
+static const struct decode_node *
+decode_lookup(const struct decode_node *schema, const char *name, size_t size)
+{
+	for (; schema && schema->name; schema++)
+		if (strncmp(schema->name, name, size) == 0 && schema->name[size] == '\0')
+			return schema;
+
+	return NULL;
+}
+
+/**
+ * Minimum size of a decoding arena.
+ */
+#define ARENA_MIN_SIZE 4096
+
+/**
+ * Statistics of the decoding arenas, see arena_free().
+ */
+static struct {
+	unsigned long cycles;
+	size_t last_blocks;
+	size_t max_blocks;
+	size_t last_bytes;
+	size_t peak_bytes;
+} arena_stats;
+
+/**
+ * Creates the arena of one decode and apply cycle.
+ *
+ * Everything decoded from an answer is allocated from one talloc pool
+ * sized from the answer, so the cycle's allocations are contiguous and
+ * released in a single operation by arena_free().
+ * Allocations exceeding the pool still succeed, but fall back to the heap.
+ *
+ * @param ctx Parent talloc context, may be NULL.
+ * @param grp The answer that is going to be decoded.
+ * @returns The arena or NULL.
+ */
+static void *
+arena_new(const void *ctx, const DM2_AVPGRP *grp)
+{
+	/*
+	 * Decoded lists consist of little more than the strings
+	 * in the answer plus the list entries.
+	 */
+	size_t size = grp ? (grp->size - grp->pos) * 2 : 0;
+
+	return talloc_pool(ctx, size > ARENA_MIN_SIZE ? size : ARENA_MIN_SIZE);
+}
+
+/**
+ * Releases an arena and accounts for its allocations.
+ *
+ * Since nothing is freed before the end of a cycle, the size of
+ * the arena's children is the cycle's peak usage.
+ */
+static void
+arena_free(void *arena, const char *name)
+{
+	if (!arena)
+		return;
+
+	arena_stats.cycles++;
+	arena_stats.last_blocks = talloc_total_blocks(arena) - 1;
+	arena_stats.last_bytes = talloc_total_size(arena) - talloc_get_size(arena);
+	arena_stats.max_blocks = MAX(arena_stats.max_blocks, arena_stats.last_blocks);
+	arena_stats.peak_bytes = MAX(arena_stats.peak_bytes, arena_stats.last_bytes);
+
+	logx(LOG_DEBUG, "%s: %zu allocations, %zu bytes",
+	     name, arena_stats.last_blocks, arena_stats.last_bytes);
+
+	talloc_free(arena);
+}
+
+/**
+ * Hashes the part of an answer that has not been decoded yet.
+ *
+ * The answer to a request is identical as long as the configuration
+ * is unchanged, so the hash identifies the configuration in the
+ * warm-start snapshot, see snapshot_unchanged().
+ */
+static uint64_t
+answer_hash(const DM2_AVPGRP *grp)
+{
+	return render_hash(RENDER_HASH_INIT, (const char *)grp->data + grp->pos,
+	                   grp->size - grp->pos);
+}
+
+/**
+ * Logs the statistics of the decoding arenas.
+ */
+void comm_log_stats(void)
+{
+	logx(LOG_INFO, "Decoding arenas: %lu cycles, last %zu allocations/%zu bytes, "
+	     "max %zu allocations/%zu bytes",
+	     arena_stats.cycles, arena_stats.last_blocks, arena_stats.last_bytes,
+	     arena_stats.max_blocks, arena_stats.peak_bytes);
+}
+
+/**
+ * Decode one node of a LIST answer according to a schema.
+ *
+ * @param schema Nodes expected at this level.
+ * @param grp The AVP group to decode from.
+ * @param ctx talloc context of the decoded data.
+ * @param obj The object corresponding to this level.
+ * @returns RC_OK if a node was decoded or skipped,
+ *          another RC at the end of @p grp or on errors.
+ */
 static uint32_t
-decode_node_list(DMCONTEXT *socket, const char *prefix, DM2_AVPGRP *grp, DECODE_CB cb, void *cb_data)
+decode_node_list(const struct decode_node *schema, DM2_AVPGRP *grp, void *ctx, void *obj)
 {
 	uint32_t r;
 	DM2_AVPGRP container;
-	uint32_t code;
+	uint32_t code, name_code;
 	uint32_t vendor_id;
-	void *data;
-	size_t size;
-
-	char *name, *path;
-	uint16_t id;
+	void *data, *name;
+	size_t size, name_size;
 	uint32_t type;
+	const struct decode_node *node;
 
 	if ((r = dm_expect_avp(grp, &code, &vendor_id, &data, &size)) != RC_OK)
 		return r;
@@ -162,76 +596,88 @@ decode_node_list(DMCONTEXT *socket, const char *prefix, DM2_AVPGRP *grp, DECODE_
 	if (vendor_id != VP_TRAVELPING)
 		return RC_ERR_MISC;
 
-	dm_init_avpgrp(grp->ctx, data, size, &container);
-
 	switch (code) {
 	case AVP_TABLE:
-		if ((r = dm_expect_string_type(&container, AVP_NAME, VP_TRAVELPING, &name)) != RC_OK)
-			return r;
+	case AVP_OBJECT:
+	case AVP_ELEMENT:
+	case AVP_ARRAY:
+		break;
+	default:
+		return RC_ERR_MISC;
+	}
 
-		if (!(path = talloc_asprintf(container.ctx, "%s.%s", prefix, name)))
-			return RC_ERR_ALLOC;
+	dm_init_avpgrp(grp->ctx, data, size, &container);
 
-		while (decode_node_list(socket, path, &container, cb, cb_data) == RC_OK) {
-		}
+	if ((r = dm_expect_avp(&container, &name_code, &vendor_id, &name, &name_size)) != RC_OK)
+		return r;
+	if (name_code != AVP_NAME || vendor_id != VP_TRAVELPING)
+		return RC_ERR_MISC;
 
-		break;
+	/* not consumed by the agent */
+	if (!(node = decode_lookup(schema, name, name_size)))
+		return RC_OK;
 
-	case AVP_INSTANCE:
-		if ((r = dm_expect_uint16_type(&container, AVP_NAME, VP_TRAVELPING, &id)) != RC_OK)
-			return r;
+	switch (code) {
+	case AVP_TABLE: {
+		void *table = (char *)obj + node->offset;
 
-		if (!(path = talloc_asprintf(container.ctx, "%s.%d", prefix, id)))
-			return RC_ERR_ALLOC;
+		if (node->entry_size) {
+			DM2_AVPGRP instances = container;
+			int count = 0;
 
-		while (decode_node_list(socket, path, &container, cb, cb_data) == RC_OK) {
+			while (dm_expect_avp(&instances, &code, &vendor_id, &data, &size) == RC_OK)
+				count++;
+			reserve_var_list((struct var_list *)table, node->entry_size,
+			                 ((struct var_list *)table)->count + count);
 		}
 
-		break;
+		while (dm_expect_avp(&container, &code, &vendor_id, &data, &size) == RC_OK) {
+			DM2_AVPGRP instance;
+			uint16_t id;
+			void *child;
 
-	case AVP_OBJECT:
-		if ((r = dm_expect_string_type(&container, AVP_NAME, VP_TRAVELPING, &name)) != RC_OK)
-			return r;
+			if (code != AVP_INSTANCE || vendor_id != VP_TRAVELPING)
+				return RC_ERR_MISC;
+
+			dm_init_avpgrp(grp->ctx, data, size, &instance);
+			if ((r = dm_expect_uint16_type(&instance, AVP_NAME, VP_TRAVELPING, &id)) != RC_OK)
+				return r;
 
-		if (!(path = talloc_asprintf(container.ctx, "%s.%s", prefix, name)))
-			return RC_ERR_ALLOC;
+			if (!(child = node->enter ? node->enter(ctx, table, id) : table))
+				continue;
 
-		while (decode_node_list(socket, path, &container, cb, cb_data) == RC_OK) {
+			while (decode_node_list(node->children, &instance, ctx, child) == RC_OK) {
+			}
 		}
+		break;
+	}
 
+	case AVP_OBJECT:
+		while (decode_node_list(node->children, &container, ctx,
+		                        (char *)obj + node->offset) == RC_OK) {
+		}
 		break;
 
 	case AVP_ELEMENT:
-		if ((r = dm_expect_string_type(&container, AVP_NAME, VP_TRAVELPING, &name)) != RC_OK
-		    || (r = dm_expect_uint32_type(&container, AVP_TYPE, VP_TRAVELPING, &type)) != RC_OK)
-			return r;
-
-		if (!(path = talloc_asprintf(container.ctx, "%s.%s", prefix, name)))
-			return RC_ERR_ALLOC;
-
-		if ((r = dm_expect_avp(&container, &code, &vendor_id, &data, &size)) != RC_OK)
+		if ((r = dm_expect_uint32_type(&container, AVP_TYPE, VP_TRAVELPING, &type)) != RC_OK
+		    || (r = dm_expect_avp(&container, &code, &vendor_id, &data, &size)) != RC_OK)
 			return r;
 
-		cb(socket, path, code, vendor_id, data, size, cb_data);
+		if (node->set)
+			node->set(ctx, obj, node, data, size);
 		break;
 
 	case AVP_ARRAY:
-		if ((r = dm_expect_string_type(&container, AVP_NAME, VP_TRAVELPING, &name)) != RC_OK
-		    || (r = dm_expect_uint32_type(&container, AVP_TYPE, VP_TRAVELPING, &type)) != RC_OK)
+		if ((r = dm_expect_uint32_type(&container, AVP_TYPE, VP_TRAVELPING, &type)) != RC_OK)
 			return r;
 
-		if (!(path = talloc_asprintf(container.ctx, "%s.%s", prefix, name)))
-			return RC_ERR_ALLOC;
-
 		while (dm_expect_group_end(&container) != RC_OK) {
 			if ((r = dm_expect_avp(&container, &code, &vendor_id, &data, &size)) != RC_OK)
 				return r;
-			cb(socket, path, code, vendor_id, data, size, cb_data);
+			if (node->set)
+				node->set(ctx, obj, node, data, size);
 		}
 		break;
-
-	default:
-		return RC_ERR_MISC;
 	}
 
 	return RC_OK;
@@ -243,33 +689,56 @@ decode_node_list(DMCONTEXT *socket, const char *prefix, DM2_AVPGRP *grp, DECODE_
  *       the datamodel also supports TCP
  */
 static void
-ntp_cb(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-       void *data, size_t size, void *cb_data)
+ntp_add_server(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
 {
-	struct ntp_servers *srvs = (struct ntp_servers *)cb_data;
-	const char *s;
+	struct ntp_servers *srvs = (struct ntp_servers *)obj;
 
-	if (!(s = strrchr(name, '.')))
-		return;
-
-	if (strncmp(s + 1, "enabled", 7) == 0) {
-		srvs->enabled = dm_get_uint8_avp(data);
-	} else if (strncmp(s + 1, "address", 7) == 0) {
-		if ((srvs->count % 16) == 0) {
-			srvs->server = talloc_realloc(NULL, srvs->server, char *, srvs->count + 16);
-			if (!srvs->server)
-				return;
-		}
-		srvs->server[srvs->count] = talloc_strndup(srvs->server, data, size);
-		srvs->count++;
+	if ((srvs->count % 16) == 0) {
+		srvs->server = talloc_realloc(ctx, srvs->server, char *, srvs->count + 16);
+		if (!srvs->server)
+			return;
 	}
+	srvs->server[srvs->count] = talloc_strndup(ctx, data, size);
+	srvs->count++;
+}
+
+static void
+ntp_set_enabled(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
+{
+	((struct ntp_servers *)obj)->enabled = dm_get_uint8_avp(data);
 }
 
+static const struct decode_node ntp_server_udp_schema[] = {
+	{ .name = "address", .set = ntp_add_server },
+	{ }
+};
+
+static const struct decode_node ntp_server_schema[] = {
+	{ .name = "udp", .children = ntp_server_udp_schema },
+	{ }
+};
+
+static const struct decode_node ntp_children_schema[] = {
+	{ .name = "enabled", .set = ntp_set_enabled },
+	{ .name = "server", .children = ntp_server_schema },
+	{ }
+};
+
+/** system.ntp */
+static const struct decode_node ntp_schema[] = {
+	{ .name = "ntp", .children = ntp_children_schema },
+	{ }
+};
+
 static void
 ntpListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata __attribute__((unused)))
 {
 	uint32_t rc, answer_rc;
 	struct ntp_servers srvs;
+	uint64_t hash;
+	void *arena;
+	STATS_SCOPE(STATS_NTP_LIST);
+	APPLY_SCOPE(APPLY_NTP);
 
 	if (event != DMCONFIG_ANSWER_READY)
 	        CB_ERR("Couldn't list object, ev=%d.\n", event);
@@ -278,16 +747,28 @@ ntpListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *
 	    || answer_rc != RC_OK)
 	        CB_ERR("Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
 
+	if (apply_superseded(APPLY_NTP) ||
+	    snapshot_unchanged(SNAPSHOT_NTP, (hash = answer_hash(grp))))
+		return;
+
+	if (!(arena = arena_new(NULL, grp)))
+		CB_ERR("Out of memory.\n");
+
 	srvs.enabled = 0;
 	srvs.count = 0;
-	srvs.server = talloc_array(grp->ctx, char *, 16);
-	if (!srvs.server)
+	srvs.server = talloc_array(arena, char *, 16);
+	if (!srvs.server) {
+		talloc_free(arena);
 		return;
+	}
 
-	while (decode_node_list(socket, "", grp, ntp_cb, &srvs) == RC_OK) {
+	while (decode_node_list(ntp_schema, grp, arena, &srvs) == RC_OK) {
 	}
 
 	set_ntp_server(&srvs);
+	snapshot_applied(SNAPSHOT_NTP, hash);
+
+	arena_free(arena, "system.ntp");
 }
 
 static void
@@ -297,15 +778,54 @@ listSystemNtp(DMCONTEXT *dmCtx)
 	        CB_ERR("Couldn't register LIST request.\n");
 }
 
+struct ptp_params {
+	char *state;
+	char *interface;
+};
+
+static const struct decode_node ptp_children_schema[] = {
+	{ .name = "state", .set = decode_string, .offset = offsetof(struct ptp_params, state) },
+	{ .name = "interface", .set = decode_string, .offset = offsetof(struct ptp_params, interface) },
+	{ }
+};
+
+/** system.ptp */
+static const struct decode_node ptp_schema[] = {
+	{ .name = "ptp", .children = ptp_children_schema },
+	{ }
+};
+
+/**
+ * Store the PTP interface of the data model for set_ptp_state().
+ *
+ * Invalid names are not truncated or rendered, the default
+ * interface is used instead.
+ *
+ * @param value The interface, NULL or empty for the default.
+ */
+static void
+set_pending_ptp_interface(const char *value)
+{
+	if (value && *value && !valid_if_name(value)) {
+		logx(LOG_ERR, "Invalid \"system.ptp.interface\", using the default interface");
+		value = NULL;
+	}
+
+	snprintf(pending_ptp_interface, sizeof(pending_ptp_interface), "%s", value ? : "");
+}
+
 static void
-ptpGetReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
-               void *userdata __attribute__((unused)))
+ptpListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
+                void *userdata __attribute__((unused)))
 {
 	uint32_t rc, answer_rc;
-	char *ptp_state;
+	struct ptp_params params;
+	uint64_t hash;
+	void *ctx;
+	STATS_SCOPE(STATS_PTP_GET);
 
 	if (event != DMCONFIG_ANSWER_READY)
-	        CB_ERR("Couldn't get \"system.ptp.state\", ev=%d.\n", event);
+	        CB_ERR("Couldn't list \"system.ptp\", ev=%d.\n", event);
 
 	/*
 	 * This depends on the metropolis-ptp Yang module,
@@ -314,29 +834,55 @@ ptpGetReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	 */
 	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
 	    || answer_rc != RC_OK) {
-	        logx(LOG_INFO, "Couldn't get \"system.ptp.state\", rc=%d,%d.\n", rc, answer_rc);
+	        logx(LOG_INFO, "Couldn't list \"system.ptp\", rc=%d,%d.\n", rc, answer_rc);
 		return;
 	}
 
-	if ((rc = dm_expect_string_type(grp, AVP_ENUM, VP_TRAVELPING, &ptp_state)) != RC_OK ||
-	    (rc = dm_expect_group_end(grp)) != RC_OK)
-		CB_ERR("Couldn't decode GET request, rc=%d", rc);
+	memset(&params, 0, sizeof(params));
+	if (!(ctx = arena_new(NULL, grp)))
+		CB_ERR("Out of memory.\n");
 
-	set_ptp_state(ptp_state);
-}
+	while (decode_node_list(ptp_schema, grp, ctx, &params) == RC_OK);
 
-static void
-listSystemPtp(DMCONTEXT *dmCtx)
-{
-	static const char *paths[] = {
-		"system.ptp.state"
-	};
+	if (!params.state) {
+		arena_free(ctx, "system.ptp");
+		CB_ERR("Couldn't decode \"system.ptp.state\"");
+	}
 
-	uint32_t rc;
+	/* later notifications only carry the parameter that changed */
+	snprintf(pending_ptp_state, sizeof(pending_ptp_state), "%s", params.state);
+	set_pending_ptp_interface(params.interface);
 
-	rc = rpc_db_get_async(dmCtx, sizeof(paths)/sizeof(paths[0]), paths, ptpGetReceived, NULL);
-	if (rc != RC_OK)
-		CB_ERR("Couldn't get \"system.ptp.state\", rc=%d", rc);
+	/*
+	 * The answer also carries the runtime state leaves the agent
+	 * itself updates, so only the configuration is hashed.
+	 * The NUL separates state and interface.
+	 */
+	hash = render_hash(RENDER_HASH_INIT, pending_ptp_state, strlen(pending_ptp_state) + 1);
+	hash = render_hash(hash, pending_ptp_interface, strlen(pending_ptp_interface));
+
+	if (!snapshot_unchanged(SNAPSHOT_PTP, hash)) {
+		set_ptp_state(pending_ptp_state, pending_ptp_interface);
+		snapshot_applied(SNAPSHOT_PTP, hash);
+	}
+
+	arena_free(ctx, "system.ptp");
+}
+
+/**
+ * Gets the PTP configuration.
+ *
+ * The interface leaf is optional, so the subtree is listed
+ * instead of getting the leaves.
+ */
+static void
+listSystemPtp(DMCONTEXT *dmCtx)
+{
+	uint32_t rc;
+
+	rc = rpc_db_list_async(dmCtx, 0, "system.ptp", ptpListReceived, NULL);
+	if (rc != RC_OK)
+		CB_ERR("Couldn't list \"system.ptp\", rc=%d", rc);
 }
 
 /** apply the values from system.dns.server list to the systemd configuration
@@ -350,21 +896,32 @@ struct dns_params {
 };
 
 static void
-dns_cb(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-       void *data, size_t size, void *cb_data)
+dns_add_string(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
 {
-	struct dns_params *info = (struct dns_params *)cb_data;
-	const char *s;
+	add_string_list(DECODE_FIELD(obj, node, struct string_list), data, size);
+}
 
-	if (!(s = strrchr(name, '.')))
-		return;
+static const struct decode_node dns_server_transport_schema[] = {
+	{ .name = "address", .set = dns_add_string, .offset = offsetof(struct dns_params, srvs) },
+	{ }
+};
 
-	if (strncmp(s + 1, "search", 6) == 0) {
-		add_string_list(&info->search, data, size);
-	} else if (strncmp(s + 1, "address", 7) == 0) {
-		add_string_list(&info->srvs, data, size);
-	}
-}
+static const struct decode_node dns_server_schema[] = {
+	{ .name = "udp-and-tcp", .children = dns_server_transport_schema },
+	{ }
+};
+
+static const struct decode_node dns_children_schema[] = {
+	{ .name = "search", .set = dns_add_string, .offset = offsetof(struct dns_params, search) },
+	{ .name = "server", .children = dns_server_schema },
+	{ }
+};
+
+/** system.dns-resolver */
+static const struct decode_node dns_schema[] = {
+	{ .name = "dns-resolver", .children = dns_children_schema },
+	{ }
+};
 
 static void
 dnsListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
@@ -372,6 +929,10 @@ dnsListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 {
 	uint32_t rc, answer_rc;
 	struct dns_params info;
+	uint64_t hash;
+	void *arena;
+	STATS_SCOPE(STATS_DNS_LIST);
+	APPLY_SCOPE(APPLY_DNS);
 
 	if (event != DMCONFIG_ANSWER_READY)
 	        CB_ERR("Couldn't list object, ev=%d.\n", event);
@@ -380,13 +941,23 @@ dnsListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	    || answer_rc != RC_OK)
 	        CB_ERR("Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
 
-	new_string_list(grp->ctx, &info.search);
-	new_string_list(grp->ctx, &info.srvs);
+	if (apply_superseded(APPLY_DNS) ||
+	    snapshot_unchanged(SNAPSHOT_DNS, (hash = answer_hash(grp))))
+		return;
+
+	if (!(arena = arena_new(NULL, grp)))
+		CB_ERR("Out of memory.\n");
 
-	while (decode_node_list(socket, "", grp, dns_cb, &info) == RC_OK) {
+	new_string_list(arena, &info.search);
+	new_string_list(arena, &info.srvs);
+
+	while (decode_node_list(dns_schema, grp, arena, &info) == RC_OK) {
 	}
 
 	set_dns(&info.search, &info.srvs);
+	snapshot_applied(SNAPSHOT_DNS, hash);
+
+	arena_free(arena, "system.dns-resolver");
 }
 
 static void
@@ -398,65 +969,67 @@ listSystemDns(DMCONTEXT *dmCtx)
 
 /***************************************/
 
-static void
-ssh_key(const char *name, void *data, size_t size, struct auth_ssh_key_list *list)
+static void *
+ssh_key_enter(void *ctx, void *obj, uint16_t id)
 {
-	if (strncmp(name, "name", 4) == 0) {
-		struct auth_ssh_key *d;
-
-		if (!(d = add_var_list((struct var_list *)list, sizeof(struct auth_ssh_key))))
-			return;
-
-		d->name = talloc_strndup(list->ctx, data, size);
-	} else if (strncmp(name, "algorithm", 9) == 0) {
-		list->ssh[list->count - 1].algo = talloc_strndup(list->ctx, data, size);
-	} else if (strncmp(name, "key-data", 8) == 0) {
-		list->ssh[list->count - 1].data = talloc_size(list->ctx, size * 2);
-		dm_to64(data, size, list->ssh[list->count - 1].data);
-	}
+	return add_var_list((struct var_list *)obj, sizeof(struct auth_ssh_key));
 }
 
 static void
-auth_cb(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-	void *data, size_t size, void *cb_data)
+ssh_key_set_data(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
 {
-	struct auth_list *info = (struct auth_list *)cb_data;
-	const char *s;
+	struct auth_ssh_key *key = (struct auth_ssh_key *)obj;
 
-	if (!(s = strchr(name + 1, '.')))
-		return;
-	if (!(s = strchr(s + 1, '.')))
-		return;
+	key->data = talloc_size(ctx, size * 2);
+	dm_to64(data, size, key->data);
+}
 
-	if (strncmp(s + 1, "name", 4) == 0) {
-		struct auth_user *d;
+static const struct decode_node ssh_key_schema[] = {
+	{ .name = "name", .set = decode_string, .offset = offsetof(struct auth_ssh_key, name) },
+	{ .name = "algorithm", .set = decode_string, .offset = offsetof(struct auth_ssh_key, algo) },
+	{ .name = "key-data", .set = ssh_key_set_data },
+	{ }
+};
 
-		logx(LOG_DEBUG, "user (%d): %*s", info->count, (int)size, (char *)data);
-		if (!(d = add_var_list((struct var_list *)info, sizeof(struct auth_user))))
-			return;
+static void *
+auth_user_enter(void *ctx, void *obj, uint16_t id)
+{
+	struct auth_list *info = (struct auth_list *)obj;
+	struct auth_user *d;
 
-		new_var_list(info->ctx, (struct var_list *)&d->ssh, sizeof(struct auth_ssh_key_list));
+	if (!(d = add_var_list((struct var_list *)info, sizeof(struct auth_user))))
+		return NULL;
 
-		d->name = talloc_strndup(info->ctx, data, size);
-	} else if (strncmp(s + 1, "password", 8) == 0) {
-		logx(LOG_DEBUG, "pass: %*s", (int)size, (char *)data);
-		info->user[info->count - 1].password = talloc_strndup(info->ctx, data, size);
-	} else {
-		if (strncmp(s + 1, "ssh-key.", 8) == 0) {
-			if (!(s = strchr(s + 10, '.')))
-				return;
+	new_var_list(info->ctx, (struct var_list *)&d->ssh, sizeof(struct auth_ssh_key_list));
 
-			ssh_key(s + 1, data, size, &info->user[info->count - 1].ssh);
-		}
-	}
+	return d;
 }
 
+static const struct decode_node auth_user_schema[] = {
+	{ .name = "name", .set = decode_string, .offset = offsetof(struct auth_user, name) },
+	{ .name = "password", .set = decode_string, .offset = offsetof(struct auth_user, password) },
+	{ .name = "ssh-key", .children = ssh_key_schema, .enter = ssh_key_enter,
+	  .offset = offsetof(struct auth_user, ssh), .entry_size = sizeof(struct auth_ssh_key) },
+	{ }
+};
+
+/** system.authentication.user */
+static const struct decode_node auth_schema[] = {
+	{ .name = "user", .children = auth_user_schema, .enter = auth_user_enter,
+	  .entry_size = sizeof(struct auth_user) },
+	{ }
+};
+
 static void
 AuthListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	         void *userdata __attribute__((unused)))
 {
 	uint32_t rc, answer_rc;
 	struct auth_list auth;
+	uint64_t hash;
+	void *arena;
+	STATS_SCOPE(STATS_AUTH_LIST);
+	APPLY_SCOPE(APPLY_AUTHENTICATION);
 
 	if (event != DMCONFIG_ANSWER_READY)
 	        CB_ERR("Couldn't list object, ev=%d.\n", event);
@@ -465,12 +1038,22 @@ AuthListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	    || answer_rc != RC_OK)
 	        CB_ERR("Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
 
-	new_var_list(grp->ctx, (struct var_list *)&auth, sizeof(struct auth_user));
+	if (apply_superseded(APPLY_AUTHENTICATION) ||
+	    snapshot_unchanged(SNAPSHOT_AUTHENTICATION, (hash = answer_hash(grp))))
+		return;
+
+	if (!(arena = arena_new(NULL, grp)))
+		CB_ERR("Out of memory.\n");
 
-	while (decode_node_list(socket, "", grp, auth_cb, &auth) == RC_OK) {
+	new_var_list(arena, (struct var_list *)&auth, sizeof(struct auth_user));
+
+	while (decode_node_list(auth_schema, grp, arena, &auth) == RC_OK) {
 	}
 
 	set_authentication(&auth);
+	snapshot_applied(SNAPSHOT_AUTHENTICATION, hash);
+
+	arena_free(arena, "system.authentication.user");
 }
 
 static void
@@ -490,220 +1073,386 @@ struct if_params {
 	struct string_list srvs;
 };
 
+/**
+ * Pending interface configuration request.
+ *
+ * interfaces.interface and dhcp.client.interfaces are listed back-to-back
+ * and the configuration is applied once both answers have been received.
+ */
+struct if_list_request {
+	struct interface_list info;
+	/** instance ids of interfaces with DHCP client */
+	struct var_list dhcp;
+
+	/** decoding arena, created from the first answer */
+	void *arena;
+
+	/** answer hashes, see answer_hash() */
+	uint64_t if_hash;
+	uint64_t dhcp_hash;
+
+	unsigned int pending;
+	bool failed;
+	/** generation of APPLY_INTERFACES the request belongs to */
+	unsigned int generation;
+};
+
+/**
+ * Returns the arena of an if_list_request, creating it if necessary.
+ */
+static void *
+if_list_arena(struct if_list_request *req, const DM2_AVPGRP *grp)
+{
+	if (!req->arena) {
+		/* the interface list dominates, so one answer is a good estimate */
+		if (!(req->arena = arena_new(req, grp)))
+			return NULL;
+		req->info.ctx = req->dhcp.ctx = req->arena;
+	}
+
+	return req->arena;
+}
+
 static void
-dhcp_client_cb(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-               void *data, size_t size, void *cb_data)
+dhcp_client_set_interface(void *ctx, void *obj, const struct decode_node *node,
+                          void *data, size_t size)
 {
-	struct interface_list *info = (struct interface_list *)cb_data;
-	const char *s;
+	static const char prefix[] = "interfaces.interface.";
+	struct var_list *dhcp = (struct var_list *)obj;
+	const char *p = data;
+	unsigned int instance_id = 0;
 
-	if (!(s = strchr(name + 1, '.')))
-		return;
-	if (!(s = strchr(s + 1, '.')))
+	/* the value is a path which is parsed in place */
+	if (size <= sizeof(prefix) - 1 || memcmp(p, prefix, sizeof(prefix) - 1) != 0)
 		return;
 
-	if (strncmp(s + 1, "interface", 9) == 0) {
-		char *interface = strndup(data, size);
-		unsigned int instance_id;
-
-		int rc = sscanf(interface, "interfaces.interface.%u", &instance_id);
-		free(interface);
-		if (rc != 1)
+	for (size_t i = sizeof(prefix) - 1; i < size; i++) {
+		if (!isdigit((unsigned char)p[i]) || instance_id > UINT16_MAX)
 			return;
-
-		for (int i = 0; i < info->count; i++) {
-			if (info->iface[i].instance_id == instance_id) {
-				info->iface[i].dhcp.enabled = true;
-				break;
-			}
-		}
+		instance_id = instance_id * 10 + (p[i] - '0');
 	}
+
+	unsigned int *id = add_var_list(dhcp, sizeof(unsigned int));
+	if (id)
+		*id = instance_id;
 }
 
-static void
-dhcpClientListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
+static const struct decode_node dhcp_client_interface_schema[] = {
+	{ .name = "interface", .set = dhcp_client_set_interface },
+	{ }
+};
+
+/** dhcp.client.interfaces */
+static const struct decode_node dhcp_client_schema[] = {
+	{ .name = "interfaces", .children = dhcp_client_interface_schema,
+	  .entry_size = sizeof(unsigned int) },
+	{ }
+};
+
+static int
+interface_id_cmp(struct interface *a, struct interface *b)
 {
-	struct interface_list *info = userdata;
-	uint32_t rc, answer_rc;
+	return (a->instance_id > b->instance_id) - (a->instance_id < b->instance_id);
+}
 
-	if (event != DMCONFIG_ANSWER_READY) {
-		talloc_free(info);
-		CB_ERR("Couldn't list object, ev=%d.\n", event);
-	}
+static int
+interface_name_cmp(struct interface *a, struct interface *b)
+{
+	return strcmp(a->name, b->name);
+}
+
+RB_GENERATE(interface_id_tree, interface, id_node, interface_id_cmp);
+RB_GENERATE(interface_name_tree, interface, name_node, interface_name_cmp);
+
+/**
+ * Index a completely decoded interface list by instance id and name.
+ *
+ * The list must not be extended afterwards, since the index refers
+ * to the list entries.
+ */
+void
+interface_list_index(struct interface_list *info)
+{
+	RB_INIT(&info->by_id);
+	RB_INIT(&info->by_name);
 
-	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK ||
-	    answer_rc != RC_OK) {
-		talloc_free(info);
-		CB_ERR("Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
+	for (int i = 0; i < info->count; i++) {
+		struct interface *iface = info->iface + i;
+
+		RB_INSERT(interface_id_tree, &info->by_id, iface);
+		if (iface->name && RB_INSERT(interface_name_tree, &info->by_name, iface))
+			logx(LOG_WARNING, "Duplicate interface name \"%s\"", iface->name);
 	}
+}
 
-	while (decode_node_list(socket, "", grp, dhcp_client_cb, info) == RC_OK);
+struct interface *
+interface_by_id(struct interface_list *info, unsigned int instance_id)
+{
+	struct interface key = { .instance_id = instance_id };
 
-	if (info->flags & IF_NEIGH)
-		set_if_neigh(info);
-	if (info->flags & IF_IP)
-		set_if_addr(info);
+	return RB_FIND(interface_id_tree, &info->by_id, &key);
+}
+
+struct interface *
+interface_by_name(struct interface_list *info, const char *name)
+{
+	struct interface key = { .name = (char *)name };
 
-	talloc_free(info);
+	return RB_FIND(interface_name_tree, &info->by_name, &key);
 }
 
+/**
+ * Applies the interface configuration once all answers of an
+ * if_list_request have been received.
+ */
 static void
-if_ip_addr(const char *name, void *data, size_t size, struct ip_list *list)
+if_list_done(struct if_list_request *req)
 {
-	const char *s;
+	struct interface_list *info = &req->info;
+	bool full = (info->flags & (IF_IP | IF_NEIGH)) == (IF_IP | IF_NEIGH);
+	uint64_t hash;
 
-	if (!(s = strchr(name + 1, '.')))
+	if (--req->pending)
 		return;
 
-	if (strncmp("ip", s + 1, 2) == 0) {
-		char b[INET6_ADDRSTRLEN];
-		int af;
-		struct in6_addr addr;
-		struct ipaddr *d;
-
-		if (!(d = add_var_list((struct var_list *)list, sizeof(struct ipaddr))))
-			return;
+	if (req->failed) {
+		talloc_free(req);
+		apply_done(APPLY_INTERFACES, req->generation);
+		return;
+	}
 
-		dm_get_address_avp(&af, &addr, sizeof(addr), data, size);
-		inet_ntop(af, &addr, b, sizeof(b));
-		d->af = af;
-		d->address = talloc_strdup(list->ctx, b);
-	} else if (size != 0 && strncmp("prefix-length", s + 1, 13) == 0) {
-		struct ipaddr *d = list->ip + list->count - 1;
-		d->value = talloc_asprintf(list->ctx, "%u", dm_get_uint32_avp(data));
+	/* the newer request must cover this one's flags as well */
+	if (apply_superseded(APPLY_INTERFACES)) {
+		apply_tasks[APPLY_INTERFACES].if_flags |= info->flags;
+		arena_free(req->arena, "interfaces.interface");
+		talloc_free(req);
+		apply_done(APPLY_INTERFACES, req->generation);
+		return;
 	}
-}
 
-static void
-if_ip_neigh(const char *name, void *data, size_t size, struct ip_list *list)
-{
-	const char *s;
+	hash = render_hash(RENDER_HASH_INIT, &req->if_hash, sizeof(req->if_hash));
+	hash = render_hash(hash, &req->dhcp_hash, sizeof(req->dhcp_hash));
 
-	if (!(s = strchr(name + 1, '.')))
+	/* partial updates are never skipped nor recorded */
+	if (full && snapshot_unchanged(SNAPSHOT_INTERFACES, hash)) {
+		arena_free(req->arena, "interfaces.interface");
+		talloc_free(req);
+		apply_done(APPLY_INTERFACES, req->generation);
 		return;
+	}
 
-	if (strncmp("ip", s + 1, 2) == 0) {
-		char b[INET6_ADDRSTRLEN];
-		int af;
-		struct in6_addr addr;
-		struct ipaddr *d;
+	interface_list_index(info);
 
-		if (!(d = add_var_list((struct var_list *)list, sizeof(struct ipaddr))))
-			return;
+	for (int i = 0; i < req->dhcp.count; i++) {
+		struct interface *iface;
+
+		if ((iface = interface_by_id(info, ((unsigned int *)req->dhcp.data)[i])))
+			iface->dhcp.enabled = true;
+	}
+
+	if (info->flags & IF_NEIGH)
+		set_if_neigh(info);
+	/* done once networkd has picked up the new configuration */
+	if (info->flags & IF_IP)
+		set_if_addr(info, apply_done_cb, apply_cb_data(APPLY_INTERFACES, req->generation));
+	else
+		apply_done(APPLY_INTERFACES, req->generation);
+	if (full)
+		snapshot_applied(SNAPSHOT_INTERFACES, hash);
+	else
+		snapshot_invalidate(SNAPSHOT_INTERFACES);
+
+	arena_free(req->arena, "interfaces.interface");
+	talloc_free(req);
+}
 
-		dm_get_address_avp(&af, &addr, sizeof(addr), data, size);
-		inet_ntop(af, &addr, b, sizeof(b));
-		d->address = talloc_strdup(list->ctx, b);
-	} else if (strncmp("link-layer-address", s + 1, 20) == 0) {
-		struct ipaddr *d = list->ip + list->count - 1;
+static void
+dhcpClientListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
+{
+	struct if_list_request *req = userdata;
+	uint32_t rc, answer_rc;
+	STATS_SCOPE(STATS_DHCP_LIST);
 
-		d->value = talloc_strndup(list->ctx, data, size);
+	if (event != DMCONFIG_ANSWER_READY) {
+		logx(LOG_ERR, "Couldn't list object, ev=%d.\n", event);
+		req->failed = true;
+	} else if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK ||
+	           answer_rc != RC_OK) {
+		logx(LOG_ERR, "Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
+		req->failed = true;
+	} else if (!if_list_arena(req, grp)) {
+		logx(LOG_ERR, "Out of memory.\n");
+		req->failed = true;
+	} else {
+		req->dhcp_hash = answer_hash(grp);
+		while (decode_node_list(dhcp_client_schema, grp, req->arena, &req->dhcp) == RC_OK);
 	}
+
+	if (req->failed)
+		stats_error();
+	if_list_done(req);
+}
+
+static void *
+ip_list_enter(void *ctx, void *obj, uint16_t id)
+{
+	return add_var_list((struct var_list *)obj, sizeof(struct ipaddr));
 }
 
 static void
-if_ip_gateway(void *data, size_t size, struct ip_list *list)
+ipaddr_set_address(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
 {
+	struct ipaddr *d = (struct ipaddr *)obj;
 	char b[INET6_ADDRSTRLEN];
 	struct in6_addr addr;
-	struct ipaddr *d;
-
-	if (!(d = add_var_list((struct var_list *)list, sizeof(struct ipaddr))))
-		return;
 
 	dm_get_address_avp(&d->af, &addr, sizeof(addr), data, size);
 	inet_ntop(d->af, &addr, b, sizeof(b));
-	d->address = talloc_strdup(list->ctx, b);
+	d->address = talloc_strdup(ctx, b);
 }
 
 static void
-if_ip(const char *name, void *data, size_t size, struct if_ip *if_ip)
+ipaddr_set_prefix_length(void *ctx, void *obj, const struct decode_node *node,
+                         void *data, size_t size)
 {
-	if (strncmp("enabled", name, 7) == 0) {
-		if_ip->enabled = dm_get_uint8_avp(data);
-	} else if (strncmp("forwarding", name, 9) == 0) {
-		if_ip->forwarding = dm_get_uint8_avp(data);
-	} else if (strncmp("mtu", name, 3) == 0) {
-		if_ip->mtu = dm_get_uint32_avp(data);
-	} else if (strncmp("address", name, 7) == 0) {
-		if_ip_addr(name + 8, data, size, &if_ip->addr);
-	} else if (strncmp("neighbor", name, 8) == 0) {
-		if_ip_neigh(name + 9, data, size, &if_ip->neigh);
-	} else if (strncmp("gateway-ip", name, 10) == 0) {
-		/*
-		 * NOTE: gateway-ip is a Metropolis extension.
-		 * It is an array of IPv4/v6 addresses.
-		 */
-		if_ip_gateway(data, size, &if_ip->gateway);
-	}
+	if (size != 0)
+		((struct ipaddr *)obj)->value = talloc_asprintf(ctx, "%u", dm_get_uint32_avp(data));
 }
 
 static void
-if_cb(DMCONTEXT *socket, const char *name, uint32_t code, uint32_t vendor_id,
-      void *data, size_t size, void *cb_data)
+if_ip_add_gateway(void *ctx, void *obj, const struct decode_node *node, void *data, size_t size)
 {
-	struct interface_list *info = (struct interface_list *)cb_data;
-	const char *s;
+	struct ipaddr *d;
 
-	if (!(s = strchr(name + 1, '.')))
-		return;
-	if (!(s = strchr(s + 1, '.')))
+	if (!(d = ip_list_enter(ctx, DECODE_FIELD(obj, node, struct ip_list), 0)))
 		return;
 
-	if (strncmp(s + 1, "name", 4) == 0) {
-		struct interface *d;
+	ipaddr_set_address(ctx, d, node, data, size);
+}
 
-		if (!(d = add_var_list((struct var_list *)info, sizeof(struct interface))))
-			return;
+static const struct decode_node if_ip_addr_schema[] = {
+	{ .name = "ip", .set = ipaddr_set_address },
+	{ .name = "prefix-length", .set = ipaddr_set_prefix_length },
+	{ }
+};
+
+static const struct decode_node if_ip_neigh_schema[] = {
+	{ .name = "ip", .set = ipaddr_set_address },
+	{ .name = "link-layer-address", .set = decode_string, .offset = offsetof(struct ipaddr, value) },
+	{ }
+};
 
-		new_var_list(info->ctx, (struct var_list *)&d->ipv4.addr, sizeof(struct ip_list));
-		new_var_list(info->ctx, (struct var_list *)&d->ipv4.neigh, sizeof(struct ip_list));
-		new_var_list(info->ctx, (struct var_list *)&d->ipv4.gateway, sizeof(struct ip_list));
-		new_var_list(info->ctx, (struct var_list *)&d->ipv6.addr, sizeof(struct ip_list));
-		new_var_list(info->ctx, (struct var_list *)&d->ipv6.neigh, sizeof(struct ip_list));
-		new_var_list(info->ctx, (struct var_list *)&d->ipv6.gateway, sizeof(struct ip_list));
+static const struct decode_node if_ip_schema[] = {
+	{ .name = "enabled", .set = decode_uint8, .offset = offsetof(struct if_ip, enabled) },
+	{ .name = "forwarding", .set = decode_uint8, .offset = offsetof(struct if_ip, forwarding) },
+	{ .name = "mtu", .set = decode_uint32, .offset = offsetof(struct if_ip, mtu) },
+	{ .name = "address", .children = if_ip_addr_schema, .enter = ip_list_enter,
+	  .offset = offsetof(struct if_ip, addr), .entry_size = sizeof(struct ipaddr) },
+	{ .name = "neighbor", .children = if_ip_neigh_schema, .enter = ip_list_enter,
+	  .offset = offsetof(struct if_ip, neigh), .entry_size = sizeof(struct ipaddr) },
+	/*
+	 * NOTE: gateway-ip is a Metropolis extension.
+	 * It is an array of IPv4/v6 addresses.
+	 */
+	{ .name = "gateway-ip", .set = if_ip_add_gateway, .offset = offsetof(struct if_ip, gateway) },
+	{ }
+};
 
-		d->name = talloc_strndup(info->ctx, data, size);
+static void *
+if_enter(void *ctx, void *obj, uint16_t id)
+{
+	struct interface_list *info = (struct interface_list *)obj;
+	struct interface *d;
 
-		sscanf(name, ".interface.%u", &d->instance_id);
-	} else if (strncmp(s + 1, "ipv4", 4) == 0) {
-		if_ip(s + 6, data, size, &info->iface[info->count - 1].ipv4);
-	} else if (strncmp(s + 1, "ipv6", 4) == 0) {
-		if_ip(s + 6, data, size, &info->iface[info->count - 1].ipv6);
-	}
+	if (!(d = add_var_list((struct var_list *)info, sizeof(struct interface))))
+		return NULL;
+
+	new_var_list(info->ctx, (struct var_list *)&d->ipv4.addr, sizeof(struct ip_list));
+	new_var_list(info->ctx, (struct var_list *)&d->ipv4.neigh, sizeof(struct ip_list));
+	new_var_list(info->ctx, (struct var_list *)&d->ipv4.gateway, sizeof(struct ip_list));
+	new_var_list(info->ctx, (struct var_list *)&d->ipv6.addr, sizeof(struct ip_list));
+	new_var_list(info->ctx, (struct var_list *)&d->ipv6.neigh, sizeof(struct ip_list));
+	new_var_list(info->ctx, (struct var_list *)&d->ipv6.gateway, sizeof(struct ip_list));
+
+	d->instance_id = id;
+
+	return d;
 }
 
+static const struct decode_node if_schema[] = {
+	{ .name = "name", .set = decode_string, .offset = offsetof(struct interface, name) },
+	{ .name = "ipv4", .children = if_ip_schema, .offset = offsetof(struct interface, ipv4) },
+	{ .name = "ipv6", .children = if_ip_schema, .offset = offsetof(struct interface, ipv6) },
+	{ }
+};
+
+/** interfaces.interface */
+static const struct decode_node if_list_schema[] = {
+	{ .name = "interface", .children = if_schema, .enter = if_enter,
+	  .entry_size = sizeof(struct interface) },
+	{ }
+};
+
 static void
 ifListReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
 {
+	struct if_list_request *req = userdata;
 	uint32_t rc, answer_rc;
+	STATS_SCOPE(STATS_IF_LIST);
 
-	if (event != DMCONFIG_ANSWER_READY)
-	        CB_ERR("Couldn't list object, ev=%d.\n", event);
-
-	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
-	    || answer_rc != RC_OK)
-	        CB_ERR("Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
-
-	struct interface_list *info = talloc(socket, struct interface_list);
-	new_var_list(socket, (struct var_list *)info, sizeof(struct interface));
-	info->flags = (unsigned int)(size_t)userdata;
-
-	while (decode_node_list(socket, "", grp, if_cb, info) == RC_OK);
-
-	if (rpc_db_list_async(socket, 0, "dhcp.client.interfaces",
-	                      dhcpClientListReceived, info)) {
-		talloc_free(info);
-		CB_ERR("Couldn't register LIST request.\n");
+	if (event != DMCONFIG_ANSWER_READY) {
+		logx(LOG_ERR, "Couldn't list object, ev=%d.\n", event);
+		req->failed = true;
+	} else if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
+	           || answer_rc != RC_OK) {
+		logx(LOG_ERR, "Couldn't list object, rc=%d,%d.\n", rc, answer_rc);
+		req->failed = true;
+	} else if (!if_list_arena(req, grp)) {
+		logx(LOG_ERR, "Out of memory.\n");
+		req->failed = true;
+	} else {
+		req->if_hash = answer_hash(grp);
+		while (decode_node_list(if_list_schema, grp, req->arena, &req->info) == RC_OK);
 	}
+
+	if (req->failed)
+		stats_error();
+	if_list_done(req);
 }
 
+/**
+ * Lists the interface configuration.
+ *
+ * The DHCP client configuration does not depend on the interface list,
+ * so both requests are sent without waiting for the first answer.
+ */
 static void
 listInterfaces(DMCONTEXT *dmCtx, unsigned int flags)
 {
-	if (rpc_db_list_async(dmCtx, 0, "interfaces.interface", ifListReceived,
-	                      (void *)(size_t)flags))
+	struct if_list_request *req;
+
+	if (!(req = talloc_zero(NULL, struct if_list_request)))
+		CB_ERR("Out of memory.\n");
+
+	/* the lists are allocated from the arena, see if_list_arena() */
+	new_var_list(NULL, (struct var_list *)&req->info, sizeof(struct interface));
+	new_var_list(NULL, &req->dhcp, sizeof(unsigned int));
+	req->info.flags = flags;
+	req->generation = apply_tasks[APPLY_INTERFACES].started;
+
+	if (rpc_db_list_async(dmCtx, 0, "interfaces.interface", ifListReceived, req)) {
+		talloc_free(req);
+	        CB_ERR("Couldn't register LIST request.\n");
+	}
+	req->pending++;
+
+	if (rpc_db_list_async(dmCtx, 0, "dhcp.client.interfaces",
+	                      dhcpClientListReceived, req)) {
+		/* the configuration is discarded when the interface list arrives */
+		req->failed = true;
 	        CB_ERR("Couldn't register LIST request.\n");
+	}
+	req->pending++;
 }
 
 static void
@@ -712,6 +1461,8 @@ autoIdGetReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 {
 	uint32_t rc, answer_rc;
 	uint8_t autoid_enabled;
+	uint64_t hash;
+	STATS_SCOPE(STATS_AUTOID_GET);
 
 	if (event != DMCONFIG_ANSWER_READY)
 	        CB_ERR("Couldn't get \"pulsarlr.autoid-enabled\", ev=%d.\n", event);
@@ -727,11 +1478,15 @@ autoIdGetReceived(DMCONTEXT *socket, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 		return;
 	}
 
+	if (snapshot_unchanged(SNAPSHOT_AUTOID, (hash = answer_hash(grp))))
+		return;
+
 	if ((rc = dm_expect_uint8_type(grp, AVP_BOOL, VP_TRAVELPING, &autoid_enabled)) != RC_OK ||
 	    (rc = dm_expect_group_end(grp)) != RC_OK)
 		CB_ERR("Couldn't decode GET request, rc=%d", rc);
 
 	set_autoid_enabled(autoid_enabled);
+	snapshot_applied(SNAPSHOT_AUTOID, hash);
 }
 
 static void
@@ -748,108 +1503,262 @@ listAutoId(DMCONTEXT *dmCtx)
 		CB_ERR("Couldn't get \"%s\", rc=%d", paths[0], rc);
 }
 
-static void
-sparkplugReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
-                  void *userdata __attribute__((unused)))
+struct sparkplug_server {
+	unsigned int id;
+	char *host;
+	uint32_t port;
+};
+
+struct sparkplug_params {
+	char *current_server;
+	char *username;
+	char *password;
+	/** struct sparkplug_server */
+	struct var_list servers;
+};
+
+static struct sparkplug_server *
+sparkplug_get_server(struct sparkplug_params *params, unsigned int id, bool create)
 {
-	uint32_t rc, answer_rc;
+	struct sparkplug_server *servers = params->servers.data;
+	struct sparkplug_server *server;
 
-	if (event != DMCONFIG_ANSWER_READY)
-	        CB_ERR("Couldn't get remaining Sparkplug parameters, ev=%d.\n", event);
+	for (int i = 0; i < params->servers.count; i++)
+		if (servers[i].id == id)
+			return servers + i;
 
-	/*
-	 * NOTE: We don't get here unless the previous GET was successful,
-	 * so we know we've got the necessary metropolis-sparkplug Yang module.
-	 */
-	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
-	    || answer_rc != RC_OK)
-		CB_ERR("Couldn't get remaining Sparkplug parameters, rc=%d,%d.\n",
-		       rc, answer_rc);
+	if (!create ||
+	    !(server = add_var_list(&params->servers, sizeof(struct sparkplug_server))))
+		return NULL;
+	server->id = id;
+
+	return server;
+}
+
+static void *
+sparkplug_server_enter(void *ctx, void *obj, uint16_t id)
+{
+	return sparkplug_get_server((struct sparkplug_params *)obj, id, true);
+}
 
-	char *host, *username, *password;
+static const struct decode_node sparkplug_server_schema[] = {
+	{ .name = "host", .set = decode_string, .offset = offsetof(struct sparkplug_server, host) },
 	/*
 	 * FIXME: sparkplug.server.X.port is currently AVP_UINT32.
 	 * This could change in the future.
 	 */
-	uint32_t port;
+	{ .name = "port", .set = decode_uint32, .offset = offsetof(struct sparkplug_server, port) },
+	{ }
+};
 
-	if ((rc = dm_expect_string_type(grp, AVP_STRING, VP_TRAVELPING, &host)) != RC_OK ||
-	    (rc = dm_expect_uint32_type(grp, AVP_UINT32, VP_TRAVELPING, &port)) != RC_OK ||
-	    (rc = dm_expect_string_type(grp, AVP_STRING, VP_TRAVELPING, &username)) != RC_OK ||
-	    (rc = dm_expect_string_type(grp, AVP_STRING, VP_TRAVELPING, &password)) != RC_OK ||
-	    (rc = dm_expect_group_end(grp)) != RC_OK)
-		CB_ERR("Couldn't decode GET request, rc=%d", rc);
+static const struct decode_node sparkplug_children_schema[] = {
+	{ .name = "current-server", .set = decode_string,
+	  .offset = offsetof(struct sparkplug_params, current_server) },
+	{ .name = "username", .set = decode_string, .offset = offsetof(struct sparkplug_params, username) },
+	{ .name = "password", .set = decode_string, .offset = offsetof(struct sparkplug_params, password) },
+	{ .name = "server", .children = sparkplug_server_schema, .enter = sparkplug_server_enter },
+	{ }
+};
+
+/** sparkplug */
+static const struct decode_node sparkplug_schema[] = {
+	{ .name = "sparkplug", .children = sparkplug_children_schema },
+	{ }
+};
+
+/**
+ * Local copy of the sparkplug subtree.
+ *
+ * It is filled by the LIST answer and kept current by active notifications,
+ * see sparkplug_cache_update(), so a change of the current server
+ * is resolved without another round-trip to mand.
+ */
+static struct {
+	/** talloc context of the cached parameters, NULL if the cache is invalid */
+	void *ctx;
+	struct sparkplug_params params;
+} sparkplug_cache;
 
-	set_mosquitto(host, port, username, password);
+static void
+sparkplug_cache_invalidate(void)
+{
+	talloc_free(sparkplug_cache.ctx);
+	memset(&sparkplug_cache, 0, sizeof(sparkplug_cache));
 }
 
 static void
-sparkplugCurrentServerReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
-                               void *userdata __attribute__((unused)))
+sparkplug_cache_set_string(char **field, const char *str)
 {
-	uint32_t rc, answer_rc;
+	talloc_free(*field);
+	*field = talloc_strdup(sparkplug_cache.ctx, str);
+}
 
-	if (event != DMCONFIG_ANSWER_READY)
-	        CB_ERR("Couldn't get \"sparkplug.current-server\", ev=%d.\n", event);
+/**
+ * Updates the cache from an active notification.
+ *
+ * Changes that cannot be tracked locally invalidate the cache,
+ * so the next apply lists the whole subtree again.
+ *
+ * @param type NOTIFY_* type of the notification.
+ * @param path Path below "sparkplug.".
+ * @param str The new value of changed parameters, NULL otherwise.
+ */
+static void
+sparkplug_cache_update(uint32_t type, const char *path, const char *str)
+{
+	struct sparkplug_params *params = &sparkplug_cache.params;
+	struct sparkplug_server *server;
+	unsigned int id;
+	int pos = 0;
 
-	/*
-	 * This depends on the metropolis-sparkplug Yang module,
-	 * which is not in every Metropolis build.
-	 * Therefore we handle errors gracefully.
-	 */
-	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
-	    || answer_rc != RC_OK) {
-	        logx(LOG_INFO, "Couldn't get \"sparkplug.current-server\", rc=%d,%d.\n",
-		     rc, answer_rc);
+	if (!sparkplug_cache.ctx)
 		return;
-	}
 
-	char *current_server;
+	if (sscanf(path, "server.%u%n", &id, &pos) == 1 && path[pos] == '\0') {
+		if (type != NOTIFY_INSTANCE_DELETED)
+			/* the new instance's parameters are not notified */
+			goto invalidate;
 
-	if ((rc = dm_expect_string_type(grp, AVP_PATH, VP_TRAVELPING, &current_server)) != RC_OK ||
-	    (rc = dm_expect_group_end(grp)) != RC_OK)
-		CB_ERR("Couldn't decode GET request, rc=%d", rc);
+		if ((server = sparkplug_get_server(params, id, false))) {
+			struct sparkplug_server *servers = params->servers.data;
+			struct sparkplug_server *last = servers + params->servers.count - 1;
+
+			talloc_free(server->host);
+			*server = *last;
+			params->servers.count--;
+		}
+		return;
+	}
 
-	char path_host[256], path_port[256];
-	strcat(strcpy(path_host, current_server), ".host");
-	strcat(strcpy(path_port, current_server), ".port");
+	if (type != NOTIFY_PARAMETER_CHANGED)
+		goto invalidate;
+
+	if (!strcmp(path, "current-server"))
+		sparkplug_cache_set_string(&params->current_server, str);
+	else if (!strcmp(path, "username"))
+		sparkplug_cache_set_string(&params->username, str);
+	else if (!strcmp(path, "password"))
+		sparkplug_cache_set_string(&params->password, str);
+	else if (sscanf(path, "server.%u.%n", &id, &pos) == 1 && pos) {
+		if (!(server = sparkplug_get_server(params, id, true)))
+			goto invalidate;
+
+		if (!strcmp(path + pos, "host"))
+			sparkplug_cache_set_string(&server->host, str);
+		else if (!strcmp(path + pos, "port"))
+			server->port = strtoul(str, NULL, 10);
+	}
+	/* other parameters are not consumed */
 
-	const char *paths[] = {
-		path_host, /* sparkplug.server.X.host */
-		path_port, /* sparkplug.server.X.port */
-		"sparkplug.username",
-		"sparkplug.password"
-	};
+	return;
 
-	rc = rpc_db_get_async(dmCtx, sizeof(paths)/sizeof(paths[0]), paths,
-	                      sparkplugReceived, NULL);
-	if (rc != RC_OK)
-		CB_ERR("Couldn't get remaining Sparkplug parameters, rc=%d", rc);
+ invalidate:
+	logx(LOG_DEBUG, "Sparkplug cache invalidated by \"sparkplug.%s\"", path);
+	sparkplug_cache_invalidate();
 }
 
-static void
-listSparkplug(DMCONTEXT *dmCtx)
+/**
+ * Configures the MQTT bridge to the current Sparkplug server.
+ *
+ * @returns true on success, false if the current server is invalid.
+ */
+static bool
+sparkplug_apply(struct sparkplug_params *params)
 {
-	static const char *paths[] = {
-		"sparkplug.current-server"
-	};
+	struct sparkplug_server *server;
+	unsigned int id;
 
-	uint32_t rc;
+	/*
+	 * The current server is a reference to one of the
+	 * sparkplug.server instances, which are part of the same list.
+	 */
+	if (!params->current_server ||
+	    sscanf(params->current_server, "sparkplug.server.%u", &id) != 1 ||
+	    !(server = sparkplug_get_server(params, id, false)) ||
+	    !server->host) {
+		logx(LOG_ERR, "Invalid Sparkplug server \"%s\"",
+		     params->current_server ? : "");
+		return false;
+	}
 
-	rc = rpc_db_get_async(dmCtx, sizeof(paths)/sizeof(paths[0]), paths,
-	                      sparkplugCurrentServerReceived, NULL);
-	if (rc != RC_OK)
-		CB_ERR("Couldn't get \"%s\", rc=%d", paths[0], rc);
+	set_mosquitto(server->host, server->port, params->username, params->password);
+	return true;
 }
 
 static void
-wwanReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
-             void *userdata __attribute__((unused)))
+sparkplugListReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
+                      void *userdata __attribute__((unused)))
 {
 	uint32_t rc, answer_rc;
+	uint64_t hash;
+	STATS_SCOPE(STATS_SPARKPLUG_LIST);
+	APPLY_SCOPE(APPLY_SPARKPLUG);
 
 	if (event != DMCONFIG_ANSWER_READY)
-	        CB_ERR("Couldn't get WWAN parameters, ev=%d.\n", event);
+	        CB_ERR("Couldn't list \"sparkplug\", ev=%d.\n", event);
+
+	/*
+	 * This depends on the metropolis-sparkplug Yang module,
+	 * which is not in every Metropolis build.
+	 * Therefore we handle errors gracefully.
+	 */
+	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
+	    || answer_rc != RC_OK) {
+	        logx(LOG_INFO, "Couldn't list \"sparkplug\", rc=%d,%d.\n",
+		     rc, answer_rc);
+		return;
+	}
+
+	if (apply_superseded(APPLY_SPARKPLUG))
+		return;
+	hash = answer_hash(grp);
+
+	/*
+	 * The cache lives on beyond this cycle, so it is not
+	 * allocated from an arena.
+	 */
+	sparkplug_cache_invalidate();
+	if (!(sparkplug_cache.ctx = talloc_named_const(NULL, 0, "sparkplug")))
+		CB_ERR("Out of memory.\n");
+	new_var_list(sparkplug_cache.ctx, &sparkplug_cache.params.servers,
+	             sizeof(struct sparkplug_server));
+
+	while (decode_node_list(sparkplug_schema, grp, sparkplug_cache.ctx,
+	                        &sparkplug_cache.params) == RC_OK);
+
+	if (snapshot_unchanged(SNAPSHOT_SPARKPLUG, hash))
+		return;
+
+	if (sparkplug_apply(&sparkplug_cache.params))
+		snapshot_applied(SNAPSHOT_SPARKPLUG, hash);
+}
+
+/**
+ * Gets the Sparkplug configuration.
+ *
+ * The whole subtree is listed at once, so the current server's
+ * parameters do not have to be requested in a second round-trip.
+ */
+static void
+listSparkplug(DMCONTEXT *dmCtx)
+{
+	uint32_t rc;
+
+	rc = rpc_db_list_async(dmCtx, 0, "sparkplug", sparkplugListReceived, NULL);
+	if (rc != RC_OK)
+		CB_ERR("Couldn't list \"sparkplug\", rc=%d", rc);
+}
+
+static void
+wwanReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
+             void *userdata __attribute__((unused)))
+{
+	uint32_t rc, answer_rc;
+	STATS_SCOPE(STATS_WWAN_GET);
+	APPLY_SCOPE(APPLY_WWAN);
+
+	if (event != DMCONFIG_ANSWER_READY)
+	        CB_ERR("Couldn't get WWAN parameters, ev=%d.\n", event);
 
 	/*
 	 * NOTE: We don't get here unless the previous GET was successful,
@@ -860,6 +1769,11 @@ wwanReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 		CB_ERR("Couldn't get WWAN parameters, rc=%d,%d.\n",
 		       rc, answer_rc);
 
+	uint64_t hash = answer_hash(grp);
+
+	if (apply_superseded(APPLY_WWAN) || snapshot_unchanged(SNAPSHOT_WWAN, hash))
+		return;
+
 	uint8_t enabled;
 	char *apn, *pin, *mode, *lte_mode;
 	DM2_AVPGRP lte_bands_grp;
@@ -887,10 +1801,14 @@ wwanReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	if (i == sizeof(lte_bands)-1)
 	        logx(LOG_ERR, "Too many WWAN bands specified");
 
-	if (enabled)
-		set_wwan(apn, pin, mode, lte_mode, lte_bands);
-	else if (system("systemctl stop metropolis-wwan") < 0)
-		logx(LOG_ERR, "Cannot disable WWAN connection");
+	/* the hash is recorded once the chat script has been committed */
+	if (enabled) {
+		set_wwan(apn, pin, mode, lte_mode, lte_bands, hash,
+		         apply_done_cb, apply_scope_defer(&apply_scope));
+	} else {
+		stop_wwan();
+		snapshot_applied(SNAPSHOT_WWAN, hash);
+	}
 }
 
 static void
@@ -918,6 +1836,8 @@ wifiReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
              void *userdata __attribute__((unused)))
 {
 	uint32_t rc, answer_rc;
+	STATS_SCOPE(STATS_WIFI_GET);
+	APPLY_SCOPE(APPLY_WIFI);
 
 	if (event != DMCONFIG_ANSWER_READY)
 	        CB_ERR("Couldn't get Wi-Fi parameters, ev=%d.\n", event);
@@ -931,6 +1851,11 @@ wifiReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 		CB_ERR("Couldn't get Wi-Fi parameters, rc=%d,%d.\n",
 		       rc, answer_rc);
 
+	uint64_t hash = answer_hash(grp);
+
+	if (apply_superseded(APPLY_WIFI) || snapshot_unchanged(SNAPSHOT_WIFI, hash))
+		return;
+
 	uint8_t enabled;
 	char *ssid, *password, *security, *country;
 
@@ -941,10 +1866,14 @@ wifiReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
 	    (rc = dm_expect_string_type(grp, AVP_STRING, VP_TRAVELPING, &country)) != RC_OK)
 		CB_ERR("Couldn't decode GET request, rc=%d", rc);
 
-	if (enabled)
-		set_wifi(ssid, password, security, country);
-	else if (system("systemctl stop metropolis-wifi") < 0)
-		logx(LOG_ERR, "Cannot disable Wi-Fi connection");
+	/* the hash is recorded once wpa_supplicant.conf has been committed */
+	if (enabled) {
+		set_wifi(ssid, password, security, country, hash,
+		         apply_done_cb, apply_scope_defer(&apply_scope));
+	} else {
+		stop_wifi();
+		snapshot_applied(SNAPSHOT_WIFI, hash);
+	}
 }
 
 static void
@@ -966,6 +1895,57 @@ listWifi(DMCONTEXT *dmCtx)
 		CB_ERR("Couldn't get Wi-Fi parameters, rc=%d", rc);
 }
 
+/**
+ * Lists a queued subsystem, see apply_schedule().
+ */
+static void
+apply_start(DMCONTEXT *dmCtx, enum apply_subsystem subsystem)
+{
+	struct apply_task *task = apply_tasks + subsystem;
+
+	task->queued = false;
+	task->running = true;
+	task->started = task->generation;
+
+	logx(LOG_DEBUG, "%s: applying generation %u", task->name, task->started);
+
+	switch (subsystem) {
+	case APPLY_NTP:
+		listSystemNtp(dmCtx);
+		break;
+	case APPLY_DNS:
+		listSystemDns(dmCtx);
+		break;
+	case APPLY_AUTHENTICATION:
+		listAuthentication(dmCtx);
+		break;
+	case APPLY_INTERFACES:
+		listInterfaces(dmCtx, task->if_flags);
+		task->if_flags = 0;
+		break;
+	case APPLY_SPARKPLUG:
+		if (!sparkplug_cache.ctx) {
+			listSparkplug(dmCtx);
+			break;
+		}
+
+		/* the cache is current, see sparkplug_cache_update() */
+		sparkplug_apply(&sparkplug_cache.params);
+		snapshot_invalidate(SNAPSHOT_SPARKPLUG);
+		task->running = false;
+		break;
+	case APPLY_WWAN:
+		listWWAN(dmCtx);
+		break;
+	case APPLY_WIFI:
+		listWifi(dmCtx);
+		break;
+	default:
+		task->running = false;
+		break;
+	}
+}
+
 static void
 request_cb(DMCONTEXT *socket, DM_PACKET *pkt, DM2_AVPGRP *grp, void *userdata)
 {
@@ -983,9 +1963,7 @@ request_cb(DMCONTEXT *socket, DM_PACKET *pkt, DM2_AVPGRP *grp, void *userdata)
 #endif
 
 	if ((rpc_dmclient_switch(socket, &req, grp, &answer)) == RC_ERR_ALLOC) {
-		dm_context_shutdown(socket, DMCONFIG_OK);
-		dm_context_release(socket);
-		ev_break(socket->ev, EVBREAK_ALL);
+		connection_lost(socket, true);
 		return;
 	}
 
@@ -993,24 +1971,267 @@ request_cb(DMCONTEXT *socket, DM_PACKET *pkt, DM2_AVPGRP *grp, void *userdata)
 		dm_enqueue(socket, answer, REPLY, NULL, NULL);
 }
 
+/**
+ * Applies everything that was marked dirty by active notifications
+ * since the debounce window was opened.
+ *
+ * Each subsystem is re-read (or applied) at most once per window, no matter
+ * how many of its parameters changed.
+ */
+static void
+notify_debounce_cb(EV_P_ ev_timer *w, int revents __attribute__((unused)))
+{
+	DMCONTEXT *dmCtx = (DMCONTEXT *) w->data;
+	unsigned int dirty = notify_dirty;
+
+	notify_dirty = 0;
+	logx(LOG_DEBUG, "Applying debounced notifications, dirty=%#x", dirty);
+
+	/* single parameters are applied without their answer hash */
+	if (dirty & DIRTY_PTP) {
+		set_ptp_state(pending_ptp_state, pending_ptp_interface);
+		snapshot_invalidate(SNAPSHOT_PTP);
+	}
+	if (dirty & DIRTY_AUTOID) {
+		set_autoid_enabled(pending_autoid_enabled);
+		snapshot_invalidate(SNAPSHOT_AUTOID);
+	}
+
+	/* resolved from the local cache unless it was invalidated */
+	if (dirty & DIRTY_SPARKPLUG)
+		apply_schedule(dmCtx, APPLY_SPARKPLUG, 0);
+	if (dirty & DIRTY_WWAN)
+		apply_schedule(dmCtx, APPLY_WWAN, 0);
+	if (dirty & DIRTY_WIFI)
+		apply_schedule(dmCtx, APPLY_WIFI, 0);
+}
+
+/**
+ * Marks subsystems dirty and opens the debounce window if necessary.
+ *
+ * The window is not extended by later notifications, so a continuous
+ * stream of changes is still applied every notify_debounce seconds.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @param dirty Bitmask of DIRTY_* flags.
+ */
+static void
+notify_mark_dirty(DMCONTEXT *dmCtx, unsigned int dirty)
+{
+	if (!dirty)
+		return;
+
+	notify_dirty |= dirty;
+
+	if (ev_is_active(&notify_debounce_timer))
+		return;
+
+	ev_timer_set(&notify_debounce_timer, notify_debounce, 0.);
+	notify_debounce_timer.data = dmCtx;
+	ev_timer_start(dmCtx->ev, &notify_debounce_timer);
+}
+
+/**
+ * Consumes the value of a notified parameter.
+ *
+ * @param notify NOTIFY_* type of the notification.
+ * @param path The notified path.
+ * @param value The decoded value of changed parameters, NULL otherwise.
+ */
+typedef void (*NOTIFY_CONSUME)(uint32_t notify, const char *path, const char *value);
+
+static void
+notify_ptp_state(uint32_t notify, const char *path, const char *value)
+{
+	if (value)
+		strncpy(pending_ptp_state, value, sizeof(pending_ptp_state) - 1);
+}
+
+static void
+notify_ptp_interface(uint32_t notify, const char *path, const char *value)
+{
+	if (value)
+		set_pending_ptp_interface(value);
+}
+
+static void
+notify_autoid_enabled(uint32_t notify, const char *path, const char *value)
+{
+	if (value)
+		pending_autoid_enabled = strcmp(value, "true") == 0;
+}
+
+static void
+notify_sparkplug(uint32_t notify, const char *path, const char *value)
+{
+	sparkplug_cache_update(notify, path + strlen("sparkplug."), value);
+}
+
+static void
+notify_set_value(uint32_t notify, const char *path, const char *value)
+{
+	if (value)
+		set_value((char *)path, value);
+}
+
+/**
+ * Parameters the agent consumes active notifications of.
+ *
+ * Only these paths are registered with mand, so changes of
+ * other parameters in the same subtrees are never sent.
+ */
+static const struct notify_leaf {
+	const char *path;
+	/**
+	 * Optional Yang module providing the path, NULL for the base profile.
+	 * The paths of each module are registered by one request,
+	 * so they must be adjacent.
+	 */
+	const char *module;
+	/** the path is a table, whose instances are registered recursively */
+	bool table;
+	/**
+	 * Older revisions of the module lack the path, so it is registered
+	 * by its own request and cannot fail the module's other paths.
+	 */
+	bool optional;
+	/** DIRTY_* flags of the consumer */
+	unsigned int dirty;
+	/** the value is a credential and must not be logged */
+	bool secret;
+	/** consumes the value, NULL if marking the subsystem dirty is sufficient */
+	NOTIFY_CONSUME consume;
+} notify_leaves[] = {
+	{ "system.hostname",                NULL, .consume = notify_set_value },
+	{ "system.clock.timezone-location", NULL, .consume = notify_set_value },
+
+	/* NOTE: PTP does not have its own action table. */
+	{ "system.ptp.state", "metropolis-ptp", .dirty = DIRTY_PTP, .consume = notify_ptp_state },
+	{ "system.ptp.interface", "metropolis-ptp", .optional = true,
+	  .dirty = DIRTY_PTP, .consume = notify_ptp_interface },
+
+	{ "pulsarlr.autoid-enabled", "metropolis-pulsarlr",
+	  .dirty = DIRTY_AUTOID, .consume = notify_autoid_enabled },
+
+	{ "sparkplug.current-server", "metropolis-sparkplug",
+	  .dirty = DIRTY_SPARKPLUG, .consume = notify_sparkplug },
+	{ "sparkplug.username", "metropolis-sparkplug",
+	  .dirty = DIRTY_SPARKPLUG, .consume = notify_sparkplug },
+	{ "sparkplug.password", "metropolis-sparkplug", .secret = true,
+	  .dirty = DIRTY_SPARKPLUG, .consume = notify_sparkplug },
+	{ "sparkplug.server", "metropolis-sparkplug", .table = true,
+	  .dirty = DIRTY_SPARKPLUG, .consume = notify_sparkplug },
+
+	{ "wwan.enabled",   "metropolis-wwan", .dirty = DIRTY_WWAN },
+	{ "wwan.apn",       "metropolis-wwan", .dirty = DIRTY_WWAN },
+	{ "wwan.pin",       "metropolis-wwan", .dirty = DIRTY_WWAN, .secret = true },
+	{ "wwan.mode",      "metropolis-wwan", .dirty = DIRTY_WWAN },
+	{ "wwan.lte.mode",  "metropolis-wwan", .dirty = DIRTY_WWAN },
+	{ "wwan.lte.band",  "metropolis-wwan", .dirty = DIRTY_WWAN },
+
+	{ "wifi.enabled",   "metropolis-wifi", .dirty = DIRTY_WIFI },
+	{ "wifi.ssid",      "metropolis-wifi", .dirty = DIRTY_WIFI },
+	{ "wifi.password",  "metropolis-wifi", .dirty = DIRTY_WIFI, .secret = true },
+	{ "wifi.security",  "metropolis-wifi", .dirty = DIRTY_WIFI },
+	{ "wifi.country",   "metropolis-wifi", .dirty = DIRTY_WIFI }
+};
+
+#define NOTIFY_LEAVES (sizeof(notify_leaves)/sizeof(notify_leaves[0]))
+
+/** notify_leaves sorted by path, see notify_index_init() */
+static const struct notify_leaf *notify_index[NOTIFY_LEAVES];
+
+static int
+notify_index_cmp(const void *a, const void *b)
+{
+	return strcmp((*(const struct notify_leaf **)a)->path,
+	              (*(const struct notify_leaf **)b)->path);
+}
+
+static void
+notify_index_init(void)
+{
+	for (size_t i = 0; i < NOTIFY_LEAVES; i++)
+		notify_index[i] = notify_leaves + i;
+	qsort(notify_index, NOTIFY_LEAVES, sizeof(notify_index[0]), notify_index_cmp);
+}
+
+/**
+ * Looks up the first @p len characters of @p path in the index.
+ */
+static const struct notify_leaf *
+notify_index_find(const char *path, size_t len)
+{
+	size_t lo = 0, hi = NOTIFY_LEAVES;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		const char *p = notify_index[mid]->path;
+		int cmp = strncmp(p, path, len);
+
+		if (cmp == 0 && p[len] != '\0')
+			cmp = 1;
+		if (cmp == 0)
+			return notify_index[mid];
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+/**
+ * Finds the consumer of a notified path.
+ *
+ * Paths below a table, including its instances, belong to the table.
+ *
+ * @returns The consumer or NULL if the path is not consumed.
+ */
+static const struct notify_leaf *
+notify_lookup(const char *path)
+{
+	const struct notify_leaf *leaf;
+	size_t len = strlen(path);
+
+	if ((leaf = notify_index_find(path, len)))
+		return leaf;
+
+	while (len > 0) {
+		while (len > 0 && path[--len] != '.');
+		if (len > 0 && (leaf = notify_index_find(path, len)) && leaf->table)
+			return leaf;
+	}
+
+	return NULL;
+}
+
 uint32_t rpc_client_active_notify(void *ctx, DM2_AVPGRP *obj)
 {
 	uint32_t rc;
-	bool sparkplug_changed = false;
-	bool wwan_changed = false;
-	bool wifi_changed = false;
+	unsigned int dirty = 0;
+	STATS_SCOPE(STATS_ACTIVE_NOTIFY);
 
 	do {
 		DM2_AVPGRP grp;
-		uint32_t type;
+		uint32_t notify, type;
 		char *path;
+		char *value = NULL;
+		const struct notify_leaf *leaf;
 
 		if ((rc = dm_expect_object(obj, &grp)) != RC_OK
-		    || (rc = dm_expect_uint32_type(&grp, AVP_NOTIFY_TYPE, VP_TRAVELPING, &type)) != RC_OK
+		    || (rc = dm_expect_uint32_type(&grp, AVP_NOTIFY_TYPE, VP_TRAVELPING, &notify)) != RC_OK
 		    || (rc = dm_expect_string_type(&grp, AVP_PATH, VP_TRAVELPING, &path)) != RC_OK)
 	                CB_ERR_RET(rc, "Couldn't decode active notifications, rc=%d\n", rc);
 
-		switch (type) {
+		if (!(leaf = notify_lookup(path))) {
+			logx(LOG_DEBUG, "Notification: \"%s\" is not consumed\n", path);
+			continue;
+		}
+
+		switch (notify) {
 		case NOTIFY_INSTANCE_CREATED:
 	                logx(LOG_DEBUG, "Notification: Instance \"%s\" created\n", path);
 			break;
@@ -1021,43 +2242,33 @@ uint32_t rpc_client_active_notify(void *ctx, DM2_AVPGRP *obj)
 
 		case NOTIFY_PARAMETER_CHANGED: {
 			struct dm2_avp avp;
-			char *str;
 
+			if (!leaf->consume) {
+				logx(LOG_DEBUG, "Notification: Parameter \"%s\" changed\n", path);
+				break;
+			}
+
+			/* only values that are consumed are decoded */
 			if ((rc = dm_expect_uint32_type(&grp, AVP_TYPE, VP_TRAVELPING, &type)) != RC_OK
 			    || (rc = dm_expect_value(&grp, &avp)) != RC_OK
-			    || (rc = dm_decode_unknown_as_string(type, avp.data, avp.size, &str)) != RC_OK)
+			    || (rc = dm_decode_unknown_as_string(type, avp.data, avp.size, &value)) != RC_OK)
 				CB_ERR_RET(rc, "Couldn't decode parameter changed notifications, rc=%d\n", rc);
 
-	                logx(LOG_DEBUG, "Notification: Parameter \"%s\" changed to \"%s\"\n", path, str);
-			if (!strcmp(path, "system.ptp.state"))
-				set_ptp_state(str);
-			else if (!strcmp(path, "pulsarlr.autoid-enabled"))
-				set_autoid_enabled(strcmp(str, "true") == 0);
-			else
-				set_value(path, str);
-
+	                logx(LOG_DEBUG, "Notification: Parameter \"%s\" changed to \"%s\"\n", path,
+			     leaf->secret ? "********" : value);
 			break;
 	        }
 		default:
-	                logx(LOG_DEBUG, "Notification: Warning, unknown type: %d\n", type);
+	                logx(LOG_DEBUG, "Notification: Warning, unknown type: %d\n", notify);
 			break;
 		}
 
-		sparkplug_changed |= strncmp(path, "sparkplug.", 10) == 0;
-		wwan_changed |= strncmp(path, "wwan.", 5) == 0;
-		wifi_changed |= strncmp(path, "wifi.", 5) == 0;
+		if (leaf->consume)
+			leaf->consume(notify, path, value);
+		dirty |= leaf->dirty;
 	} while ((rc = dm_expect_end(obj)) != RC_OK);
 
-	/*
-	 * For simplicity, we don't try to parse the notification payload for
-	 * sparkplug.* parameters.
-	 */
-	if (sparkplug_changed)
-		listSparkplug(ctx);
-	if (wwan_changed)
-		listWWAN(ctx);
-	if (wifi_changed)
-		listWifi(ctx);
+	notify_mark_dirty(ctx, dirty);
 
 	return dm_expect_end(obj);
 }
@@ -1069,32 +2280,21 @@ uint32_t rpc_client_active_notify(void *ctx, DM2_AVPGRP *obj)
  */
 uint32_t rpc_client_event_broadcast(void *ctx, const char *path, uint32_t type)
 {
+	STATS_SCOPE(STATS_EVENT_BROADCAST);
+
 	logx(LOG_DEBUG, "Event: %d on \"%s\"", type, path);
 
 	if (strncmp(path, "system.ntp", 10) == 0)
-		listSystemNtp(ctx);
+		apply_schedule(ctx, APPLY_NTP, 0);
 	else if (strncmp(path, "system.dns-resolver", 19) == 0)
-		listSystemDns(ctx);
+		apply_schedule(ctx, APPLY_DNS, 0);
 	else if (strncmp(path, "system.authentication", 21) == 0)
-		listAuthentication(ctx);
+		apply_schedule(ctx, APPLY_AUTHENTICATION, 0);
 	else if (strncmp(path, "interfaces", 10) == 0)
-		listInterfaces(ctx, IF_IP | IF_NEIGH);
+		apply_schedule(ctx, APPLY_INTERFACES, IF_IP | IF_NEIGH);
 	else if (strncmp(path, "dhcp.client", 11) == 0)
-		listInterfaces(ctx, IF_IP);
-
-	return RC_OK;
-}
+		apply_schedule(ctx, APPLY_INTERFACES, IF_IP);
 
-static uint32_t if_ioctl(int d, int request, void *data)
-{
-	int result;
-
-	if (ioctl(d, request, data) == -1) {
-		do {
-			result = close(d);
-		} while (result == -1 && errno == EINTR);
-		return RC_ERR_MISC;
-	}
 	return RC_OK;
 }
 
@@ -1157,387 +2357,1006 @@ add_addr_to_answer(struct nl_object *obj, void *data)
 		return;
 }
 
-uint32_t rpc_client_get_interface_state(void *ctx, const char *if_name, DM2_REQUEST *answer)
+/**
+ * Control socket for interface ioctls, see init_comm().
+ */
+static int ctrl_sock = -1;
+
+/**
+ * Cached link speed of an interface.
+ *
+ * Entries are invalidated on link changes, see link_speed_invalidate().
+ */
+struct link_speed {
+	LIST_ENTRY(link_speed) entry;
+	int ifindex;
+	uint32_t speed;
+};
+
+static LIST_HEAD(, link_speed) link_speeds = LIST_HEAD_INITIALIZER(link_speeds);
+
+/**
+ * Drop cached link speeds.
+ *
+ * @param ifindex Interface index or 0 for all interfaces.
+ */
+static void
+link_speed_invalidate(int ifindex)
 {
-	int fd;
-	FILE *fp;
-	char line[1024];
-	struct ifreq ifr;
-	struct ethtool_cmd cmd;
-	uint32_t rc;
-	const char *dev;
+	struct link_speed *ls, *next;
 
-	uint64_t rec_pkt = 0, rec_oct = 0, rec_err = 0, rec_drop = 0;
-	uint64_t snd_pkt = 0, snd_oct = 0, snd_err = 0, snd_drop = 0;
-	int scan_count;
+	for (ls = LIST_FIRST(&link_speeds); ls; ls = next) {
+		next = LIST_NEXT(ls, entry);
 
-	logx(LOG_DEBUG, "rpc_client_get_interface_state: %s", if_name);
+		if (ifindex && ls->ifindex != ifindex)
+			continue;
 
-	dev = if_name;
+		LIST_REMOVE(ls, entry);
+		free(ls);
+	}
+}
 
-	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-	if (fd == -1)
-		return RC_ERR_MISC;
+/**
+ * Query the link speed in Mbit/s via ethtool.
+ *
+ * ETHTOOL_GLINKSETTINGS requires a handshake: the kernel answers
+ * the first request with the negated number of link mode mask words
+ * it expects. ETHTOOL_GSET is used on kernels older than 4.6.
+ *
+ * @param dev Interface name.
+ * @returns The speed or 0 if it cannot be determined.
+ */
+static uint32_t
+query_link_speed(const char *dev)
+{
+	struct ifreq ifr;
+	struct {
+		struct ethtool_link_settings req;
+		uint32_t link_mode_data[3 * SCHAR_MAX];
+	} ecmd;
+	struct ethtool_cmd cmd;
+
+	if (ctrl_sock < 0)
+		return 0;
 
 	strncpy(ifr.ifr_name, dev, IFNAMSIZ-1);
 	ifr.ifr_name[IFNAMSIZ-1] = '\0';
 
-	if ((rc = if_ioctl(fd, SIOCGIFINDEX, &ifr)) != RC_OK)
-		return rc;
-	if (ifr.ifr_ifindex == 0)
-		ifr.ifr_ifindex = 2147483647;
-	if ((rc = dm_add_int32(answer, AVP_INT32, VP_TRAVELPING, ifr.ifr_ifindex)) != RC_OK)
-		return rc;
+	memset(&ecmd, 0, sizeof(ecmd));
+	ecmd.req.cmd = ETHTOOL_GLINKSETTINGS;
+	ifr.ifr_data = (void *)&ecmd;
+	if (ioctl(ctrl_sock, SIOCETHTOOL, &ifr) == 0) {
+		if (ecmd.req.link_mode_masks_nwords >= 0)
+			return 0;
 
-	if ((rc = if_ioctl(fd, SIOCGIFFLAGS, &ifr)) != RC_OK
-	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, ifr.ifr_flags)) != RC_OK)
-		return rc;
+		ecmd.req.cmd = ETHTOOL_GLINKSETTINGS;
+		ecmd.req.link_mode_masks_nwords = -ecmd.req.link_mode_masks_nwords;
+		if (ioctl(ctrl_sock, SIOCETHTOOL, &ifr) == -1 ||
+		    ecmd.req.link_mode_masks_nwords <= 0)
+			return 0;
 
-	if ((rc = if_ioctl(fd, SIOCGIFHWADDR, &ifr)) != RC_OK
-	    || (rc = dm_add_raw(answer, AVP_BINARY, VP_TRAVELPING, &ifr.ifr_hwaddr, 6)) != RC_OK)
-	    return rc;
+		return ecmd.req.speed;
+	} else if (errno != EOPNOTSUPP)
+		return 0;
 
 	ifr.ifr_data = (void *)&cmd;
 	cmd.cmd = ETHTOOL_GSET; /* "Get settings" */
-	if ((rc = if_ioctl(fd, SIOCETHTOOL, &ifr)) != RC_OK) {
-		if ((rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, 0)) != RC_OK)
-			return rc;
-	} else
-		if ((rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, ethtool_cmd_speed(&cmd))) != RC_OK)
-			return rc;
-
-	if (!(fp = fopen("/proc/net/dev", "r")))
-		return RC_ERR_MISC;
+	if (ioctl(ctrl_sock, SIOCETHTOOL, &ifr) == -1)
+		return 0;
 
-	if (!fgets(line, sizeof(line), fp)) /* ignore first line */
-		logx(LOG_ERR, "Cannot parse /proc/net/dev");
-	if (!fgets(line, sizeof(line), fp))
-		logx(LOG_ERR, "Cannot parse /proc/net/dev");
+	return ethtool_cmd_speed(&cmd);
+}
 
-	while (!feof(fp)) {
-		char device[32];
+/**
+ * Get the link speed in Mbit/s.
+ *
+ * The speed only changes together with the link state, so it is
+ * queried once and cached until the next link change.
+ *
+ * @param ifindex Interface index.
+ * @param dev Interface name.
+ * @returns The speed or 0 if it cannot be determined.
+ */
+static uint32_t
+get_link_speed(int ifindex, const char *dev)
+{
+	struct link_speed *ls;
 
-		scan_count = fscanf(fp, " %32[^:]:%"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %*u %*u %*u %*u %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %*u %*u %*s",
-				    device,
-				    &rec_oct, &rec_pkt, &rec_err, &rec_drop,
-				    &snd_oct, &snd_pkt, &snd_err, &snd_drop);
-		if (scan_count == 9 && strcmp(dev, device) == 0)
-			break;
-	}
-	fclose(fp);
+	LIST_FOREACH(ls, &link_speeds, entry)
+		if (ls->ifindex == ifindex)
+			return ls->speed;
 
-	if ((rc = dm_add_object(answer)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, rec_oct)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, rec_pkt)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, rec_err)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, rec_drop)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, snd_oct)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, snd_pkt)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, snd_err)) != RC_OK
-	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, snd_drop)) != RC_OK
-	    || (rc = dm_finalize_group(answer)) != RC_OK)
-		return rc;
+	if (!(ls = malloc(sizeof(struct link_speed))))
+		return query_link_speed(dev);
 
-	/* read IP's from NL */
+	ls->ifindex = ifindex;
+	ls->speed = query_link_speed(dev);
+	LIST_INSERT_HEAD(&link_speeds, ls, entry);
 
-	int ifindex;
-	struct nl_sock *socket = nl_socket_alloc();
-	struct nl_cache *link_cache;
-	struct nl_cache *addr_cache;
-	struct nl_cache *neigh_cache;
-	struct rtnl_link *link;
-	struct rtnl_addr *addr_filter = NULL;
-	struct rtnl_neigh *neigh_filter = NULL;
-	int forward;
-	uint32_t mtu;
+	return ls->speed;
+}
 
-	if (nl_connect(socket, NETLINK_ROUTE) < 0)
-		return RC_ERR_MISC;
+static int
+get_forwarding(int family, int ifindex, const char *dev)
+{
+	char path[PATH_MAX];
+	int forward = 0;
 
-	if (rtnl_link_alloc_cache(socket, AF_UNSPEC, &link_cache) < 0
-	    || rtnl_addr_alloc_cache(socket, &addr_cache) < 0
-	    || rtnl_neigh_alloc_cache(socket, &neigh_cache) < 0) {
-		nl_socket_free(socket);
-		return RC_ERR_ALLOC;
-	}
+	if (netlink_get_forwarding(family, ifindex, &forward) == 0)
+		return forward;
 
-	rc = RC_OK;
+	snprintf(path, sizeof(path), "/proc/sys/net/%s/conf/%s/forwarding",
+	         family == AF_INET ? "ipv4" : "ipv6", dev);
+	sys_scan(path, "%u", &forward);
 
-	link = rtnl_link_get_by_name(link_cache, dev);
-	ifindex = rtnl_link_get_ifindex(link);
-	mtu = rtnl_link_get_mtu(link);
-	if (mtu == 0 || mtu > 65535)
-		mtu = 65535;
+	return forward;
+}
 
-	addr_filter = rtnl_addr_alloc();
-	rtnl_addr_set_ifindex(addr_filter, ifindex);
+/**
+ * Add the IPv4 or IPv6 state group of an interface.
+ */
+static uint32_t
+add_ip_state_to_answer(DM2_REQUEST *answer, int family, int ifindex, const char *dev, uint32_t mtu)
+{
+	struct rtnl_addr *addr_filter;
+	struct rtnl_neigh *neigh_filter;
+	int forward;
+	uint32_t rc;
 
-	/* IPv4 group */
-	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
+	if (!(addr_filter = rtnl_addr_alloc()))
+		return RC_ERR_ALLOC;
+	if (!(neigh_filter = rtnl_neigh_alloc())) {
+		rtnl_addr_put(addr_filter);
+		return RC_ERR_ALLOC;
+	}
 
-	snprintf(line, sizeof(line), "/proc/sys/net/ipv4/conf/%s/forwarding", dev);
-	sys_scan(line, "%u", &forward);
+	rtnl_addr_set_ifindex(addr_filter, ifindex);
+	rtnl_addr_set_family(addr_filter, family);
+	rtnl_neigh_set_ifindex(neigh_filter, ifindex);
+	rtnl_neigh_set_family(neigh_filter, family);
 
-	logx(LOG_DEBUG, "IPv4 Forward: %d", forward);
-	if ((rc = dm_add_uint8(answer, AVP_BOOL, VP_TRAVELPING, forward)) != RC_OK
-	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, mtu)) != RC_OK)
-		goto exit_nl;
+	forward = get_forwarding(family, ifindex, dev);
+	logx(LOG_DEBUG, "IPv%c Forward: %d", family == AF_INET ? '4' : '6', forward);
 
-	rtnl_addr_set_family(addr_filter, AF_INET);
+	if ((rc = dm_add_object(answer)) != RC_OK
+	    || (rc = dm_add_uint8(answer, AVP_BOOL, VP_TRAVELPING, forward)) != RC_OK
+	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, mtu)) != RC_OK)
+		goto exit;
 
 	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
+		goto exit;
+	nl_cache_foreach_filter(netlink_addr_cache(), (struct nl_object *) addr_filter,
+	                        add_addr_to_answer, answer);
+	if ((rc = dm_finalize_group(answer)) != RC_OK)
+		goto exit;
 
-	nl_cache_foreach_filter(addr_cache, (struct nl_object *) addr_filter, add_addr_to_answer, answer);
+	if ((rc = dm_add_object(answer)) != RC_OK)
+		goto exit;
+	nl_cache_foreach_filter(netlink_neigh_cache(), (struct nl_object *) neigh_filter,
+	                        add_neigh_to_answer, answer);
 	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+		goto exit;
 
-	neigh_filter = rtnl_neigh_alloc();
-	rtnl_neigh_set_ifindex(neigh_filter, ifindex);
+	rc = dm_finalize_group(answer);
 
-	rtnl_neigh_set_family(neigh_filter, AF_INET);
+exit:
+	rtnl_neigh_put(neigh_filter);
+	rtnl_addr_put(addr_filter);
 
-	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
-	nl_cache_foreach_filter(neigh_cache, (struct nl_object *) neigh_filter, add_neigh_to_answer, answer);
-	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+	return rc;
+}
+
+/**
+ * Add the state of a single interface from netlink objects.
+ *
+ * @param answer The answer to add to.
+ * @param link Link object.
+ * @param stats Interface counters.
+ * @param speed Link speed in Mbit/s.
+ * @returns According dmconfig RC.
+ */
+static uint32_t
+add_interface_state_to_answer(DM2_REQUEST *answer, struct rtnl_link *link,
+                              const struct netlink_link_stats *stats, uint32_t speed)
+{
+	const char *dev = rtnl_link_get_name(link);
+	int ifindex = rtnl_link_get_ifindex(link);
+	struct nl_addr *lladdr = rtnl_link_get_addr(link);
+	struct sockaddr hwaddr;
+	uint32_t mtu;
+	uint32_t rc;
+
+	/* same layout as returned by SIOCGIFHWADDR */
+	memset(&hwaddr, 0, sizeof(hwaddr));
+	hwaddr.sa_family = rtnl_link_get_arptype(link);
+	if (lladdr)
+		memcpy(hwaddr.sa_data, nl_addr_get_binary_addr(lladdr),
+		       MIN(nl_addr_get_len(lladdr), sizeof(hwaddr.sa_data)));
+
+	if ((rc = dm_add_int32(answer, AVP_INT32, VP_TRAVELPING, ifindex ? : 2147483647)) != RC_OK
+	    /* SIOCGIFFLAGS returns only the lower 16 bits */
+	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING,
+	                           (uint16_t)rtnl_link_get_flags(link))) != RC_OK
+	    || (rc = dm_add_raw(answer, AVP_BINARY, VP_TRAVELPING, &hwaddr, 6)) != RC_OK
+	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, speed)) != RC_OK)
+		return rc;
+
+	if ((rc = dm_add_object(answer)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->rx_bytes)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->rx_packets)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->rx_errors)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->rx_dropped)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->tx_bytes)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->tx_packets)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->tx_errors)) != RC_OK
+	    || (rc = dm_add_uint64(answer, AVP_UINT64, VP_TRAVELPING, stats->tx_dropped)) != RC_OK
+	    || (rc = dm_finalize_group(answer)) != RC_OK)
+		return rc;
+
+	mtu = rtnl_link_get_mtu(link);
+	if (mtu == 0 || mtu > 65535)
+		mtu = 65535;
 
 	/* IPv4 group */
-	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+	if ((rc = add_ip_state_to_answer(answer, AF_INET, ifindex, dev, mtu)) != RC_OK)
+		return rc;
 
 	/* IPv6 group */
-	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
+	return add_ip_state_to_answer(answer, AF_INET6, ifindex, dev, mtu);
+}
+
+uint32_t rpc_client_get_interface_state(void *ctx, const char *if_name, DM2_REQUEST *answer)
+{
+	struct rtnl_link *link;
+	struct netlink_link_stats stats;
+	uint32_t rc;
+	STATS_SCOPE(STATS_GET_INTERFACE_STATE);
 
-	snprintf(line, sizeof(line), "/proc/sys/net/ipv6/conf/%s/forwarding", dev);
-	sys_scan(line, "%u", &forward);
+	logx(LOG_DEBUG, "rpc_client_get_interface_state: %s", if_name);
 
-	logx(LOG_DEBUG, "IPv6 Forward: %d", forward);
-	if ((rc = dm_add_uint8(answer, AVP_BOOL, VP_TRAVELPING, forward)) != RC_OK
-	    || (rc = dm_add_uint32(answer, AVP_UINT32, VP_TRAVELPING, mtu)) != RC_OK)
-		goto exit_nl;
+	if (!netlink_link_cache() ||
+	    !(link = rtnl_link_get_by_name(netlink_link_cache(), if_name))) {
+		stats_error();
+		return RC_ERR_MISC;
+	}
 
-	rtnl_addr_set_family(addr_filter, AF_INET6);
+	netlink_get_link_stats(link, &stats);
 
-	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
-	nl_cache_foreach_filter(addr_cache, (struct nl_object *) addr_filter, add_addr_to_answer, answer);
-	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+	rc = add_interface_state_to_answer(answer, link, &stats,
+	                                   get_link_speed(rtnl_link_get_ifindex(link), if_name));
 
-	rtnl_neigh_set_family(neigh_filter, AF_INET6);
+	rtnl_link_put(link);
 
-	if ((rc = dm_add_object(answer)) != RC_OK)
-		goto exit_nl;
-	nl_cache_foreach_filter(neigh_cache, (struct nl_object *) neigh_filter, add_neigh_to_answer, answer);
-	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+	if (rc != RC_OK)
+		stats_error();
+	return rc;
+}
 
-	/* IPv6 group */
-	if ((rc = dm_finalize_group(answer)) != RC_OK)
-		goto exit_nl;
+#if HAVE_DECL_RPC_CLIENT_GET_INTERFACES_STATE
 
-exit_nl:
-	nl_cache_free(neigh_cache);
-	nl_cache_free(addr_cache);
-	nl_cache_free(link_cache);
-	if (addr_filter) rtnl_addr_put(addr_filter);
-	if (neigh_filter) rtnl_neigh_put(neigh_filter);
-	nl_socket_free(socket);
+struct interfaces_state_ctx {
+	DM2_REQUEST *answer;
+	uint32_t rc;
+};
 
-	return rc;
+static void
+add_link_state_cb(struct nl_object *obj, void *data)
+{
+	struct interfaces_state_ctx *st = data;
+	struct rtnl_link *link = (struct rtnl_link *)obj;
+	struct netlink_link_stats stats;
+	const char *dev = rtnl_link_get_name(link);
+	int ifindex = rtnl_link_get_ifindex(link);
+
+	if (st->rc != RC_OK)
+		return;
+
+	netlink_link_stats_from(link, &stats);
+
+	if ((st->rc = dm_add_object(st->answer)) != RC_OK
+	    || (st->rc = dm_add_string(st->answer, AVP_STRING, VP_TRAVELPING, dev)) != RC_OK
+	    || (st->rc = add_interface_state_to_answer(st->answer, link, &stats,
+	                                               get_link_speed(ifindex, dev))) != RC_OK)
+		return;
+
+	st->rc = dm_finalize_group(st->answer);
 }
 
-static uint32_t
-init_hostname(DMCONTEXT *dmCtx)
+/**
+ * Answer the state of all interfaces at once.
+ *
+ * All interfaces are reported from a single link dump, so the
+ * counters of all interfaces are taken at the same point in time.
+ * Addresses and neighbors are served from the netlink caches.
+ */
+uint32_t rpc_client_get_interfaces_state(void *ctx, DM2_REQUEST *answer)
 {
-	uint32_t rc;
-	char hostname[256];
-	gethostname(hostname, sizeof(hostname));
-
-	struct rpc_db_set_path_value set_value = {
-		.path  = "system.hostname",
-		.value = {
-			.code = AVP_STRING,
-			.vendor_id = VP_TRAVELPING,
-			.data = hostname,
-			.size = strlen(hostname)
-		},
+	struct interfaces_state_ctx st = {
+		.answer = answer,
+		.rc = RC_OK
 	};
-	if ((rc = rpc_db_set(dmCtx, 1, &set_value, NULL)) != RC_OK)
-		logx(LOG_WARNING, "Failed to report hostname, rc=%d.", rc);
+	struct nl_cache *snapshot;
+	STATS_SCOPE(STATS_GET_INTERFACES_STATE);
 
-	if ((rc = rpc_param_notify(dmCtx, NOTIFY_ACTIVE, 1, &set_value.path, NULL)) != RC_OK) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-		CB_ERR_RET(rc, "Couldn't register PARAM NOTIFY request, rc=%d.", rc);
+	logx(LOG_DEBUG, "rpc_client_get_interfaces_state");
+
+	if (!(snapshot = netlink_link_snapshot())) {
+		stats_error();
+		return RC_ERR_MISC;
 	}
 
-	return RC_OK;
+	nl_cache_foreach(snapshot, add_link_state_cb, &st);
+
+	nl_cache_free(snapshot);
+
+	if (st.rc != RC_OK)
+		stats_error();
+	return st.rc;
 }
 
-static uint32_t
-init_timezone(DMCONTEXT *dmCtx)
+#endif
+
+/**
+ * Answer of SET requests that report state.
+ *
+ * Nothing is waiting for these answers, but as they are sent
+ * periodically, they notice a lost connection even when mand is idle.
+ */
+static void
+setAnswerReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
+                  void *userdata __attribute__((unused)))
+{
+	uint32_t rc, answer_rc;
+
+	/* reported once by connection_lost() */
+	if (event != DMCONFIG_ANSWER_READY) {
+		connection_lost(dmCtx, false);
+		return;
+	}
+
+	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
+	    || answer_rc != RC_OK)
+		logx(LOG_DEBUG, "SET request failed, rc=%d,%d.", rc, answer_rc);
+}
+
+/**
+ * Minimum delay between a link, address or neighbor change and its report.
+ * Further changes within this window are coalesced.
+ */
+#define IF_STATE_PUSH_DELAY_S 0.2
+/**
+ * Minimum interval between two reports, so a bouncing link
+ * produces at most one report per interval.
+ */
+#define IF_STATE_PUSH_INTERVAL_S 2.
+/**
+ * Maximum number of interfaces tracked individually per report.
+ * All interfaces are reported if more interfaces changed.
+ */
+#define IF_STATE_DIRTY_MAX 64
+
+static ev_timer if_state_timer;
+static int if_state_dirty[IF_STATE_DIRTY_MAX];
+static unsigned int if_state_ndirty;
+static bool if_state_all_dirty;
+static ev_tstamp if_state_push_ts;
+/** changes are reported once the startup pipeline completed */
+static bool if_state_push_enabled;
+
+/**
+ * RFC 7223 oper-status of the kernel's IF_OPER_* values (RFC 2863 order),
+ * see linux/if.h.
+ */
+static const char * const if_oper_status[] = {
+	"unknown",		/* IF_OPER_UNKNOWN */
+	"not-present",		/* IF_OPER_NOTPRESENT */
+	"down",			/* IF_OPER_DOWN */
+	"lower-layer-down",	/* IF_OPER_LOWERLAYERDOWN */
+	"testing",		/* IF_OPER_TESTING */
+	"dormant",		/* IF_OPER_DORMANT */
+	"up"			/* IF_OPER_UP */
+};
+
+/**
+ * Reports the state of a single interface.
+ *
+ * Interface instances are addressed by their name key.
+ * The lists of addresses and neighbors are still read through
+ * rpc_client_get_interface_state(), but every change updates
+ * last-change, so readers know when to fetch them again.
+ */
+static void
+push_link_state(DMCONTEXT *dmCtx, struct rtnl_link *link, const char *last_change)
 {
+	const char *dev = rtnl_link_get_name(link);
+	uint8_t operstate = rtnl_link_get_operstate(link);
+	const char *status;
+	char oper_path[128], change_path[128];
 	uint32_t rc;
-	FILE *fpipe;
-	char buffer[255];
-
-	struct rpc_db_set_path_value set_value = {
-		.path  = "system.clock.timezone-location",
-		.value = {
-			.code = AVP_ENUM,
-			.vendor_id = VP_TRAVELPING,
+
+	status = operstate < sizeof(if_oper_status)/sizeof(if_oper_status[0])
+	         ? if_oper_status[operstate] : "unknown";
+
+	snprintf(oper_path, sizeof(oper_path), "interfaces-state.interface.%s.oper-status", dev);
+	snprintf(change_path, sizeof(change_path), "interfaces-state.interface.%s.last-change", dev);
+
+	struct rpc_db_set_path_value set_values[] = {
+		{
+			.path  = oper_path,
+			.value = {
+				.code = AVP_ENUM,
+				.vendor_id = VP_TRAVELPING,
+				.data = (void *)status,
+				.size = strlen(status)
+			}
 		},
+		{
+			.path  = change_path,
+			.value = {
+				.code = AVP_STRING,
+				.vendor_id = VP_TRAVELPING,
+				.data = (void *)last_change,
+				.size = strlen(last_change)
+			}
+		}
 	};
 
-	fpipe = popen("timedatectl status", "r");
-	if (!fpipe)
-		return RC_ERR_MISC;
+	logx(LOG_DEBUG, "Interface %s: %s", dev, status);
 
-	while (fgets(buffer, sizeof(buffer), fpipe)) {
-		char *tz = strstr(buffer, "Time zone: ");
-		char *p;
+	if ((rc = rpc_db_set_async(dmCtx, sizeof(set_values)/sizeof(set_values[0]),
+	                           set_values, setAnswerReceived, NULL)) != RC_OK)
+		logx(LOG_WARNING, "Failed to report state of interface %s, rc=%d.", dev, rc);
+}
 
-		if (!tz)
-			continue;
-		tz += 11;
+static void
+push_link_state_cb(struct nl_object *obj, void *data)
+{
+	void **args = data;
 
-		p = strchr(tz, ' ');
-		if (p)
-			*p = '\0';
+	push_link_state(args[0], (struct rtnl_link *)obj, args[1]);
+}
 
-		set_value.value.data = tz;
-		set_value.value.size = strlen(tz);
+/**
+ * Reports the state of all interfaces that changed since the last report.
+ */
+static void
+if_state_push_cb(EV_P_ ev_timer *w, int revents __attribute__((unused)))
+{
+	DMCONTEXT *dmCtx = (DMCONTEXT *) w->data;
+	struct nl_cache *cache = netlink_link_cache();
+	char last_change[32];
+	time_t now = time(NULL);
+	struct tm tm;
 
-		if ((rc = rpc_db_set(dmCtx, 1, &set_value, NULL)) != RC_OK)
-			logx(LOG_WARNING, "Failed to report timezone, rc=%d.", rc);
-		break;
-	}
+	if_state_push_ts = ev_now(EV_A);
 
-	fclose(fpipe);
+	strftime(last_change, sizeof(last_change), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
 
-	if ((rc = rpc_param_notify(dmCtx, NOTIFY_ACTIVE, 1, &set_value.path, NULL)) != RC_OK) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-		CB_ERR_RET(rc, "Couldn't register PARAM NOTIFY request, rc=%d.", rc);
+	if (if_state_all_dirty) {
+		void *args[] = {dmCtx, last_change};
+
+		nl_cache_foreach(cache, push_link_state_cb, args);
+	} else {
+		for (unsigned int i = 0; i < if_state_ndirty; i++) {
+			struct rtnl_link *link;
+
+			/* deleted interfaces disappear from /interfaces-state anyway */
+			if (!(link = rtnl_link_get(cache, if_state_dirty[i])))
+				continue;
+
+			push_link_state(dmCtx, link, last_change);
+			rtnl_link_put(link);
+		}
 	}
 
-	return RC_OK;
+	if_state_ndirty = 0;
+	if_state_all_dirty = false;
 }
 
 /**
- * Timer used to periodically report monitored system parameters.
+ * Records a link, address or neighbor change and schedules its report.
+ *
+ * Like notify_mark_dirty(), the window is not extended by later changes.
+ * It is however delayed to keep IF_STATE_PUSH_INTERVAL_S between reports.
+ * Link changes also invalidate the cached link speed.
  */
-static ev_timer monitoring_timer;
+static void
+if_state_changed(int ifindex, unsigned int what, void *data)
+{
+	DMCONTEXT *dmCtx = data;
+	ev_tstamp delay;
+
+	logx(LOG_DEBUG, "Interface %d changed, what=%#x", ifindex, what);
+
+	if (what & NETLINK_CHANGE_LINK)
+		link_speed_invalidate(ifindex);
+
+	if (!if_state_push_enabled)
+		return;
+
+	if (!ifindex || if_state_ndirty == IF_STATE_DIRTY_MAX)
+		if_state_all_dirty = true;
+	else if (!if_state_all_dirty) {
+		unsigned int i;
+
+		for (i = 0; i < if_state_ndirty && if_state_dirty[i] != ifindex; i++)
+			;
+		if (i == if_state_ndirty)
+			if_state_dirty[if_state_ndirty++] = ifindex;
+	}
+
+	if (ev_is_active(&if_state_timer))
+		return;
+
+	delay = MAX(IF_STATE_PUSH_DELAY_S,
+	            if_state_push_ts + IF_STATE_PUSH_INTERVAL_S - ev_now(dmCtx->ev));
+
+	ev_timer_set(&if_state_timer, delay, 0.);
+	if_state_timer.data = dmCtx;
+	ev_timer_start(dmCtx->ev, &if_state_timer);
+}
+
+/** directory name of the time zone database in /etc/localtime links */
+#define ZONEINFO_DIR "zoneinfo/"
 
 /**
- * Reports monitored system information.
- * 
- * @param dmCtx The libdmconfig context.
- * @param report_total If total memory size should be reported or not.
- * @return According dmconfig RC.
- * 
- * Currently CPU und RAM usage get reported.
- * In future maybe temperatures will be reported.
+ * Determines the current timezone.
+ *
+ * /etc/localtime is a symlink into the time zone database,
+ * whose path below that database is the timezone name.
+ * Only if it is not, timedated is asked.
+ *
+ * @param buf Buffer for the timezone name.
+ * @param size Size of @p buf.
+ * @returns true if the timezone could be determined.
  */
-static uint32_t
-report_system_monitoring_info(DMCONTEXT *dmCtx, bool report_total)
+static bool
+get_timezone(char *buf, size_t size)
 {
-	struct sysinfo info;
-	uint64_t si_total, si_free;
-	uint32_t mem_used, mem_total, mem_free_perc, loads[3], rc;
+	char link[PATH_MAX];
+	ssize_t len;
+	char *tz;
 
-	if (sysinfo(&info) != 0) {
-		logx(LOG_WARNING, "Failed to read sysinfo: %s.",
-		     strerror(errno));
-		return RC_ERR_MISC;
+	if ((len = readlink(SYSCONF_PREFIX "/localtime", link, sizeof(link) - 1)) > 0) {
+		link[len] = '\0';
+
+		if ((tz = strstr(link, ZONEINFO_DIR)) && tz[strlen(ZONEINFO_DIR)]) {
+			snprintf(buf, size, "%s", tz + strlen(ZONEINFO_DIR));
+			return true;
+		}
 	}
 
-	si_total = (uint64_t) info.totalram * (uint64_t) info.mem_unit;
-	si_free  = (uint64_t) info.freeram * (uint64_t) info.mem_unit;
+	if ((tz = systemd_get_timezone())) {
+		snprintf(buf, size, "%s", tz);
+		free(tz);
+		return true;
+	}
 
-	mem_total     = (uint32_t) (si_total / MEGABYTE);
-	mem_used      = (uint32_t) ((si_total - si_free) / MEGABYTE);
-	mem_free_perc = (uint32_t) (si_free * 100 / si_total);
+	return false;
+}
 
-	mem_total     = htonl(mem_total);
-	mem_used      = htonl(mem_used);
-	mem_free_perc = htonl(mem_free_perc);
+/**
+ * Determines the static hostname.
+ *
+ * Falls back to the kernel's hostname if /etc/hostname is missing or empty.
+ */
+static void
+get_hostname(char *buf, size_t size)
+{
+	FILE *fin;
 
-	for (int i = 0; i < 3; i++)
-		loads[i] = htonl((uint32_t) info.loads[i] * 100 / (1 << SI_LOAD_SHIFT));
+	*buf = '\0';
+	if ((fin = fopen(SYSCONF_PREFIX "/hostname", "r"))) {
+		if (!fgets(buf, size, fin))
+			*buf = '\0';
+		fclose(fin);
+		chomp(buf);
+	}
 
-	struct rpc_db_set_path_value set_values[] = {
-		{
-			.path  = "metropolis.memory.memory-used",
-			.value = {
-				.code = AVP_UINT32,
-				.vendor_id = VP_TRAVELPING,
-				.data = &mem_used,
-				.size = sizeof(mem_used)
-			}
-		},
-		{
-			.path  = "metropolis.memory.memory-free-percentage",
+	if (!*buf && gethostname(buf, size) < 0)
+		*buf = '\0';
+	buf[size - 1] = '\0';
+}
+
+/*
+ * Last hostname and timezone reported, see report_system_state().
+ */
+static char reported_hostname[HOST_NAME_MAX + 1];
+static char reported_timezone[128];
+
+/**
+ * inotify instance watching SYSCONF_PREFIX for hostname and timezone changes.
+ */
+static ev_io system_state_watcher;
+
+/**
+ * Reports hostname and timezone in a single SET request.
+ *
+ * Values that did not change since the last report are skipped.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @return According dmconfig RC.
+ */
+static uint32_t
+report_system_state(DMCONTEXT *dmCtx)
+{
+	uint32_t rc;
+	char hostname[sizeof(reported_hostname)];
+	char tz[sizeof(reported_timezone)];
+	struct rpc_db_set_path_value set_values[2];
+	int nvalues = 0;
+
+	get_hostname(hostname, sizeof(hostname));
+	if (strcmp(hostname, reported_hostname) != 0)
+		set_values[nvalues++] = (struct rpc_db_set_path_value){
+			.path  = "system.hostname",
 			.value = {
-				.code = AVP_UINT32,
+				.code = AVP_STRING,
 				.vendor_id = VP_TRAVELPING,
-				.data = &mem_free_perc,
-				.size = sizeof(mem_free_perc)
+				.data = hostname,
+				.size = strlen(hostname)
 			}
-		},
-		{
-			.path  = "metropolis.cpu.load-average-1",
+		};
+
+	if (!get_timezone(tz, sizeof(tz))) {
+		logx(LOG_WARNING, "Couldn't determine timezone.");
+		strcpy(tz, reported_timezone);
+	} else if (strcmp(tz, reported_timezone) != 0)
+		set_values[nvalues++] = (struct rpc_db_set_path_value){
+			.path  = "system.clock.timezone-location",
 			.value = {
-				.code = AVP_UINT32,
+				.code = AVP_ENUM,
 				.vendor_id = VP_TRAVELPING,
-				.data = &loads[0],
-				.size = sizeof(loads[0])
+				.data = tz,
+				.size = strlen(tz)
 			}
-		},
-		{
-			.path  = "metropolis.cpu.load-average-5",
+		};
+
+	if (!nvalues)
+		return RC_OK;
+
+	if ((rc = rpc_db_set_async(dmCtx, nvalues, set_values, setAnswerReceived, NULL)) != RC_OK) {
+		logx(LOG_WARNING, "Failed to report hostname and timezone, rc=%d.", rc);
+		return rc;
+	}
+
+	strcpy(reported_hostname, hostname);
+	strcpy(reported_timezone, tz);
+	return RC_OK;
+}
+
+static void
+system_state_changed(EV_P_ ev_io *w, int revents __attribute__((unused)))
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	bool changed = false;
+	ssize_t len;
+
+	while ((len = read(w->fd, buf, sizeof(buf))) > 0)
+		for (char *p = buf; p < buf + len; p += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)p;
+
+			if (event->len &&
+			    (!strcmp(event->name, "hostname") || !strcmp(event->name, "localtime")))
+				changed = true;
+		}
+
+	/* reported by init_system_state() after reconnecting */
+	if (changed && dm_connected)
+		report_system_state(w->data);
+}
+
+/**
+ * Reports hostname and timezone and watches them for changes.
+ *
+ * The files are usually replaced by renaming, so the directory
+ * is watched instead of the files.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @return According dmconfig RC.
+ */
+static uint32_t
+init_system_state(DMCONTEXT *dmCtx)
+{
+	/* a new connection must get all values */
+	*reported_hostname = '\0';
+	*reported_timezone = '\0';
+
+	if (!ev_is_active(&system_state_watcher)) {
+		int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+		if (fd < 0 ||
+		    inotify_add_watch(fd, SYSCONF_PREFIX, IN_CLOSE_WRITE | IN_MOVED_TO |
+		                                          IN_CREATE | IN_DELETE) < 0) {
+			logx(LOG_WARNING, "Cannot watch hostname and timezone: %s", strerror(errno));
+			if (fd >= 0)
+				close(fd);
+		} else {
+			ev_io_init(&system_state_watcher, system_state_changed, fd, EV_READ);
+			ev_io_start(dmCtx->ev, &system_state_watcher);
+		}
+	}
+	system_state_watcher.data = dmCtx;
+
+	return report_system_state(dmCtx);
+}
+
+/**
+ * Timer used to periodically sample monitored system parameters.
+ */
+static ev_timer monitoring_timer;
+
+enum monitoring_value {
+	MON_MEMORY_USED,
+	MON_MEMORY_FREE_PERCENTAGE,
+	MON_LOAD_AVERAGE_1,
+	MON_LOAD_AVERAGE_5,
+	MON_LOAD_AVERAGE_15,
+	MON_MEMORY_TOTAL,
+	MON_CPU_USAGE,
+	MON_TEMPERATURE,
+	MON_VALUES
+};
+
+/**
+ * Monitored values.
+ *
+ * Optional values are not part of every data model, so they are
+ * reported in separate SET requests which may fail without
+ * affecting the other values.
+ */
+static const struct {
+	const char *path;
+	uint32_t code;
+	bool optional;
+} monitoring_values[MON_VALUES] = {
+	[MON_MEMORY_USED]            = { "metropolis.memory.memory-used", AVP_UINT32 },
+	[MON_MEMORY_FREE_PERCENTAGE] = { "metropolis.memory.memory-free-percentage", AVP_UINT32 },
+	[MON_LOAD_AVERAGE_1]         = { "metropolis.cpu.load-average-1", AVP_UINT32 },
+	[MON_LOAD_AVERAGE_5]         = { "metropolis.cpu.load-average-5", AVP_UINT32 },
+	[MON_LOAD_AVERAGE_15]        = { "metropolis.cpu.load-average-15", AVP_UINT32 },
+	[MON_MEMORY_TOTAL]           = { "metropolis.memory.memory-total", AVP_UINT32 },
+	[MON_CPU_USAGE]              = { "metropolis.cpu.usage", AVP_UINT32, true },
+	[MON_TEMPERATURE]            = { "metropolis.temperature.maximum", AVP_INT32, true }
+};
+
+ev_tstamp monitoring_interval = MONITORING_INTERVAL_DEFAULT_S;
+unsigned int monitoring_threshold = MONITORING_THRESHOLD_DEFAULT;
+
+/** values last reported to mand */
+static int64_t monitoring_reported[MON_VALUES];
+/** time of the last report of all values */
+static ev_tstamp monitoring_full_report_ts;
+
+/**
+ * Checks whether a monitored value moved far enough to be reported.
+ *
+ * Percentages must change by monitoring_threshold percentage points,
+ * temperatures by monitoring_threshold degrees, the used memory by
+ * monitoring_threshold percent of the total memory and load averages
+ * by monitoring_threshold percent (but at least monitoring_threshold
+ * hundredths).
+ */
+static bool
+monitoring_value_changed(enum monitoring_value value, int64_t cur,
+                         const struct monitor_sample *sample)
+{
+	int64_t prev = monitoring_reported[value];
+	uint64_t delta = cur > prev ? cur - prev : prev - cur;
+
+	switch (value) {
+	case MON_MEMORY_USED:
+		return delta * 100 >= (uint64_t)monitoring_threshold * sample->mem_total;
+
+	case MON_LOAD_AVERAGE_1:
+	case MON_LOAD_AVERAGE_5:
+	case MON_LOAD_AVERAGE_15:
+		return delta * 100 >= (uint64_t)monitoring_threshold * MAX(prev, 100);
+
+	case MON_MEMORY_TOTAL:
+		return delta != 0;
+
+	default:
+		return delta >= monitoring_threshold;
+	}
+}
+
+/**
+ * Samples and reports monitored system information.
+ *
+ * Values are only pushed to mand when they changed by more than
+ * the configured threshold, but all values are reported at least every
+ * SYSTEM_MONITORING_REPORT_INTERVAL_S seconds.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @param report_all If all values should be reported, regardless of their change.
+ * @return According dmconfig RC.
+ */
+static uint32_t
+report_system_monitoring_info(DMCONTEXT *dmCtx, bool report_all)
+{
+	struct monitor_sample sample;
+	int64_t values[MON_VALUES];
+	bool available[MON_VALUES];
+	uint32_t data[MON_VALUES], rc;
+	struct rpc_db_set_path_value set_values[MON_VALUES], optional_value;
+	int nvalues = 0;
+	ev_tstamp now = ev_now(dmCtx->ev);
+
+	if (monitor_sample(&sample) < 0)
+		return RC_ERR_MISC;
+
+	values[MON_MEMORY_USED] = sample.mem_used;
+	values[MON_MEMORY_FREE_PERCENTAGE] = sample.mem_free_perc;
+	values[MON_LOAD_AVERAGE_1] = sample.loads[0];
+	values[MON_LOAD_AVERAGE_5] = sample.loads[1];
+	values[MON_LOAD_AVERAGE_15] = sample.loads[2];
+	values[MON_MEMORY_TOTAL] = sample.mem_total;
+	values[MON_CPU_USAGE] = sample.cpu_usage;
+	/* millidegree to degree Celsius, rounded */
+	values[MON_TEMPERATURE] = sample.max_temp >= 0 ? (sample.max_temp + 500) / 1000
+	                                               : (sample.max_temp - 500) / 1000;
+
+	for (int i = 0; i < MON_VALUES; i++)
+		available[i] = true;
+	available[MON_TEMPERATURE] = sample.have_max_temp;
+
+	if (now - monitoring_full_report_ts >= SYSTEM_MONITORING_REPORT_INTERVAL_S) {
+		report_all = true;
+		monitoring_full_report_ts = now;
+	}
+
+	for (unsigned int i = 0; i < sample.cpus; i++)
+		logx(LOG_DEBUG, "CPU %u: %u%%", i, sample.cpu_core_usage[i]);
+	for (unsigned int i = 0; i < sample.sensors; i++)
+		logx(LOG_DEBUG, "%s: %d", monitor_sensor_name(i), sample.sensor_temp[i]);
+
+	for (int i = 0; i < MON_VALUES; i++) {
+		struct rpc_db_set_path_value *set_value;
+
+		if (!available[i] ||
+		    (!report_all && !monitoring_value_changed(i, values[i], &sample)))
+			continue;
+
+		/* optional values are sent on their own, see monitoring_values */
+		set_value = monitoring_values[i].optional ? &optional_value
+		                                          : &set_values[nvalues++];
+
+		data[i] = htonl((uint32_t)values[i]);
+		*set_value = (struct rpc_db_set_path_value){
+			.path  = monitoring_values[i].path,
 			.value = {
-				.code = AVP_UINT32,
+				.code = monitoring_values[i].code,
 				.vendor_id = VP_TRAVELPING,
-				.data = &loads[1],
-				.size = sizeof(loads[1])
+				.data = &data[i],
+				.size = sizeof(data[i])
 			}
-		},
+		};
+		monitoring_reported[i] = values[i];
+
+		if (monitoring_values[i].optional &&
+		    (rc = rpc_db_set_async(dmCtx, 1, set_value, setAnswerReceived, NULL)) != RC_OK)
+			logx(LOG_WARNING, "Failed to report \"%s\", rc=%d.",
+			     monitoring_values[i].path, rc);
+	}
+
+	if (nvalues &&
+	    (rc = rpc_db_set_async(dmCtx, nvalues, set_values, setAnswerReceived, NULL)) != RC_OK)
+		logx(LOG_WARNING, "Failed to report system information, rc=%d.", rc);
+
+	return RC_OK;
+}
+
+/** number of calls of each handler when it was last reported */
+static uint64_t agent_stats_reported[STATS_HANDLERS];
+
+/**
+ * Reports the counters of all handlers that have been called since
+ * the last report.
+ *
+ * The metropolis.agent subtree is not part of every data model,
+ * so every handler is reported in a SET request of its own.
+ * Durations are reported in microseconds.
+ *
+ * @param dmCtx The libdmconfig context.
+ */
+static void
+report_agent_stats(DMCONTEXT *dmCtx)
+{
+	static const char *fields[] = {
+		"calls", "errors", "last-duration", "duration-p50", "duration-p99"
+	};
+
+	for (int i = 0; i < STATS_HANDLERS; i++) {
+		const struct stats_counter *counter = stats_get(i);
+		char paths[sizeof(fields)/sizeof(fields[0])][64];
+		uint64_t calls, errors;
+		uint32_t durations[3];
+		struct rpc_db_set_path_value set_values[sizeof(fields)/sizeof(fields[0])];
+		uint32_t rc;
+
+		if (counter->calls == agent_stats_reported[i])
+			continue;
+		agent_stats_reported[i] = counter->calls;
+
+		calls = htobe64(counter->calls);
+		errors = htobe64(counter->errors);
+		durations[0] = htonl(counter->last_us);
+		durations[1] = htonl(stats_percentile(counter, 50));
+		durations[2] = htonl(stats_percentile(counter, 99));
+
+		for (int j = 0; j < sizeof(fields)/sizeof(fields[0]); j++) {
+			snprintf(paths[j], sizeof(paths[j]), "metropolis.agent.%s.%s",
+			         stats_name(i), fields[j]);
+
+			set_values[j] = (struct rpc_db_set_path_value){
+				.path  = paths[j],
+				.value = {
+					.code = j < 2 ? AVP_UINT64 : AVP_UINT32,
+					.vendor_id = VP_TRAVELPING,
+					.data = j == 0 ? (void *)&calls
+					      : j == 1 ? (void *)&errors : (void *)&durations[j - 2],
+					.size = j < 2 ? sizeof(uint64_t) : sizeof(uint32_t)
+				}
+			};
+		}
+
+		if ((rc = rpc_db_set_async(dmCtx, sizeof(set_values)/sizeof(set_values[0]),
+		                           set_values, setAnswerReceived, NULL)) != RC_OK)
+			logx(LOG_WARNING, "Failed to report counters of %s, rc=%d.",
+			     stats_name(i), rc);
+	}
+}
+
+/**
+ * Reports the servo state of ptp4l, see ptp_get_current_data().
+ *
+ * Offset and path delay are reported in nanoseconds.
+ */
+static void
+ptp_current_data_received(const struct ptp_current_data *current, void *data)
+{
+	DMCONTEXT *dmCtx = data;
+	int64_t offset = htobe64(current->offset_from_master);
+	int64_t delay = htobe64(current->mean_path_delay);
+	uint32_t rc;
+
+	/* requested before the connection was lost */
+	if (!dm_connected)
+		return;
+
+	struct rpc_db_set_path_value set_values[] = {
 		{
-			.path  = "metropolis.cpu.load-average-15",
+			.path  = "system.ptp.offset-from-master",
 			.value = {
-				.code = AVP_UINT32,
+				.code = AVP_INT64,
 				.vendor_id = VP_TRAVELPING,
-				.data = &loads[2],
-				.size = sizeof(loads[2])
+				.data = &offset,
+				.size = sizeof(offset)
 			}
 		},
 		{
-			.path  = "metropolis.memory.memory-total",
+			.path  = "system.ptp.mean-path-delay",
 			.value = {
-				.code = AVP_UINT32,
+				.code = AVP_INT64,
 				.vendor_id = VP_TRAVELPING,
-				.data = &mem_total,
-				.size = sizeof(mem_total)
+				.data = &delay,
+				.size = sizeof(delay)
 			}
 		}
 	};
 
-	int nvalues = sizeof(set_values) / sizeof(set_values[0]);
-	if (!report_total)
-		nvalues -= 1;
+	logx(LOG_DEBUG, "PTP: offset %" PRId64 " ns, path delay %" PRId64 " ns, %u steps removed",
+	     current->offset_from_master, current->mean_path_delay, current->steps_removed);
 
-	if ((rc = rpc_db_set_async(dmCtx, nvalues, set_values, NULL, NULL)) != RC_OK)
-		logx(LOG_WARNING, "Failed to report system information, rc=%d.", rc);
-
-	return RC_OK;
+	if ((rc = rpc_db_set_async(dmCtx, sizeof(set_values)/sizeof(set_values[0]),
+	                           set_values, setAnswerReceived, NULL)) != RC_OK)
+		logx(LOG_WARNING, "Failed to report PTP state, rc=%d.", rc);
 }
 
 /**
- * Periodically reports system information.
+ * Periodically samples system information.
  */
 static void
 report_system_monitoring_timer_cb(EV_P_ ev_timer *w, int revents)
@@ -1546,10 +3365,15 @@ report_system_monitoring_timer_cb(EV_P_ ev_timer *w, int revents)
 
 	if (report_system_monitoring_info(dmCtx, false) != RC_OK)
 		logx(LOG_WARNING, "Failed to report system information.");
+
+	report_agent_stats(dmCtx);
+
+	/* fails silently unless ptp4l is running */
+	ptp_get_current_data(ptp_current_data_received, dmCtx);
 }
 
 /**
- * Sets system information initially and starts ev_timer for periodic querying.
+ * Sets system information initially and starts ev_timer for periodic sampling.
  * 
  * @param dmCtx The libdmconfig context.
  * @return According dmconfig RC.
@@ -1557,98 +3381,344 @@ report_system_monitoring_timer_cb(EV_P_ ev_timer *w, int revents)
 static uint32_t
 init_system_monitoring(DMCONTEXT *dmCtx)
 {
+	monitoring_full_report_ts = ev_now(dmCtx->ev);
+	monitor_init();
+
 	if (report_system_monitoring_info(dmCtx, true) != RC_OK) {
 		logx(LOG_WARNING, "Failed to report system information.");
 		return RC_ERR_MISC;
 	}
 
 	ev_timer_init(&monitoring_timer, report_system_monitoring_timer_cb,
-		      	  5, SYSTEM_MONITORING_REPORT_INTERVAL_S);
+		      monitoring_interval, monitoring_interval);
 	monitoring_timer.data = dmCtx;
 	ev_timer_start(dmCtx->ev, &monitoring_timer);
 
 	return RC_OK;
 }
 
-static uint32_t
-socketConnected(DMCONFIG_EVENT event, DMCONTEXT *dmCtx, void *userdata __attribute__ ((unused)))
+/**
+ * Time at which the connection to mand was initiated.
+ */
+static ev_tstamp connect_ts;
+/**
+ * Time at which the connection to mand was established.
+ */
+static ev_tstamp connected_ts;
+
+/**
+ * Delay before the first attempt to reconnect to mand.
+ * It is doubled after every failed attempt, up to RECONNECT_DELAY_MAX_S,
+ * and reset once the startup pipeline completed.
+ */
+#define RECONNECT_DELAY_MIN_S 0.5
+#define RECONNECT_DELAY_MAX_S 30.
+
+static ev_timer reconnect_timer;
+static ev_tstamp reconnect_delay = RECONNECT_DELAY_MIN_S;
+
+static void comm_connect(struct ev_loop *loop, DMCONTEXT *dmCtx);
+
+static void
+reconnect_cb(EV_P_ ev_timer *w, int revents __attribute__((unused)))
 {
-	uint32_t rc;
+	comm_connect(EV_A_ w->data);
+}
 
-	if (event != DMCONFIG_CONNECTED) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-	        CB_ERR_RET(RC_ERR_MISC, "Connecting socket unsuccessful.");
+static void
+reconnect_schedule(struct ev_loop *loop, DMCONTEXT *dmCtx)
+{
+	logx(LOG_NOTICE, "Reconnecting to mand in %.1f s.", reconnect_delay);
+
+	ev_timer_stop(loop, &reconnect_timer);
+	ev_timer_init(&reconnect_timer, reconnect_cb, reconnect_delay, 0.);
+	reconnect_timer.data = dmCtx;
+	ev_timer_start(loop, &reconnect_timer);
+
+	reconnect_delay = MIN(reconnect_delay * 2, RECONNECT_DELAY_MAX_S);
+}
+
+/**
+ * Stops everything that uses the connection to mand and reconnects.
+ *
+ * Pending requests are answered with an error event by libdmconfig,
+ * so this is usually called many times per lost connection.
+ * Only the first call has an effect.
+ *
+ * The in-memory state (netlink caches, the Sparkplug cache and the
+ * hashes of the applied configuration) is kept: the startup pipeline
+ * lists all subsystems again, but only those that changed while we
+ * were disconnected are applied.
+ *
+ * @param dmCtx The libdmconfig context.
+ * @param shutdown Whether the connection is still open and must be
+ *                 shut down, i.e. it was not closed by libdmconfig.
+ */
+static void
+connection_lost(DMCONTEXT *dmCtx, bool shutdown)
+{
+	if (!dm_connected)
+		return;
+	dm_connected = false;
+
+	logx(LOG_WARNING, "Connection to mand lost.");
+	stats_error();
+
+	ev_timer_stop(dmCtx->ev, &monitoring_timer);
+
+	if_state_push_enabled = false;
+	if_state_ndirty = 0;
+	if_state_all_dirty = false;
+	ev_timer_stop(dmCtx->ev, &if_state_timer);
+
+	notify_dirty = 0;
+	ev_timer_stop(dmCtx->ev, &notify_debounce_timer);
+
+	/* the answers of running lists are lost, see apply_run_queued() */
+	for (int i = 0; i < APPLY_SUBSYSTEMS; i++) {
+		apply_tasks[i].running = false;
+		apply_tasks[i].queued = false;
+		apply_tasks[i].if_flags = 0;
 	}
 
-	logx(LOG_DEBUG, "Socket connected.");
+	if (shutdown)
+		dm_context_shutdown(dmCtx, DMCONFIG_OK);
+
+	reconnect_schedule(dmCtx->ev, dmCtx);
+}
 
-	if ((rc = rpc_startsession(dmCtx, CMD_FLAG_READWRITE, 0, NULL)) != RC_OK) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-	        CB_ERR_RET(rc, "Couldn't register start session request, rc=%d.", rc);
+static void
+sessionRequestReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
+{
+	const char *request = userdata;
+	uint32_t rc, answer_rc;
+
+	if (event != DMCONFIG_ANSWER_READY) {
+		connection_lost(dmCtx, false);
+		CB_ERR("%s request failed, ev=%d.", request, event);
 	}
 
-	logx(LOG_DEBUG, "Start session request registered.");
+	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
+	    || answer_rc != RC_OK) {
+		connection_lost(dmCtx, true);
+		CB_ERR("%s request failed, rc=%d,%d.", request, rc, answer_rc);
+	}
+
+	logx(LOG_DEBUG, "%s request successful.", request);
+}
+
+static void
+leafNotifyReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
+{
+	const char *path = userdata;
+	uint32_t rc = RC_ERR_MISC, answer_rc = RC_ERR_MISC;
+
+	if (event == DMCONFIG_ANSWER_READY)
+		rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc);
+
+	if (rc == RC_OK && answer_rc == RC_OK)
+		logx(LOG_DEBUG, "Registered notification for \"%s\".", path);
+	else
+		logx(LOG_INFO, "Couldn't register notification for \"%s\", rc=%d,%d.",
+		     path, rc, answer_rc);
+}
+
+/**
+ * Registers the notification of one leaf by its own request.
+ */
+static void
+register_leaf_notify(DMCONTEXT *dmCtx, const struct notify_leaf *leaf)
+{
+	const char *path = leaf->path;
+	uint32_t rc;
+
+	if (leaf->table)
+		rc = rpc_recursive_param_notify_async(dmCtx, NOTIFY_ACTIVE, path,
+		                                      leafNotifyReceived, (void *)path);
+	else
+		rc = rpc_param_notify_async(dmCtx, NOTIFY_ACTIVE, 1, &path,
+		                            leafNotifyReceived, (void *)path);
+	if (rc != RC_OK)
+		logx(LOG_WARNING, "Couldn't register notification for \"%s\", rc=%d.",
+		     path, rc);
+}
+
+/**
+ * Leaves of a module that are registered by the module's request,
+ * see register_module_notify().
+ */
+static inline bool
+notify_leaf_bundled(const struct notify_leaf *leaf)
+{
+	return !leaf->table && !leaf->optional;
+}
+
+/**
+ * Answer of the request registering the leaves of a module.
+ *
+ * mand rejects the whole request if any of the paths does not exist,
+ * e.g. with an older revision of the module, so the leaves are then
+ * registered one by one and only the missing ones fail.
+ */
+static void
+moduleNotifyReceived(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp, void *userdata)
+{
+	const struct notify_leaf *first = userdata;
+	const struct notify_leaf *end = notify_leaves + NOTIFY_LEAVES;
+	uint32_t rc, answer_rc;
 
-	if ((rc = rpc_register_role(dmCtx, "-state")) != RC_OK) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-	        CB_ERR_RET(rc, "Couldn't register role, rc=%d.", rc);
+	/* the next connection registers the module again */
+	if (event != DMCONFIG_ANSWER_READY) {
+		logx(LOG_INFO, "Couldn't register notifications for \"%s\", ev=%d.",
+		     first->module, event);
+		return;
 	}
-	logx(LOG_DEBUG, "Role registered.");
 
-	if ((rc = rpc_subscribe_notify(dmCtx, NULL)) != RC_OK) {
-		ev_break(dmCtx->ev, EVBREAK_ALL);
-	        CB_ERR_RET(rc, "Couldn't register SUBSCRIBE NOTIFY request, rc=%d.", rc);
+	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) == RC_OK &&
+	    answer_rc == RC_OK) {
+		logx(LOG_INFO, "Registered notifications for \"%s\".", first->module);
+		return;
 	}
-	logx(LOG_DEBUG, "Notification subscription request registered.");
 
-	if (init_hostname(dmCtx) != RC_OK)
-		logx(LOG_WARNING, "Initial update of Hostname failed.");
+	logx(LOG_INFO, "Couldn't register notifications for \"%s\", rc=%d,%d, "
+	     "registering its leaves individually.", first->module, rc, answer_rc);
 
-	if (init_timezone(dmCtx) != RC_OK)
-		logx(LOG_WARNING, "Initial update of Timezone failed.");
+	for (const struct notify_leaf *leaf = first;
+	     leaf < end && leaf->module && !strcmp(leaf->module, first->module); leaf++)
+		if (notify_leaf_bundled(leaf))
+			register_leaf_notify(dmCtx, leaf);
+}
 
-	if (init_system_monitoring(dmCtx) != RC_OK)
-		logx(LOG_WARNING, "Initial update of system monitoring failed.");
+/**
+ * Registers the notifications of the optional Yang modules, see notify_leaves.
+ *
+ * They are not part of the Metropolis base profile, so we must
+ * be prepared to handle missing nodes.
+ * This helps to avoid a new image-specific compile-time option.
+ * Each module is registered by its own requests, so a missing
+ * module does not affect the others.
+ */
+static void
+register_module_notify(DMCONTEXT *dmCtx)
+{
+	for (size_t i = 0; i < NOTIFY_LEAVES; ) {
+		const struct notify_leaf *first = notify_leaves + i;
+		const char *paths[NOTIFY_LEAVES];
+		int count = 0;
+		uint32_t rc;
+
+		if (!first->module) {
+			i++;
+			continue;
+		}
 
-	/*
-	 * This requires the optional metropolis-ptp Yang module.
-	 * It is not part of the Metropolis base profile, so we must be prepared to handle
-	 * missing nodes.
-	 * This helps to avoid a new image-specific compile-time option.
-	 *
-	 * NOTE: PTP does not have its own action table.
-	 */
-	rc = rpc_recursive_param_notify(dmCtx, NOTIFY_ACTIVE, "system.ptp", NULL);
-	logx(LOG_INFO, "Registered recursive notification for \"system.ptp\", rc=%d.", rc);
+		for (; i < NOTIFY_LEAVES && notify_leaves[i].module &&
+		       !strcmp(notify_leaves[i].module, first->module); i++) {
+			const struct notify_leaf *leaf = notify_leaves + i;
 
-	/*
-	 * Requires the optional metropolis-pulsarlr Yang module.
-	 */
-	rc = rpc_recursive_param_notify(dmCtx, NOTIFY_ACTIVE, "pulsarlr", NULL);
-	logx(LOG_INFO, "Registered recursive notification for \"pulsarlr\", rc=%d.", rc);
+			if (notify_leaf_bundled(leaf))
+				paths[count++] = leaf->path;
+			else
+				register_leaf_notify(dmCtx, leaf);
+		}
 
-	/*
-	 * Requires the optional metropolis-sparkplug Yang module.
-	 */
-	rc = rpc_recursive_param_notify(dmCtx, NOTIFY_ACTIVE, "sparkplug", NULL);
-	logx(LOG_INFO, "Registered recursive notification for \"sparkplug\", rc=%d.", rc);
+		if (!count)
+			continue;
 
-	/*
-	 * Requires the optional metropolis-wwan Yang module.
-	 */
-	rc = rpc_recursive_param_notify(dmCtx, NOTIFY_ACTIVE, "wwan", NULL);
-	logx(LOG_INFO, "Registered recursive notification for \"wwan\", rc=%d.", rc);
+		rc = rpc_param_notify_async(dmCtx, NOTIFY_ACTIVE, count, paths,
+		                            moduleNotifyReceived, (void *)first);
+		if (rc != RC_OK)
+			logx(LOG_WARNING, "Couldn't register notifications for \"%s\", rc=%d.",
+			     first->module, rc);
+	}
+}
+
+/**
+ * Answer of the last request of the startup pipeline.
+ *
+ * mand answers the requests of a connection in order, so at this point
+ * all previous startup requests have been answered and the initial
+ * configuration has been applied.
+ */
+static void
+startupCompleted(DMCONTEXT *dmCtx, DMCONFIG_EVENT event, DM2_AVPGRP *grp,
+                 void *userdata __attribute__((unused)))
+{
+	uint32_t rc, answer_rc;
+	ev_tstamp now = ev_time();
+
+	if (event != DMCONFIG_ANSWER_READY) {
+		connection_lost(dmCtx, false);
+	        CB_ERR("Couldn't register PARAM NOTIFY request, ev=%d.", event);
+	}
+
+	if ((rc = dm_expect_uint32_type(grp, AVP_RC, VP_TRAVELPING, &answer_rc)) != RC_OK
+	    || answer_rc != RC_OK) {
+		connection_lost(dmCtx, true);
+	        CB_ERR("Couldn't register PARAM NOTIFY request, rc=%d,%d.", rc, answer_rc);
+	}
+
+	logx(LOG_NOTICE, "Ready after %.0f ms (connected after %.0f ms)",
+	     (now - connect_ts) * 1000., (connected_ts - connect_ts) * 1000.);
+	reconnect_delay = RECONNECT_DELAY_MIN_S;
 
 	/*
-	 * Requires the optional metropolis-wifi Yang module.
+	 * Push interface state changes from now on,
+	 * starting with the current state of all interfaces.
 	 */
-	rc = rpc_recursive_param_notify(dmCtx, NOTIFY_ACTIVE, "wifi", NULL);
-	logx(LOG_INFO, "Registered recursive notification for \"wifi\", rc=%d.", rc);
+	if (netlink_link_cache()) {
+		if_state_push_enabled = true;
+		if_state_changed(0, 0, dmCtx);
+	}
+}
+
+static uint32_t
+socketConnected(DMCONFIG_EVENT event, DMCONTEXT *dmCtx, void *userdata __attribute__ ((unused)))
+{
+	const char *notify_paths[NOTIFY_LEAVES];
+	size_t notify_count = 0;
+	uint32_t rc;
+
+	connected_ts = ev_time();
+
+	if (event != DMCONFIG_CONNECTED) {
+		dm_context_shutdown(dmCtx, DMCONFIG_ERROR_CONNECTING);
+		reconnect_schedule(dmCtx->ev, dmCtx);
+	        CB_ERR_RET(RC_ERR_MISC, "Connecting socket unsuccessful.");
+	}
+
+	logx(LOG_DEBUG, "Socket connected.");
+	dm_connected = true;
 
 	/*
+	 * All startup requests are sent back-to-back without waiting for
+	 * the previous answers.
+	 * mand processes the requests of a connection in order, so the
+	 * session exists before any of the following requests are handled.
+	 *
 	 * NOTE: Beginning with the first asynchronous method call, we must no longer
 	 * call synchronous versions.
 	 */
+	if ((rc = rpc_startsession_async(dmCtx, CMD_FLAG_READWRITE, 0,
+	                                 sessionRequestReceived, "Start session")) != RC_OK ||
+	    (rc = rpc_register_role_async(dmCtx, "-state",
+	                                  sessionRequestReceived, "Register role")) != RC_OK ||
+	    (rc = rpc_subscribe_notify_async(dmCtx, sessionRequestReceived,
+	                                     "Subscribe notify")) != RC_OK) {
+		connection_lost(dmCtx, true);
+	        CB_ERR_RET(rc, "Couldn't register session requests, rc=%d.", rc);
+	}
+	logx(LOG_DEBUG, "Session requests registered.");
+
+	if (init_system_state(dmCtx) != RC_OK)
+		logx(LOG_WARNING, "Initial update of Hostname/Timezone failed.");
+
+	if (init_system_monitoring(dmCtx) != RC_OK)
+		logx(LOG_WARNING, "Initial update of system monitoring failed.");
+
+	register_module_notify(dmCtx);
+
+	snapshot_rearm();
 	listSystemNtp(dmCtx);
 	listSystemPtp(dmCtx);
 	listSystemDns(dmCtx);
@@ -1659,12 +3729,47 @@ socketConnected(DMCONFIG_EVENT event, DMCONTEXT *dmCtx, void *userdata __attribu
 	listWWAN(dmCtx);
 	listWifi(dmCtx);
 
+	/*
+	 * This is the last request of the pipeline, see startupCompleted().
+	 */
+	for (size_t i = 0; i < NOTIFY_LEAVES; i++)
+		if (!notify_leaves[i].module)
+			notify_paths[notify_count++] = notify_leaves[i].path;
+
+	if ((rc = rpc_param_notify_async(dmCtx, NOTIFY_ACTIVE, notify_count, notify_paths,
+	                                 startupCompleted, NULL)) != RC_OK) {
+		connection_lost(dmCtx, true);
+		CB_ERR_RET(rc, "Couldn't register PARAM NOTIFY request, rc=%d.", rc);
+	}
+
 	return RC_OK;
 }
 
-void init_comm(struct ev_loop *loop)
+/**
+ * Connects to mand, retried by reconnect_schedule() until it succeeds.
+ *
+ * The context is reused for every connection, so the watchers and callbacks
+ * referring to it remain valid.
+ */
+static void
+comm_connect(struct ev_loop *loop, DMCONTEXT *dmCtx)
 {
 	uint32_t rc;
+
+	connect_ts = ev_time();
+	dm_context_init(dmCtx, loop, AF_INET, NULL, socketConnected, request_cb);
+
+	if ((rc = dm_connect_async(dmCtx)) != RC_OK) {
+	        logx(LOG_WARNING, "Couldn't register connect callback or connecting unsuccessful, rc=%d.", rc);
+		dm_context_shutdown(dmCtx, DMCONFIG_ERROR_CONNECTING);
+		reconnect_schedule(loop, dmCtx);
+	        return;
+	}
+	logx(LOG_DEBUG, "Connect callback registered.");
+}
+
+void init_comm(struct ev_loop *loop)
+{
 	DMCONTEXT *ctx;
 
 	if (!(ctx = dm_context_new())) {
@@ -1672,14 +3777,18 @@ void init_comm(struct ev_loop *loop)
 	        return;
 	}
 
-	dm_context_init(ctx, loop, AF_INET, NULL, socketConnected, request_cb);
+	ev_init(&notify_debounce_timer, notify_debounce_cb);
+	notify_index_init();
+	snapshot_load();
+	ev_init(&if_state_timer, if_state_push_cb);
 
-	/* connect */
-	if ((rc = dm_connect_async(ctx)) != RC_OK) {
-	        logx(LOG_DEBUG, "Couldn't register connect callback or connecting unsuccessful, rc=%d.", rc);
-		dm_context_shutdown(ctx, DMCONFIG_ERROR_CONNECTING);
-		dm_context_release(ctx);
-	        return;
-	}
-	logx(LOG_DEBUG, "Connect callback registered.");
+	if ((ctrl_sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_IP)) < 0)
+		logx(LOG_WARNING, "Cannot create control socket: %s", strerror(errno));
+
+	if (netlink_init(loop) < 0)
+		logx(LOG_ERR, "Interface state will not be available.");
+	else
+		netlink_set_change_cb(if_state_changed, ctx);
+
+	comm_connect(loop, ctx);
 }
@@ -5,6 +5,20 @@
 #ifndef __COMM_H
 #define __COMM_H
 
+#define NOTIFY_DEBOUNCE_DEFAULT_S 0.5
+
+/** Seconds to collect active notifications before applying them */
+extern ev_tstamp notify_debounce;
+
+#define MONITORING_INTERVAL_DEFAULT_S 10.
+#define MONITORING_THRESHOLD_DEFAULT 5
+
+/** Seconds between samples of the monitored system parameters */
+extern ev_tstamp monitoring_interval;
+/** Minimum change (in percent) of monitored values to be reported */
+extern unsigned int monitoring_threshold;
+
 void init_comm(struct ev_loop *lopp);
+void comm_log_stats(void);
 
 #endif
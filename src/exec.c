@@ -0,0 +1,203 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/queue.h>
+
+#include <ev.h>
+
+#include "exec.h"
+#include "stats.h"
+#include "log.h"
+
+extern char **environ;
+
+/**
+ * A shell command executed asynchronously.
+ *
+ * Commands of the same lane are executed one after another in the order
+ * they were queued, so the ordering of their side effects is the same
+ * as with system().
+ * Different lanes run concurrently and the event loop is never blocked
+ * while a command runs.
+ */
+struct exec_job {
+	TAILQ_ENTRY(exec_job) entry;
+
+	char *cmd;
+	EXEC_CB cb;
+	void *data;
+
+	/** time the command was queued, see stats_now() */
+	uint64_t start;
+};
+
+/**
+ * A queue of commands with at most one running command.
+ */
+struct exec_lane {
+	LIST_ENTRY(exec_lane) entry;
+
+	char *name;
+	TAILQ_HEAD(exec_queue, exec_job) queue;
+	ev_child watcher;
+};
+
+/*
+ * Lanes are not freed, since there is only one per unit or subsystem.
+ */
+static LIST_HEAD(exec_lanes, exec_lane) exec_lanes = LIST_HEAD_INITIALIZER(exec_lanes);
+
+static struct ev_loop *exec_loop;
+
+static void exec_next(struct exec_lane *lane);
+
+static void
+exec_done(struct exec_lane *lane, struct exec_job *job, int status)
+{
+	TAILQ_REMOVE(&lane->queue, job, entry);
+	stats_record(STATS_EXEC, job->start, status != 0);
+
+	if (status < 0)
+		logx(LOG_ERR, "cmd=[%s] could not be started", job->cmd);
+	else if (WIFEXITED(status))
+		logx(LOG_INFO, "cmd=[%s], rc=%d", job->cmd, WEXITSTATUS(status));
+	else if (WIFSIGNALED(status))
+		logx(LOG_WARNING, "cmd=[%s] killed by signal %d", job->cmd, WTERMSIG(status));
+
+	if (job->cb)
+		job->cb(status, job->data);
+
+	free(job->cmd);
+	free(job);
+}
+
+static void
+exec_child_cb(EV_P_ ev_child *w, int revents)
+{
+	struct exec_lane *lane = w->data;
+
+	ev_child_stop(EV_A_ w);
+
+	exec_done(lane, TAILQ_FIRST(&lane->queue), w->rstatus);
+	exec_next(lane);
+}
+
+/**
+ * Start the first queued command of a lane unless one is already running.
+ */
+static void
+exec_next(struct exec_lane *lane)
+{
+	struct exec_job *job;
+
+	while (!ev_is_active(&lane->watcher) &&
+	       (job = TAILQ_FIRST(&lane->queue))) {
+		char *argv[] = {"/bin/sh", "-c", job->cmd, NULL};
+		pid_t pid;
+		int rc;
+
+		logx(LOG_DEBUG, "cmd=[%s]", job->cmd);
+
+		if ((rc = posix_spawn(&pid, argv[0], NULL, NULL, argv, environ)) != 0) {
+			logx(LOG_ERR, "cmd=[%s], error=%s", job->cmd, strerror(rc));
+			exec_done(lane, job, -1);
+			continue;
+		}
+
+		ev_child_set(&lane->watcher, pid, 0);
+		ev_child_start(exec_loop, &lane->watcher);
+	}
+}
+
+static struct exec_lane *
+exec_lane_get(const char *name)
+{
+	struct exec_lane *lane;
+
+	LIST_FOREACH(lane, &exec_lanes, entry)
+		if (!strcmp(lane->name, name))
+			return lane;
+
+	if (!(lane = calloc(1, sizeof(struct exec_lane))))
+		return NULL;
+	if (!(lane->name = strdup(name))) {
+		free(lane);
+		return NULL;
+	}
+	TAILQ_INIT(&lane->queue);
+	ev_child_init(&lane->watcher, exec_child_cb, 0, 0);
+	lane->watcher.data = lane;
+
+	LIST_INSERT_HEAD(&exec_lanes, lane, entry);
+	return lane;
+}
+
+/**
+ * Queue a shell command for asynchronous execution in a lane.
+ *
+ * @param lane_name Name of the lane, e.g. the name of the affected unit.
+ * @param cmd The command line, interpreted by /bin/sh.
+ * @param cb Completion callback or NULL.
+ * @param data User data for the callback.
+ * @returns 0 on success, -1 if the command could not be queued.
+ */
+int exec_async_lane(const char *lane_name, const char *cmd, EXEC_CB cb, void *data)
+{
+	struct exec_lane *lane;
+	struct exec_job *job;
+
+	if (!(lane = exec_lane_get(lane_name)) ||
+	    !(job = calloc(1, sizeof(struct exec_job))))
+		return -1;
+
+	if (!(job->cmd = strdup(cmd))) {
+		free(job);
+		return -1;
+	}
+	job->cb = cb;
+	job->data = data;
+	job->start = stats_now();
+
+	TAILQ_INSERT_TAIL(&lane->queue, job, entry);
+	exec_next(lane);
+
+	return 0;
+}
+
+/**
+ * Queue a shell command for asynchronous execution.
+ *
+ * All commands queued with this function run in the same lane.
+ *
+ * @param cmd The command line, interpreted by /bin/sh.
+ * @param cb Completion callback or NULL.
+ * @param data User data for the callback.
+ * @returns 0 on success, -1 if the command could not be queued.
+ */
+int exec_async(const char *cmd, EXEC_CB cb, void *data)
+{
+	return exec_async_lane("", cmd, cb, data);
+}
+
+/**
+ * Initialize the asynchronous command executor.
+ *
+ * @param loop The event loop. Since child watchers are only supported
+ *             by libev's default loop, this must be the default loop.
+ */
+void init_exec(struct ev_loop *loop)
+{
+	exec_loop = loop;
+}
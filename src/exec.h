@@ -0,0 +1,23 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __EXEC_H
+#define __EXEC_H
+
+#include <ev.h>
+
+/**
+ * Completion callback of an asynchronous command.
+ *
+ * @param status Exit status as returned by waitpid(),
+ *               -1 if the command could not be started.
+ * @param data User data passed to exec_async().
+ */
+typedef void (*EXEC_CB)(int status, void *data);
+
+void init_exec(struct ev_loop *loop);
+int exec_async(const char *cmd, EXEC_CB cb, void *data);
+int exec_async_lane(const char *lane, const char *cmd, EXEC_CB cb, void *data);
+
+#endif
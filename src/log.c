@@ -0,0 +1,278 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <ev.h>
+
+#include "log.h"
+
+/*
+ * Writing a message to syslog (and with -l, sending it to the remote
+ * syslog server) happens in the calling thread, so a handler logging a
+ * few lines adds the cost of every write to its answer.
+ * Messages are therefore formatted into a ring buffer by the caller and
+ * written after the loop has processed all pending events.
+ *
+ * The ring buffer is a bounded multi-producer single-consumer queue:
+ * producers (the loop thread and the worker threads) claim a slot by
+ * advancing log_head and publish it by setting its sequence number,
+ * the loop thread consumes slots in order from log_tail.
+ */
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 128		/* must be a power of 2 */
+#endif
+
+#define LOG_MSG_MAX 512
+
+/* every call site may log LOG_RATE_BURST messages every LOG_RATE_INTERVAL seconds */
+#ifndef LOG_RATE_BURST
+#define LOG_RATE_BURST 20
+#endif
+#ifndef LOG_RATE_INTERVAL
+#define LOG_RATE_INTERVAL 10
+#endif
+
+struct log_slot {
+	unsigned int seq;
+	int level;
+	char msg[LOG_MSG_MAX];
+};
+
+static struct log_slot log_ring[LOG_RING_SIZE];
+static unsigned int log_head;
+static unsigned int log_tail;		/* only used by the loop thread */
+static unsigned int log_dropped;
+
+static struct ev_loop *log_loop;
+static pthread_t log_thread;
+static ev_prepare log_prepare;
+static ev_async log_async;
+
+static inline bool
+log_on_loop_thread(void)
+{
+	return log_loop && pthread_equal(pthread_self(), log_thread);
+}
+
+/**
+ * Claim the next free slot of the ring buffer.
+ *
+ * @param pos Set to the position of the slot, passed to log_publish().
+ * @returns The slot or NULL if the ring buffer is full.
+ */
+static struct log_slot *
+log_claim(unsigned int *pos)
+{
+	unsigned int head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+
+	for (;;) {
+		struct log_slot *slot = &log_ring[head & (LOG_RING_SIZE - 1)];
+		int diff = (int)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - head);
+
+		if (diff < 0)
+			return NULL;
+
+		/* on failure, head is updated to the current value */
+		if (diff == 0 &&
+		    __atomic_compare_exchange_n(&log_head, &head, head + 1, true,
+		                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			*pos = head;
+			return slot;
+		}
+
+		if (diff > 0)
+			head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+	}
+}
+
+static void
+log_publish(struct log_slot *slot, unsigned int pos)
+{
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (!log_on_loop_thread())
+		ev_async_send(log_loop, &log_async);
+}
+
+/**
+ * Write all queued messages.
+ *
+ * Only the loop thread consumes the ring buffer, calls from other
+ * threads are ignored.
+ */
+void
+log_flush(void)
+{
+	unsigned int dropped;
+
+	if (!log_on_loop_thread())
+		return;
+
+	for (;;) {
+		struct log_slot *slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_tail + 1)
+			break;
+
+		(logx)(slot->level, "%s", slot->msg);
+
+		__atomic_store_n(&slot->seq, log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+		log_tail++;
+	}
+
+	if ((dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED)))
+		(logx)(LOG_WARNING, "Log buffer full, %u messages dropped", dropped);
+}
+
+static void
+log_prepare_cb(EV_P_ ev_prepare *w __attribute__((unused)),
+               int revents __attribute__((unused)))
+{
+	log_flush();
+}
+
+static void
+log_async_cb(EV_P_ ev_async *w __attribute__((unused)),
+             int revents __attribute__((unused)))
+{
+	/* nothing to do, log_prepare_cb() runs before the loop blocks again */
+}
+
+static unsigned long
+log_window(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec / LOG_RATE_INTERVAL;
+}
+
+/**
+ * Check the rate limit of a call site.
+ *
+ * The counters are updated without a lock, concurrent calls from
+ * different threads may let a message more or less through.
+ *
+ * @param site Rate limiting state of the call site.
+ * @param suppressed Set to the number of messages dropped since the
+ *                   last one that was logged.
+ * @returns true if the message should be logged.
+ */
+static bool
+log_ratelimit(struct log_site *site, unsigned int *suppressed)
+{
+	unsigned long window = log_window();
+
+	*suppressed = 0;
+	if (__atomic_load_n(&site->window, __ATOMIC_RELAXED) != window) {
+		__atomic_store_n(&site->window, window, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+	}
+
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > LOG_RATE_BURST) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	*suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+	return true;
+}
+
+static void
+log_format(char *buf, size_t size, unsigned int suppressed, const char *fmt, va_list ap)
+{
+	int len;
+
+	len = vsnprintf(buf, size, fmt, ap);
+	if (suppressed && len >= 0 && (size_t)len < size)
+		snprintf(buf + len, size - len, " (%u similar messages suppressed)", suppressed);
+}
+
+/**
+ * Queue a message, use the logx() macro instead of calling this directly.
+ *
+ * Before init_log() the message is written synchronously.
+ * If the ring buffer is full, the loop thread flushes it first while
+ * the messages of other threads are dropped and counted.
+ *
+ * @param site Rate limiting state of the call site.
+ * @param level Syslog level of the message.
+ * @param fmt printf() style format of the message.
+ */
+void
+log_submit(struct log_site *site, int level, const char *fmt, ...)
+{
+	struct log_slot *slot;
+	unsigned int suppressed;
+	unsigned int pos;
+	va_list ap;
+
+	if (!log_ratelimit(site, &suppressed))
+		return;
+
+	va_start(ap, fmt);
+
+	if (!log_loop) {
+		char buf[LOG_MSG_MAX];
+
+		log_format(buf, sizeof(buf), suppressed, fmt, ap);
+		(logx)(level, "%s", buf);
+		goto out;
+	}
+
+	if (!(slot = log_claim(&pos)) && log_on_loop_thread()) {
+		log_flush();
+		slot = log_claim(&pos);
+	}
+
+	if (slot) {
+		slot->level = level;
+		log_format(slot->msg, sizeof(slot->msg), suppressed, fmt, ap);
+		log_publish(slot, pos);
+	} else
+		__atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+
+out:
+	va_end(ap);
+}
+
+static void
+log_exit(void)
+{
+	log_flush();
+}
+
+/**
+ * Start writing messages from the event loop.
+ *
+ * Must be called by the loop thread, before any worker thread is started.
+ */
+void
+init_log(struct ev_loop *loop)
+{
+	for (unsigned int i = 0; i < LOG_RING_SIZE; i++)
+		log_ring[i].seq = i;
+
+	ev_prepare_init(&log_prepare, log_prepare_cb);
+	ev_prepare_start(loop, &log_prepare);
+	ev_async_init(&log_async, log_async_cb);
+	ev_async_start(loop, &log_async);
+
+	log_thread = pthread_self();
+	log_loop = loop;
+
+	/* messages logged right before exit() */
+	atexit(log_exit);
+}
@@ -0,0 +1,41 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __LOG_H
+#define __LOG_H
+
+#include <ev.h>
+
+#include <mand/logx.h>
+
+/**
+ * Rate limiting state of a single logx() call site.
+ */
+struct log_site {
+	unsigned long window;		/**< rate limiting interval of count */
+	unsigned int count;		/**< messages logged in window */
+	unsigned int suppressed;	/**< messages dropped since the last one logged */
+};
+
+void init_log(struct ev_loop *loop);
+void log_flush(void);
+void log_submit(struct log_site *site, int level, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+
+/*
+ * Replaces the logx() of libmand for all of our sources.
+ *
+ * The level is checked before the arguments are evaluated, so disabled
+ * debug messages cost no more than a comparison.  Enabled messages are
+ * queued and written from the event loop, see log.c.
+ */
+#define logx(level, ...)						\
+	do {								\
+		static struct log_site __log_site;			\
+									\
+		if ((level) <= logx_level)				\
+			log_submit(&__log_site, (level), __VA_ARGS__);	\
+	} while (0)
+
+#endif
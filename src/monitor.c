@@ -0,0 +1,310 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/sysinfo.h>
+
+#include "monitor.h"
+#include "log.h"
+
+#define KILOBYTES_PER_MEGABYTE 1024U
+
+/**
+ * CPU time counters of one line of /proc/stat.
+ */
+struct cpu_times {
+	uint64_t busy;
+	uint64_t total;
+};
+
+/**
+ * Counters of the previous sample.
+ * Index 0 is the aggregated "cpu" line, index n + 1 is "cpu<n>".
+ */
+static struct cpu_times prev_times[MONITOR_MAX_CPUS + 1];
+
+static FILE *proc_stat;
+static FILE *proc_meminfo;
+
+/**
+ * A temperature sensor file in sysfs.
+ *
+ * The files are opened once by monitor_init() and re-read with pread(),
+ * which makes sysfs return the current value.
+ */
+struct sensor {
+	char *name;
+	int fd;
+};
+
+static struct sensor sensors[MONITOR_MAX_SENSORS];
+static unsigned int nsensors;
+
+/**
+ * (Re)open a file in /proc for repeated reading.
+ *
+ * The file is kept open, rewinding it makes the kernel regenerate
+ * its content.
+ */
+static FILE *
+proc_rewind(FILE **f, const char *path)
+{
+	if (*f) {
+		rewind(*f);
+		return *f;
+	}
+
+	if (!(*f = fopen(path, "r")))
+		logx(LOG_WARNING, "Cannot open %s: %s", path, strerror(errno));
+
+	return *f;
+}
+
+static uint32_t
+cpu_usage(const struct cpu_times *cur, const struct cpu_times *prev)
+{
+	uint64_t total = cur->total - prev->total;
+
+	if (!total || cur->total < prev->total || cur->busy < prev->busy)
+		return 0;
+
+	return (uint32_t)((cur->busy - prev->busy) * 100 / total);
+}
+
+/**
+ * Compute the CPU utilisation from the /proc/stat deltas.
+ *
+ * The very first sample reports the utilisation since boot.
+ */
+static int
+sample_cpu(struct monitor_sample *sample)
+{
+	char line[256];
+	FILE *f;
+	unsigned int n = 0;
+
+	if (!(f = proc_rewind(&proc_stat, "/proc/stat")))
+		return -1;
+
+	while (fgets(line, sizeof(line), f) && n <= MONITOR_MAX_CPUS) {
+		uint64_t user, nice, system, idle, iowait = 0, irq = 0, softirq = 0, steal = 0;
+		struct cpu_times cur;
+		unsigned int cpu = 0;
+		char *p;
+
+		if (strncmp(line, "cpu", 3) != 0)
+			/* the cpu lines come first */
+			break;
+
+		p = line + 3;
+		if (*p != ' ') {
+			cpu = strtoul(p, &p, 10) + 1;
+			if (cpu > MONITOR_MAX_CPUS)
+				continue;
+		}
+
+		if (sscanf(p, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+		              " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+		           &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) < 4)
+			continue;
+
+		/* guest time is already accounted in user and nice */
+		cur.busy = user + nice + system + irq + softirq + steal;
+		cur.total = cur.busy + idle + iowait;
+
+		if (cpu == 0)
+			sample->cpu_usage = cpu_usage(&cur, prev_times);
+		else
+			sample->cpu_core_usage[cpu - 1] = cpu_usage(&cur, prev_times + cpu);
+
+		prev_times[cpu] = cur;
+		if (cpu > n)
+			n = cpu;
+	}
+
+	sample->cpus = n;
+	return 0;
+}
+
+/**
+ * Determine the memory usage from /proc/meminfo.
+ *
+ * MemAvailable includes reclaimable memory like the page cache,
+ * so it is a better measure than the free RAM reported by sysinfo().
+ * If missing (Linux < 3.14), the free RAM is used instead.
+ */
+static int
+sample_memory(struct monitor_sample *sample)
+{
+	char line[128];
+	unsigned long long total = 0, available = 0, value;
+	bool have_available = false;
+	FILE *f;
+
+	if ((f = proc_rewind(&proc_meminfo, "/proc/meminfo"))) {
+		while (fgets(line, sizeof(line), f)) {
+			if (sscanf(line, "MemTotal: %llu kB", &value) == 1) {
+				total = value;
+			} else if (sscanf(line, "MemAvailable: %llu kB", &value) == 1) {
+				available = value;
+				have_available = true;
+				break;
+			}
+		}
+	}
+
+	if (!total || !have_available) {
+		struct sysinfo info;
+
+		if (sysinfo(&info) != 0) {
+			logx(LOG_WARNING, "Failed to read sysinfo: %s.", strerror(errno));
+			return -1;
+		}
+
+		total = (unsigned long long)info.totalram * info.mem_unit / 1024;
+		available = (unsigned long long)info.freeram * info.mem_unit / 1024;
+	}
+
+	if (!total)
+		return -1;
+
+	sample->mem_total = (uint32_t)(total / KILOBYTES_PER_MEGABYTE);
+	sample->mem_used = (uint32_t)((total - available) / KILOBYTES_PER_MEGABYTE);
+	sample->mem_free_perc = (uint32_t)(available * 100 / total);
+
+	return 0;
+}
+
+static void
+add_sensors(const char *pattern)
+{
+	glob_t g;
+
+	if (glob(pattern, 0, NULL, &g) != 0)
+		return;
+
+	for (size_t i = 0; i < g.gl_pathc && nsensors < MONITOR_MAX_SENSORS; i++) {
+		int fd = open(g.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0) {
+			logx(LOG_DEBUG, "Cannot open %s: %s", g.gl_pathv[i], strerror(errno));
+			continue;
+		}
+
+		if (!(sensors[nsensors].name = strdup(g.gl_pathv[i]))) {
+			close(fd);
+			break;
+		}
+		sensors[nsensors++].fd = fd;
+		logx(LOG_DEBUG, "Monitoring temperature sensor %s", g.gl_pathv[i]);
+	}
+
+	globfree(&g);
+}
+
+/**
+ * Discover the thermal zones and hwmon temperature inputs.
+ */
+void
+monitor_init(void)
+{
+	static bool initialized = false;
+
+	if (initialized)
+		return;
+	initialized = true;
+
+	add_sensors("/sys/class/thermal/thermal_zone*/temp");
+	add_sensors("/sys/class/hwmon/hwmon*/temp*_input");
+
+	logx(LOG_INFO, "Found %u temperature sensors", nsensors);
+}
+
+const char *
+monitor_sensor_name(unsigned int sensor)
+{
+	return sensor < nsensors ? sensors[sensor].name : NULL;
+}
+
+static void
+sample_sensors(struct monitor_sample *sample)
+{
+	for (unsigned int i = 0; i < nsensors; i++) {
+		char buf[32];
+		ssize_t len;
+		char *end;
+		long temp;
+
+		sample->sensor_temp[i] = 0;
+
+		if (sensors[i].fd < 0)
+			continue;
+
+		if ((len = pread(sensors[i].fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+			/* e.g. the device is gone */
+			logx(LOG_WARNING, "Cannot read %s: %s", sensors[i].name,
+			     len < 0 ? strerror(errno) : "empty");
+			close(sensors[i].fd);
+			sensors[i].fd = -1;
+			continue;
+		}
+		buf[len] = '\0';
+
+		temp = strtol(buf, &end, 10);
+		if (end == buf)
+			continue;
+
+		sample->sensor_temp[i] = (int32_t)temp;
+		if (!sample->have_max_temp || temp > sample->max_temp)
+			sample->max_temp = (int32_t)temp;
+		sample->have_max_temp = true;
+	}
+
+	sample->sensors = nsensors;
+}
+
+/**
+ * Take a sample of the monitored system parameters.
+ *
+ * CPU utilisation is computed relative to the previous call.
+ *
+ * @param sample Filled with the current values.
+ * @returns 0 on success, -1 if a parameter could not be determined.
+ */
+int
+monitor_sample(struct monitor_sample *sample)
+{
+	struct sysinfo info;
+	int rc = 0;
+
+	memset(sample, 0, sizeof(*sample));
+
+	if (sample_memory(sample) < 0)
+		rc = -1;
+	if (sample_cpu(sample) < 0)
+		rc = -1;
+	sample_sensors(sample);
+
+	if (sysinfo(&info) != 0) {
+		logx(LOG_WARNING, "Failed to read sysinfo: %s.", strerror(errno));
+		return -1;
+	}
+
+	for (int i = 0; i < 3; i++)
+		sample->loads[i] = (uint32_t)((uint64_t)info.loads[i] * 100 / (1 << SI_LOAD_SHIFT));
+
+	return rc;
+}
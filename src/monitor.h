@@ -0,0 +1,45 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MONITOR_H
+#define __MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MONITOR_MAX_CPUS 64
+#define MONITOR_MAX_SENSORS 32
+
+/**
+ * One sample of the monitored system parameters.
+ */
+struct monitor_sample {
+	/** memory in MiB */
+	uint32_t mem_total;
+	uint32_t mem_used;
+	/** available memory in percent of the total */
+	uint32_t mem_free_perc;
+
+	/** load averages multiplied by 100 */
+	uint32_t loads[3];
+
+	/** busy time in percent since the previous sample, all CPUs */
+	uint32_t cpu_usage;
+	/** busy time in percent since the previous sample, per CPU */
+	unsigned int cpus;
+	uint32_t cpu_core_usage[MONITOR_MAX_CPUS];
+
+	/** temperatures in millidegree Celsius */
+	unsigned int sensors;
+	int32_t sensor_temp[MONITOR_MAX_SENSORS];
+	/** maximum of all temperatures, only valid if have_max_temp */
+	bool have_max_temp;
+	int32_t max_temp;
+};
+
+void monitor_init(void);
+int monitor_sample(struct monitor_sample *sample);
+const char *monitor_sensor_name(unsigned int sensor);
+
+#endif
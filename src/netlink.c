@@ -0,0 +1,649 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/handlers.h>
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/neighbour.h>
+#include <netlink/route/netconf.h>
+
+#include <ev.h>
+
+#include "cfgd.h"
+#include "netlink.h"
+#include "log.h"
+
+/**
+ * Maximum size of a single batch of netlink requests.
+ * This must stay well below the socket's send buffer size
+ * (32 KiB by default in libnl).
+ */
+#define NL_BATCH_SIZE (16 * 1024)
+
+/**
+ * Receive buffer size of the cache manager's event socket.
+ * Link flaps on many interfaces may produce bursts of notifications.
+ */
+#define NL_EVENT_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * Cache manager keeping the link, address and neighbor caches
+ * up to date from rtnetlink multicast notifications.
+ */
+static struct nl_cache_mngr *cache_mngr;
+static struct nl_cache *link_cache, *addr_cache, *neigh_cache, *netconf_cache;
+static ev_io cache_mngr_watcher;
+
+/**
+ * Callback for changes of cached objects, see netlink_set_change_cb().
+ */
+static NETLINK_CHANGE_CB change_cb;
+static void *change_cb_data;
+
+/**
+ * Socket for synchronous requests (cache refills and batches).
+ */
+static struct nl_sock *sync_sock;
+
+/**
+ * A number of netlink requests that are sent to the kernel in a
+ * single datagram.
+ *
+ * Only the last request of a batch asks for an ACK.
+ * Since rtnetlink processes all requests of a datagram before
+ * sendmsg() returns, receiving this ACK (or its error) means that
+ * all errors of preceding requests have already been queued.
+ */
+struct nl_batch {
+	struct nl_sock *sock;
+
+	char buf[NL_BATCH_SIZE];
+	size_t len;
+	size_t last;
+	unsigned int count;
+
+	uint32_t last_seq;
+	bool done;
+	int errors;
+};
+
+static int
+nl_batch_ack_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl_batch *batch = arg;
+
+	if (nlmsg_hdr(msg)->nlmsg_seq == batch->last_seq)
+		batch->done = true;
+
+	return NL_STOP;
+}
+
+static int
+nl_batch_err_cb(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
+{
+	struct nl_batch *batch = arg;
+
+	logx(LOG_ERR, "Netlink request (type %u, seq %u) failed: %s",
+	     err->msg.nlmsg_type, err->msg.nlmsg_seq, strerror(-err->error));
+	batch->errors++;
+
+	if (err->msg.nlmsg_seq == batch->last_seq)
+		batch->done = true;
+
+	return NL_SKIP;
+}
+
+/**
+ * Send all queued requests and wait for the kernel to process them.
+ *
+ * @param batch The batch to flush.
+ * @returns 0 on success, -1 if sending or receiving failed.
+ */
+static int
+nl_batch_flush(struct nl_batch *batch)
+{
+	struct nlmsghdr *hdr;
+	struct nl_cb *cb;
+	int rc = 0;
+
+	if (!batch->count)
+		return 0;
+
+	hdr = (struct nlmsghdr *)(batch->buf + batch->last);
+	hdr->nlmsg_flags |= NLM_F_ACK;
+	batch->last_seq = hdr->nlmsg_seq;
+	batch->done = false;
+
+	if (nl_sendto(batch->sock, batch->buf, batch->len) < 0) {
+		logx(LOG_ERR, "Cannot send netlink batch of %u requests", batch->count);
+		rc = -1;
+		goto out;
+	}
+
+	if (!(cb = nl_cb_alloc(NL_CB_DEFAULT))) {
+		rc = -1;
+		goto out;
+	}
+	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, nl_batch_ack_cb, batch);
+	nl_cb_err(cb, NL_CB_CUSTOM, nl_batch_err_cb, batch);
+
+	while (!batch->done) {
+		int err = nl_recvmsgs(batch->sock, cb);
+		if (err < 0) {
+			logx(LOG_ERR, "Cannot receive netlink batch ACK: %s", nl_geterror(err));
+			rc = -1;
+			break;
+		}
+	}
+
+	nl_cb_put(cb);
+
+out:
+	batch->len = batch->last = 0;
+	batch->count = 0;
+	return rc;
+}
+
+/**
+ * Queue a netlink request, flushing the batch first if it is full.
+ *
+ * @param batch The batch to append to.
+ * @param msg The request. It is always freed.
+ * @returns 0 on success, -1 on error.
+ */
+static int
+nl_batch_add(struct nl_batch *batch, struct nl_msg *msg)
+{
+	struct nlmsghdr *hdr;
+	size_t size;
+	int rc = 0;
+
+	nl_complete_msg(batch->sock, msg);
+	hdr = nlmsg_hdr(msg);
+	size = NLMSG_ALIGN(hdr->nlmsg_len);
+
+	if (size > sizeof(batch->buf)) {
+		rc = -1;
+		goto out;
+	}
+	if (batch->len + size > sizeof(batch->buf) &&
+	    nl_batch_flush(batch) < 0)
+		rc = -1;
+
+	memcpy(batch->buf + batch->len, hdr, hdr->nlmsg_len);
+	batch->last = batch->len;
+	batch->len += size;
+	batch->count++;
+
+out:
+	nlmsg_free(msg);
+	return rc;
+}
+
+static inline bool
+nl_lladdr_equal(struct nl_addr *a, struct nl_addr *b)
+{
+	return a && b &&
+	       nl_addr_get_len(a) == nl_addr_get_len(b) &&
+	       memcmp(nl_addr_get_binary_addr(a), nl_addr_get_binary_addr(b),
+	              nl_addr_get_len(a)) == 0;
+}
+
+/**
+ * Queue the changes necessary to install a list of static neighbors
+ * on a given interface.
+ *
+ * Kernel neighbors that are already in the desired state are marked
+ * and left alone.
+ */
+static int
+nl_queue_neigh_list(struct nl_batch *batch, struct nl_cache *neigh_cache,
+                    int ifindex, int family, const struct ip_list *list)
+{
+	int rc = 0;
+
+	for (int i = 0; i < list->count; i++) {
+		const struct ipaddr *ip = list->ip + i;
+		struct nl_addr *dst = NULL, *lladdr = NULL;
+		struct rtnl_neigh *cur, *neigh = NULL;
+		struct nl_msg *msg;
+
+		if (!ip->address || !ip->value)
+			continue;
+
+		if (nl_addr_parse(ip->address, family, &dst) < 0 ||
+		    nl_addr_parse(ip->value, AF_LLC, &lladdr) < 0) {
+			logx(LOG_WARNING, "Invalid neighbor %s lladdr %s",
+			     ip->address, ip->value);
+			goto next;
+		}
+
+		if ((cur = rtnl_neigh_get(neigh_cache, ifindex, dst))) {
+			bool unchanged = (rtnl_neigh_get_state(cur) & NUD_PERMANENT) &&
+			                 nl_lladdr_equal(rtnl_neigh_get_lladdr(cur), lladdr);
+
+			nl_object_mark((struct nl_object *)cur);
+			rtnl_neigh_put(cur);
+			if (unchanged)
+				goto next;
+		}
+
+		if (!(neigh = rtnl_neigh_alloc())) {
+			rc = -1;
+			goto next;
+		}
+		rtnl_neigh_set_ifindex(neigh, ifindex);
+		rtnl_neigh_set_family(neigh, family);
+		rtnl_neigh_set_dst(neigh, dst);
+		rtnl_neigh_set_lladdr(neigh, lladdr);
+		rtnl_neigh_set_state(neigh, NUD_PERMANENT);
+
+		if (rtnl_neigh_build_add_request(neigh, NLM_F_CREATE | NLM_F_REPLACE, &msg) < 0 ||
+		    nl_batch_add(batch, msg) < 0)
+			rc = -1;
+
+	next:
+		if (neigh)
+			rtnl_neigh_put(neigh);
+		if (lladdr)
+			nl_addr_put(lladdr);
+		if (dst)
+			nl_addr_put(dst);
+	}
+
+	return rc;
+}
+
+static void
+nl_unmark_cb(struct nl_object *obj, void *arg)
+{
+	nl_object_unmark(obj);
+}
+
+static void
+nl_queue_neigh_delete_cb(struct nl_object *obj, void *arg)
+{
+	struct nl_batch *batch = arg;
+	struct rtnl_neigh *neigh = (struct rtnl_neigh *)obj;
+	int family = rtnl_neigh_get_family(neigh);
+	struct nl_msg *msg;
+
+	if (nl_object_is_marked(obj) ||
+	    !(rtnl_neigh_get_state(neigh) & NUD_PERMANENT) ||
+	    (family != AF_INET && family != AF_INET6))
+		return;
+
+	if (rtnl_neigh_build_delete_request(neigh, 0, &msg) < 0 ||
+	    nl_batch_add(batch, msg) < 0)
+		batch->errors++;
+}
+
+/**
+ * Synchronize the kernel's permanent IPv4/IPv6 neighbors with
+ * the configured static neighbors.
+ *
+ * Instead of flushing all permanent neighbors and re-adding them,
+ * the desired state is compared with the cached neighbor table,
+ * so only missing or changed entries are replaced and only stale
+ * entries are deleted.
+ * All requests are sent in as few datagrams as possible.
+ *
+ * @param info List of configured interfaces.
+ * @returns 0 on success, -1 if at least one change failed.
+ */
+int netlink_sync_neigh(const struct interface_list *info)
+{
+	struct nl_batch *batch;
+	int rc = 0;
+
+	if (!cache_mngr)
+		return -1;
+
+	if (!(batch = calloc(1, sizeof(struct nl_batch))))
+		return -1;
+	batch->sock = sync_sock;
+
+	/* make sure we diff against the current kernel state */
+	netlink_update();
+
+	/*
+	 * Requests are not acknowledged individually, see struct nl_batch.
+	 * Sequence numbers are checked by the ACK/error callbacks instead.
+	 */
+	nl_socket_disable_auto_ack(sync_sock);
+
+	nl_cache_foreach(neigh_cache, nl_unmark_cb, NULL);
+
+	for (int i = 0; i < info->count; i++) {
+		const struct interface *iface = info->iface + i;
+		int ifindex;
+
+		if (!iface->ipv4.neigh.count && !iface->ipv6.neigh.count)
+			continue;
+
+		if (!(ifindex = rtnl_link_name2i(link_cache, iface->name))) {
+			logx(LOG_WARNING, "Cannot set neighbors on unknown interface %s",
+			     iface->name);
+			continue;
+		}
+
+		if (nl_queue_neigh_list(batch, neigh_cache, ifindex, AF_INET,
+		                        &iface->ipv4.neigh) < 0 ||
+		    nl_queue_neigh_list(batch, neigh_cache, ifindex, AF_INET6,
+		                        &iface->ipv6.neigh) < 0)
+			rc = -1;
+	}
+
+	/* remove all permanent neighbors that are no longer configured */
+	nl_cache_foreach(neigh_cache, nl_queue_neigh_delete_cb, batch);
+
+	if (nl_batch_flush(batch) < 0 || batch->errors)
+		rc = -1;
+
+	nl_socket_enable_auto_ack(sync_sock);
+	free(batch);
+
+	/*
+	 * Our own changes are reflected by notifications,
+	 * pick them up right away.
+	 */
+	netlink_update();
+
+	return rc;
+}
+
+struct nl_cache *netlink_link_cache(void)
+{
+	return link_cache;
+}
+
+struct nl_cache *netlink_addr_cache(void)
+{
+	return addr_cache;
+}
+
+struct nl_cache *netlink_neigh_cache(void)
+{
+	return neigh_cache;
+}
+
+struct nl_cache *netlink_netconf_cache(void)
+{
+	return netconf_cache;
+}
+
+/**
+ * Get the forwarding setting of an interface from the netconf cache.
+ *
+ * @param family AF_INET or AF_INET6.
+ * @param ifindex Interface index.
+ * @param forwarding Where to store the setting.
+ * @returns 0 on success, -1 if it is not cached.
+ */
+int netlink_get_forwarding(int family, int ifindex, int *forwarding)
+{
+	struct rtnl_netconf *nc;
+	int rc;
+
+	if (!netconf_cache ||
+	    !(nc = rtnl_netconf_get_by_idx(netconf_cache, family, ifindex)))
+		return -1;
+
+	rc = rtnl_netconf_get_forwarding(nc, forwarding) < 0 ? -1 : 0;
+	rtnl_netconf_put(nc);
+
+	return rc;
+}
+
+/**
+ * Get the interface counters of a link object.
+ *
+ * libnl fills the counters from IFLA_STATS64 if the kernel provides it.
+ *
+ * @param link Link object.
+ * @param stats Where to store the counters.
+ */
+void netlink_link_stats_from(struct rtnl_link *link, struct netlink_link_stats *stats)
+{
+	stats->rx_bytes   = rtnl_link_get_stat(link, RTNL_LINK_RX_BYTES);
+	stats->rx_packets = rtnl_link_get_stat(link, RTNL_LINK_RX_PACKETS);
+	stats->rx_errors  = rtnl_link_get_stat(link, RTNL_LINK_RX_ERRORS);
+	stats->rx_dropped = rtnl_link_get_stat(link, RTNL_LINK_RX_DROPPED);
+	stats->tx_bytes   = rtnl_link_get_stat(link, RTNL_LINK_TX_BYTES);
+	stats->tx_packets = rtnl_link_get_stat(link, RTNL_LINK_TX_PACKETS);
+	stats->tx_errors  = rtnl_link_get_stat(link, RTNL_LINK_TX_ERRORS);
+	stats->tx_dropped = rtnl_link_get_stat(link, RTNL_LINK_TX_DROPPED);
+}
+
+/**
+ * Get the interface counters of a link.
+ *
+ * The kernel does not send notifications for counter changes, so the
+ * counters of cached links are stale.
+ * We therefore request the link by ifindex (a single RTM_GETLINK
+ * round-trip) and use its IFLA_STATS64 counters, falling back
+ * to the counters of the given link object.
+ *
+ * @param link Link object, usually from the link cache.
+ * @param stats Where to store the counters.
+ */
+void netlink_get_link_stats(struct rtnl_link *link, struct netlink_link_stats *stats)
+{
+	struct rtnl_link *fresh = NULL;
+
+	if (sync_sock &&
+	    rtnl_link_get_kernel(sync_sock, rtnl_link_get_ifindex(link), NULL, &fresh) >= 0)
+		link = fresh;
+
+	netlink_link_stats_from(link, stats);
+
+	if (fresh)
+		rtnl_link_put(fresh);
+}
+
+/**
+ * Take a snapshot of all links including their current counters.
+ *
+ * Pending notifications are processed first, so the managed address,
+ * neighbor and netconf caches are consistent with the snapshot.
+ *
+ * @returns A new link cache that must be freed with nl_cache_free()
+ *          or NULL on error.
+ */
+struct nl_cache *netlink_link_snapshot(void)
+{
+	struct nl_cache *cache;
+	int err;
+
+	if (!sync_sock)
+		return NULL;
+
+	netlink_update();
+
+	if ((err = rtnl_link_alloc_cache(sync_sock, AF_UNSPEC, &cache)) < 0) {
+		logx(LOG_ERR, "Cannot dump links: %s", nl_geterror(err));
+		return NULL;
+	}
+
+	return cache;
+}
+
+/**
+ * Refill all managed caches from scratch.
+ *
+ * This is necessary when notifications have been lost,
+ * e.g. because the event socket's receive buffer overflowed.
+ */
+static void
+netlink_resync(void)
+{
+	struct nl_cache *caches[] = {link_cache, addr_cache, neigh_cache, netconf_cache};
+
+	logx(LOG_WARNING, "Netlink notifications lost, refilling caches");
+
+	for (int i = 0; i < sizeof(caches)/sizeof(caches[0]); i++) {
+		int err;
+
+		if (!caches[i])
+			continue;
+
+		if ((err = nl_cache_refill(sync_sock, caches[i])) < 0)
+			logx(LOG_ERR, "Cannot refill netlink cache: %s", nl_geterror(err));
+	}
+
+	/* refills do not report individual changes */
+	if (change_cb)
+		change_cb(0, NETLINK_CHANGE_LINK | NETLINK_CHANGE_ADDR | NETLINK_CHANGE_NEIGH,
+		          change_cb_data);
+}
+
+/**
+ * Process all pending netlink notifications without blocking.
+ */
+void netlink_update(void)
+{
+	int err;
+
+	if (!cache_mngr)
+		return;
+
+	err = nl_cache_mngr_data_ready(cache_mngr);
+	if (err == -NLE_NOMEM)
+		netlink_resync();
+	else if (err < 0 && err != -NLE_AGAIN)
+		logx(LOG_ERR, "Cannot process netlink notifications: %s", nl_geterror(err));
+}
+
+/**
+ * Change callback of the managed caches.
+ *
+ * Reachability updates of neighbors (NL_ACT_CHANGE) are very frequent
+ * and not reported, only neighbors that appear or disappear are.
+ */
+static void
+cache_change_cb(struct nl_cache *cache, struct nl_object *obj, int action, void *data)
+{
+	unsigned int what = (uintptr_t)data;
+	int ifindex;
+
+	if (!change_cb)
+		return;
+
+	switch (what) {
+	case NETLINK_CHANGE_LINK:
+		ifindex = rtnl_link_get_ifindex((struct rtnl_link *)obj);
+		break;
+	case NETLINK_CHANGE_ADDR:
+		ifindex = rtnl_addr_get_ifindex((struct rtnl_addr *)obj);
+		break;
+	case NETLINK_CHANGE_NEIGH:
+		if (action == NL_ACT_CHANGE)
+			return;
+		ifindex = rtnl_neigh_get_ifindex((struct rtnl_neigh *)obj);
+		break;
+	default:
+		return;
+	}
+
+	if (ifindex > 0)
+		change_cb(ifindex, what, change_cb_data);
+}
+
+/**
+ * Register a callback for link, address and neighbor changes.
+ *
+ * The callback is invoked for every change while notifications are
+ * processed, so it should only record the change.
+ * An ifindex of 0 means that all interfaces may have changed.
+ *
+ * @param cb The callback or NULL to unregister.
+ * @param data User data passed to @p cb.
+ */
+void netlink_set_change_cb(NETLINK_CHANGE_CB cb, void *data)
+{
+	change_cb = cb;
+	change_cb_data = data;
+}
+
+static void
+cache_mngr_cb(EV_P_ ev_io *w, int revents)
+{
+	netlink_update();
+}
+
+/**
+ * Set up the netlink cache manager and register it with the event loop.
+ *
+ * @param loop The event loop.
+ * @returns 0 on success, -1 on error.
+ */
+int netlink_init(struct ev_loop *loop)
+{
+	struct nl_sock *event_sock = NULL;
+	int err;
+
+	if (!(sync_sock = nl_socket_alloc()) ||
+	    !(event_sock = nl_socket_alloc()))
+		goto err_alloc;
+
+	if ((err = nl_connect(sync_sock, NETLINK_ROUTE)) < 0 ||
+	    (err = nl_cache_mngr_alloc(event_sock, NETLINK_ROUTE, 0, &cache_mngr)) < 0)
+		goto err;
+
+	if (nl_socket_set_buffer_size(event_sock, NL_EVENT_BUFFER_SIZE, 0) < 0)
+		logx(LOG_WARNING, "Cannot enlarge netlink event buffer");
+
+	if ((err = nl_cache_mngr_add(cache_mngr, "route/link", cache_change_cb,
+	                             (void *)NETLINK_CHANGE_LINK, &link_cache)) < 0 ||
+	    (err = nl_cache_mngr_add(cache_mngr, "route/addr", cache_change_cb,
+	                             (void *)NETLINK_CHANGE_ADDR, &addr_cache)) < 0 ||
+	    (err = nl_cache_mngr_add(cache_mngr, "route/neigh", cache_change_cb,
+	                             (void *)NETLINK_CHANGE_NEIGH, &neigh_cache)) < 0)
+		goto err;
+
+	/*
+	 * Forwarding settings are optional since netconf
+	 * requires Linux 3.10 or later.
+	 * They are read from procfs otherwise.
+	 */
+	if ((err = nl_cache_mngr_add(cache_mngr, "route/netconf", NULL, NULL, &netconf_cache)) < 0) {
+		logx(LOG_WARNING, "Cannot set up netconf cache: %s", nl_geterror(err));
+		netconf_cache = NULL;
+	}
+
+	ev_io_init(&cache_mngr_watcher, cache_mngr_cb,
+	           nl_cache_mngr_get_fd(cache_mngr), EV_READ);
+	ev_io_start(loop, &cache_mngr_watcher);
+
+	return 0;
+
+err:
+	logx(LOG_ERR, "Cannot set up netlink cache manager: %s", nl_geterror(err));
+	if (cache_mngr) {
+		nl_cache_mngr_free(cache_mngr);
+		cache_mngr = NULL;
+	}
+	link_cache = addr_cache = neigh_cache = netconf_cache = NULL;
+err_alloc:
+	if (event_sock)
+		nl_socket_free(event_sock);
+	if (sync_sock)
+		nl_socket_free(sync_sock);
+	sync_sock = NULL;
+	return -1;
+}
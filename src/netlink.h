@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __NETLINK_H
+#define __NETLINK_H
+
+#include <ev.h>
+
+#include <stdint.h>
+
+struct interface_list;
+struct nl_cache;
+struct rtnl_link;
+
+struct netlink_link_stats {
+	uint64_t rx_bytes;
+	uint64_t rx_packets;
+	uint64_t rx_errors;
+	uint64_t rx_dropped;
+	uint64_t tx_bytes;
+	uint64_t tx_packets;
+	uint64_t tx_errors;
+	uint64_t tx_dropped;
+};
+
+#define NETLINK_CHANGE_LINK	(1 << 0)
+#define NETLINK_CHANGE_ADDR	(1 << 1)
+#define NETLINK_CHANGE_NEIGH	(1 << 2)
+
+typedef void (*NETLINK_CHANGE_CB)(int ifindex, unsigned int what, void *data);
+
+int netlink_init(struct ev_loop *loop);
+void netlink_update(void);
+void netlink_set_change_cb(NETLINK_CHANGE_CB cb, void *data);
+
+struct nl_cache *netlink_link_cache(void);
+struct nl_cache *netlink_addr_cache(void);
+struct nl_cache *netlink_neigh_cache(void);
+struct nl_cache *netlink_netconf_cache(void);
+
+int netlink_get_forwarding(int family, int ifindex, int *forwarding);
+
+void netlink_link_stats_from(struct rtnl_link *link, struct netlink_link_stats *stats);
+void netlink_get_link_stats(struct rtnl_link *link, struct netlink_link_stats *stats);
+struct nl_cache *netlink_link_snapshot(void);
+
+int netlink_sync_neigh(const struct interface_list *info);
+
+#endif
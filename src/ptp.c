@@ -0,0 +1,371 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <ev.h>
+
+#include "ptp.h"
+#include "log.h"
+
+/**
+ * Management socket of ptp4l, see uds_address in ptp4l(8).
+ */
+#ifndef PTP4L_UDS_PATH
+#define PTP4L_UDS_PATH "/var/run/ptp4l"
+#endif
+
+/**
+ * Address of the agent's end, ptp4l sends its responses there.
+ */
+#ifndef PTP_CLIENT_PATH
+#define PTP_CLIENT_PATH "/var/run/mand-metropolisd.pmc"
+#endif
+
+/*
+ * PTPv2 management messages (IEEE 1588-2008, 15), as sent by pmc.
+ */
+#define PTP_VERSION                     2
+#define PTP_MSG_MANAGEMENT              0x0d
+#define PTP_CTL_MANAGEMENT              0x04
+#define PTP_LOG_INTERVAL_NONE           0x7f
+
+#define PTP_ACTION_GET                  0
+#define PTP_ACTION_SET                  1
+#define PTP_ACTION_RESPONSE             2
+
+#define PTP_TLV_MANAGEMENT              0x0001
+#define PTP_TLV_MANAGEMENT_ERROR_STATUS 0x0002
+
+#define PTP_MID_CURRENT_DATA_SET        0x2001
+#define PTP_MID_PRIORITY1               0x2005
+
+/** common header plus management message fields */
+#define PTP_MANAGEMENT_LEN              48
+/** TLV type, length and management id */
+#define PTP_TLV_LEN                     6
+
+#define PTP_OFF_MESSAGE_TYPE            0
+#define PTP_OFF_VERSION                 1
+#define PTP_OFF_LENGTH                  2
+#define PTP_OFF_SEQUENCE_ID             30
+#define PTP_OFF_CONTROL                 32
+#define PTP_OFF_LOG_INTERVAL            33
+#define PTP_OFF_TARGET_PORT             34
+#define PTP_OFF_ACTION                  46
+#define PTP_OFF_TLV_TYPE                48
+#define PTP_OFF_TLV_LENGTH              50
+#define PTP_OFF_TLV_ID                  52
+#define PTP_OFF_TLV_DATA                54
+
+/** time ptp4l has to answer a SET request */
+#ifndef PTP_SET_TIMEOUT_S
+#define PTP_SET_TIMEOUT_S               1.
+#endif
+
+static struct ev_loop *ptp_loop;
+static ev_io ptp_watcher;
+static uint16_t ptp_sequence_id;
+
+/*
+ * There is at most one outstanding CURRENT_DATA_SET request,
+ * a newer request replaces it.
+ */
+static PTP_CURRENT_DATA_CB ptp_current_cb;
+static void *ptp_current_data;
+static uint16_t ptp_current_sequence_id;
+
+/*
+ * There is at most one outstanding PRIORITY1 SET request,
+ * a newer request replaces it without invoking its callback.
+ */
+static PTP_SET_CB ptp_set_cb;
+static void *ptp_set_data;
+static uint16_t ptp_set_sequence_id;
+static uint8_t ptp_set_priority;
+static ev_timer ptp_set_timer;
+
+/**
+ * Complete the outstanding SET request.
+ *
+ * @param result 0 if ptp4l applied the value, -1 otherwise.
+ */
+static void
+ptp_set_done(int result)
+{
+	PTP_SET_CB cb = ptp_set_cb;
+
+	if (!cb)
+		return;
+	ptp_set_cb = NULL;
+	ev_timer_stop(ptp_loop, &ptp_set_timer);
+
+	cb(result, ptp_set_data);
+}
+
+static void
+ptp_set_timeout_cb(EV_P_ ev_timer *w __attribute__((unused)),
+                   int revents __attribute__((unused)))
+{
+	logx(LOG_WARNING, "ptp4l did not answer the PRIORITY1 request");
+	ptp_set_done(-1);
+}
+
+static inline uint16_t
+get_be16(const uint8_t *p)
+{
+	return (uint16_t)p[0] << 8 | p[1];
+}
+
+static inline void
+put_be16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline int64_t
+get_be64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (int64_t)be64toh(v);
+}
+
+static void
+ptp_response(const uint8_t *msg, size_t len)
+{
+	uint16_t tlv_type, tlv_len, id, sequence_id;
+
+	if (len < PTP_MANAGEMENT_LEN + PTP_TLV_LEN ||
+	    (msg[PTP_OFF_MESSAGE_TYPE] & 0x0f) != PTP_MSG_MANAGEMENT ||
+	    (msg[PTP_OFF_ACTION] & 0x0f) != PTP_ACTION_RESPONSE)
+		return;
+
+	sequence_id = get_be16(msg + PTP_OFF_SEQUENCE_ID);
+	tlv_type = get_be16(msg + PTP_OFF_TLV_TYPE);
+	tlv_len = get_be16(msg + PTP_OFF_TLV_LENGTH);
+	id = get_be16(msg + PTP_OFF_TLV_ID);
+
+	if (PTP_OFF_TLV_ID + (size_t)tlv_len > len)
+		return;
+
+	if (tlv_type == PTP_TLV_MANAGEMENT_ERROR_STATUS) {
+		/* the error id precedes the management id */
+		logx(LOG_WARNING, "ptp4l rejected management id %#06x, error %#06x",
+		     tlv_len >= 4 ? get_be16(msg + PTP_OFF_TLV_ID + 2) : 0, id);
+		if (ptp_set_cb && sequence_id == ptp_set_sequence_id)
+			ptp_set_done(-1);
+		return;
+	}
+	if (tlv_type != PTP_TLV_MANAGEMENT)
+		return;
+
+	switch (id) {
+	case PTP_MID_CURRENT_DATA_SET: {
+		const uint8_t *data = msg + PTP_OFF_TLV_DATA;
+		struct ptp_current_data current;
+		PTP_CURRENT_DATA_CB cb = ptp_current_cb;
+
+		if (!cb || sequence_id != ptp_current_sequence_id || tlv_len < 2 + 18)
+			return;
+		ptp_current_cb = NULL;
+
+		/* TimeInterval is in units of 2^-16 ns */
+		current.steps_removed = get_be16(data);
+		current.offset_from_master = get_be64(data + 2) / 65536;
+		current.mean_path_delay = get_be64(data + 10) / 65536;
+
+		cb(&current, ptp_current_data);
+		break;
+	}
+
+	case PTP_MID_PRIORITY1:
+		if (tlv_len < 3)
+			return;
+		logx(LOG_INFO, "ptp4l priority1 is %u", msg[PTP_OFF_TLV_DATA]);
+
+		/* the response to a SET carries the value in effect */
+		if (ptp_set_cb && sequence_id == ptp_set_sequence_id)
+			ptp_set_done(msg[PTP_OFF_TLV_DATA] == ptp_set_priority ? 0 : -1);
+		break;
+	}
+}
+
+static void
+ptp_receive(EV_P_ ev_io *w, int revents __attribute__((unused)))
+{
+	uint8_t buf[512];
+	ssize_t len;
+
+	while ((len = recv(w->fd, buf, sizeof(buf), 0)) >= 0)
+		ptp_response(buf, len);
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		logx(LOG_WARNING, "Cannot receive from ptp4l: %s", strerror(errno));
+}
+
+/**
+ * Open the management socket if necessary.
+ *
+ * @returns The socket or -1 on error.
+ */
+static int
+ptp_socket(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (ev_is_active(&ptp_watcher))
+		return ptp_watcher.fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		logx(LOG_ERR, "Cannot create PTP management socket: %s", strerror(errno));
+		return -1;
+	}
+
+	strncpy(addr.sun_path, PTP_CLIENT_PATH, sizeof(addr.sun_path) - 1);
+	unlink(PTP_CLIENT_PATH);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		logx(LOG_ERR, "Cannot bind %s: %s", PTP_CLIENT_PATH, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	ev_io_init(&ptp_watcher, ptp_receive, fd, EV_READ);
+	ev_io_start(ptp_loop, &ptp_watcher);
+
+	return fd;
+}
+
+/**
+ * Send a management message to ptp4l.
+ *
+ * @param action PTP_ACTION_GET or PTP_ACTION_SET.
+ * @param id The management id.
+ * @param data The data of SET requests, NULL for GET requests.
+ * @param size Size of @p data, must be even.
+ * @returns The sequence id of the request, -1 on error.
+ */
+static int
+ptp_send(int action, uint16_t id, const void *data, size_t size)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	uint8_t msg[PTP_MANAGEMENT_LEN + PTP_TLV_LEN + 16];
+	size_t len = PTP_MANAGEMENT_LEN + PTP_TLV_LEN + size;
+	uint16_t sequence_id = ptp_sequence_id++;
+	int fd;
+
+	if (size > sizeof(msg) - PTP_MANAGEMENT_LEN - PTP_TLV_LEN ||
+	    (fd = ptp_socket()) < 0)
+		return -1;
+
+	/* domain 0, no boundary hops, so the request is not forwarded */
+	memset(msg, 0, sizeof(msg));
+	msg[PTP_OFF_MESSAGE_TYPE] = PTP_MSG_MANAGEMENT;
+	msg[PTP_OFF_VERSION] = PTP_VERSION;
+	put_be16(msg + PTP_OFF_LENGTH, len);
+	put_be16(msg + PTP_OFF_SEQUENCE_ID, sequence_id);
+	msg[PTP_OFF_CONTROL] = PTP_CTL_MANAGEMENT;
+	msg[PTP_OFF_LOG_INTERVAL] = PTP_LOG_INTERVAL_NONE;
+	/* all clocks and ports */
+	memset(msg + PTP_OFF_TARGET_PORT, 0xff, 10);
+	msg[PTP_OFF_ACTION] = action;
+
+	put_be16(msg + PTP_OFF_TLV_TYPE, PTP_TLV_MANAGEMENT);
+	put_be16(msg + PTP_OFF_TLV_LENGTH, 2 + size);
+	put_be16(msg + PTP_OFF_TLV_ID, id);
+	if (size)
+		memcpy(msg + PTP_OFF_TLV_DATA, data, size);
+
+	strncpy(addr.sun_path, PTP4L_UDS_PATH, sizeof(addr.sun_path) - 1);
+	if (sendto(fd, msg, len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		/* ptp4l is not running */
+		logx(LOG_DEBUG, "Cannot send to %s: %s", PTP4L_UDS_PATH, strerror(errno));
+		return -1;
+	}
+
+	return sequence_id;
+}
+
+/**
+ * Change the priority1 attribute of the running ptp4l.
+ *
+ * The clock keeps its servo state, unlike after a restart.
+ * Sending the request does not mean ptp4l accepted it: @p cb receives
+ * the outcome once ptp4l has answered or PTP_SET_TIMEOUT_S has passed.
+ * @p cb is not invoked if the request could not be sent or is replaced
+ * by a newer one.
+ *
+ * @param priority1 The new priority1.
+ * @param cb Callback receiving 0 if ptp4l applied the value,
+ *           -1 if it rejected the request or did not answer.
+ * @param data User data passed to @p cb.
+ * @returns 0 if the request was sent, -1 if ptp4l is not reachable.
+ */
+int ptp_set_priority1(uint8_t priority1, PTP_SET_CB cb, void *data)
+{
+	/* padded to an even length */
+	const uint8_t tlv[2] = { priority1, 0 };
+	int sequence_id;
+
+	ptp_set_cb = NULL;
+	ev_timer_stop(ptp_loop, &ptp_set_timer);
+
+	if ((sequence_id = ptp_send(PTP_ACTION_SET, PTP_MID_PRIORITY1, tlv, sizeof(tlv))) < 0)
+		return -1;
+
+	ptp_set_cb = cb;
+	ptp_set_data = data;
+	ptp_set_sequence_id = sequence_id;
+	ptp_set_priority = priority1;
+
+	if (cb) {
+		ev_timer_set(&ptp_set_timer, PTP_SET_TIMEOUT_S, 0.);
+		ev_timer_start(ptp_loop, &ptp_set_timer);
+	}
+	return 0;
+}
+
+/**
+ * Request the CURRENT_DATA_SET of ptp4l.
+ *
+ * @p cb is not invoked if ptp4l does not answer.
+ *
+ * @param cb Callback receiving the data set.
+ * @param data User data passed to @p cb.
+ * @returns 0 if the request was sent, -1 if ptp4l is not reachable.
+ */
+int ptp_get_current_data(PTP_CURRENT_DATA_CB cb, void *data)
+{
+	int sequence_id = ptp_send(PTP_ACTION_GET, PTP_MID_CURRENT_DATA_SET, NULL, 0);
+
+	if (sequence_id < 0)
+		return -1;
+
+	ptp_current_cb = cb;
+	ptp_current_data = data;
+	ptp_current_sequence_id = sequence_id;
+	return 0;
+}
+
+void init_ptp(struct ev_loop *loop)
+{
+	ptp_loop = loop;
+	ev_init(&ptp_set_timer, ptp_set_timeout_cb);
+}
@@ -0,0 +1,42 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PTP_H
+#define __PTP_H
+
+#include <stdint.h>
+#include <ev.h>
+
+/**
+ * CURRENT_DATA_SET of the local PTP clock.
+ */
+struct ptp_current_data {
+	uint16_t steps_removed;
+	/** offset from the master clock in nanoseconds */
+	int64_t offset_from_master;
+	/** mean path delay to the master clock in nanoseconds */
+	int64_t mean_path_delay;
+};
+
+/**
+ * Callback receiving the CURRENT_DATA_SET of ptp4l.
+ *
+ * @param current The data set.
+ * @param data User data passed to ptp_get_current_data().
+ */
+typedef void (*PTP_CURRENT_DATA_CB)(const struct ptp_current_data *current, void *data);
+
+/**
+ * Callback receiving the outcome of a SET request.
+ *
+ * @param result 0 if ptp4l applied the value, -1 otherwise.
+ * @param data User data passed to ptp_set_priority1().
+ */
+typedef void (*PTP_SET_CB)(int result, void *data);
+
+void init_ptp(struct ev_loop *loop);
+int ptp_set_priority1(uint8_t priority1, PTP_SET_CB cb, void *data);
+int ptp_get_current_data(PTP_CURRENT_DATA_CB cb, void *data);
+
+#endif
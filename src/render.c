@@ -0,0 +1,339 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+
+#include "render.h"
+#include "log.h"
+
+/**
+ * The last known content of a file written by render_commit_buffer().
+ *
+ * As long as the file's inode, size and modification time are unchanged,
+ * comparing the hash of the new content is sufficient and the file
+ * does not have to be read again.
+ */
+struct render_state {
+	SLIST_ENTRY(render_state) entry;
+
+	char *path;
+	uint64_t hash;
+	off_t size;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+};
+
+static SLIST_HEAD(render_states, render_state) render_states =
+	SLIST_HEAD_INITIALIZER(render_states);
+
+/*
+ * Files may be committed by worker threads, see worker_submit(),
+ * so render_states is protected by a lock.
+ */
+static pthread_mutex_t render_states_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Compute the 64-bit FNV-1a hash of a buffer.
+ *
+ * @param hash RENDER_HASH_INIT or the hash of preceding data.
+ * @param buf The data to hash.
+ * @param size Size of @p buf.
+ * @returns The hash of all data up to and including @p buf.
+ */
+uint64_t
+render_hash(uint64_t hash, const void *buf, size_t size)
+{
+	const unsigned char *p = buf;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static struct render_state *
+render_state_get(const char *path)
+{
+	struct render_state *state;
+
+	SLIST_FOREACH(state, &render_states, entry)
+		if (!strcmp(state->path, path))
+			return state;
+
+	return NULL;
+}
+
+static void
+render_state_update(const char *path, uint64_t hash, const struct stat *st)
+{
+	struct render_state *state;
+
+	pthread_mutex_lock(&render_states_lock);
+
+	if (!(state = render_state_get(path))) {
+		if (!(state = calloc(1, sizeof(*state))))
+			goto out;
+		if (!(state->path = strdup(path))) {
+			free(state);
+			goto out;
+		}
+		SLIST_INSERT_HEAD(&render_states, state, entry);
+	}
+
+	state->hash = hash;
+	state->size = st->st_size;
+	state->dev = st->st_dev;
+	state->ino = st->st_ino;
+	state->mtime = st->st_mtim;
+
+ out:
+	pthread_mutex_unlock(&render_states_lock);
+}
+
+/**
+ * Check whether a file has exactly the given content.
+ */
+static bool
+file_equals(const char *path, const char *buf, size_t size)
+{
+	char cur[4096];
+	size_t pos = 0, len;
+	FILE *fin;
+	bool equal = true;
+
+	if (!(fin = fopen(path, "r")))
+		return false;
+
+	while (equal && (len = fread(cur, 1, sizeof(cur), fin)) > 0) {
+		equal = pos + len <= size && memcmp(buf + pos, cur, len) == 0;
+		pos += len;
+	}
+	equal = equal && !ferror(fin) && pos == size;
+
+	fclose(fin);
+	return equal;
+}
+
+/**
+ * Check whether a file is unchanged, consulting the hash of the
+ * last content written if the file was not touched in between.
+ */
+static bool
+render_unchanged(const char *path, const char *buf, size_t size, uint64_t hash)
+{
+	struct render_state *state;
+	struct stat st;
+
+	if (stat(path, &st) < 0 || st.st_size != (off_t)size)
+		return false;
+
+	pthread_mutex_lock(&render_states_lock);
+	state = render_state_get(path);
+	if (state && state->dev == st.st_dev && state->ino == st.st_ino &&
+	    state->size == st.st_size &&
+	    state->mtime.tv_sec == st.st_mtim.tv_sec &&
+	    state->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+		bool unchanged = state->hash == hash;
+
+		pthread_mutex_unlock(&render_states_lock);
+		return unchanged;
+	}
+	pthread_mutex_unlock(&render_states_lock);
+
+	if (!file_equals(path, buf, size))
+		return false;
+
+	render_state_update(path, hash, &st);
+	return true;
+}
+
+/**
+ * Replace a file atomically unless it already has the given content.
+ *
+ * The content is written to a temporary file in the same directory
+ * which is renamed over @p path, so readers never see a partially
+ * written file.
+ *
+ * @param path The file to replace.
+ * @param buf The new content.
+ * @param size Size of @p buf.
+ * @returns 1 if the file was written, 0 if it was unchanged, -1 on error.
+ */
+int
+render_commit_buffer(const char *path, const char *buf, size_t size)
+{
+	uint64_t hash = render_hash(RENDER_HASH_INIT, buf, size);
+	char *tmp;
+	struct stat st;
+	int fd;
+
+	if (render_unchanged(path, buf, size, hash))
+		return 0;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return -1;
+
+	if ((fd = mkstemp(tmp)) < 0) {
+		logx(LOG_ERR, "Cannot create temporary file for %s: %s", path, strerror(errno));
+		free(tmp);
+		return -1;
+	}
+
+	for (size_t pos = 0; pos < size; ) {
+		ssize_t len = write(fd, buf + pos, size - pos);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+		pos += len;
+	}
+
+	if (fchmod(fd, 0644) < 0 || fsync(fd) < 0 || fstat(fd, &st) < 0)
+		goto error;
+	if (close(fd) < 0) {
+		fd = -1;
+		goto error;
+	}
+	fd = -1;
+
+	if (rename(tmp, path) < 0)
+		goto error;
+
+	render_state_update(path, hash, &st);
+	free(tmp);
+	return 1;
+
+ error:
+	logx(LOG_ERR, "Cannot write %s: %s", path, strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+	return -1;
+}
+
+/**
+ * Start rendering a file into memory.
+ *
+ * @param rf Render state, initialized by this function.
+ * @param path The file that will be replaced by render_commit().
+ * @returns Stream to render into, or NULL on error.
+ */
+FILE *
+render_open(struct render_file *rf, const char *path)
+{
+	memset(rf, 0, sizeof(*rf));
+	rf->path = path;
+
+	if (!(rf->fout = open_memstream(&rf->buf, &rf->size)))
+		logx(LOG_ERR, "Cannot render %s: %s", path, strerror(errno));
+
+	return rf->fout;
+}
+
+/**
+ * Finish rendering and replace the file if its content changed.
+ *
+ * @param rf Render state initialized by render_open().
+ * @returns 1 if the file was written, 0 if it was unchanged, -1 on error.
+ */
+int
+render_commit(struct render_file *rf)
+{
+	int rc;
+
+	if (ferror(rf->fout)) {
+		logx(LOG_ERR, "Cannot render %s", rf->path);
+		render_abort(rf);
+		return -1;
+	}
+
+	if (fclose(rf->fout) != 0) {
+		rf->fout = NULL;
+		logx(LOG_ERR, "Cannot render %s: %s", rf->path, strerror(errno));
+		render_abort(rf);
+		return -1;
+	}
+	rf->fout = NULL;
+
+	rc = render_commit_buffer(rf->path, rf->buf, rf->size);
+	render_abort(rf);
+
+	return rc;
+}
+
+/**
+ * Discard a rendered file without touching the file on disk.
+ */
+void
+render_abort(struct render_file *rf)
+{
+	if (rf->fout)
+		fclose(rf->fout);
+	rf->fout = NULL;
+
+	free(rf->buf);
+	rf->buf = NULL;
+	rf->size = 0;
+}
+
+/**
+ * Replace a file with the content of another file generated
+ * by an external command, unless the content is the same.
+ *
+ * @p src is removed in any case.
+ *
+ * @param path The file to replace.
+ * @param src The generated file.
+ * @returns 1 if the file was written, 0 if it was unchanged, -1 on error.
+ */
+int
+render_commit_file(const char *path, const char *src)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *fin;
+	int rc = -1;
+
+	if (!(fin = fopen(src, "r"))) {
+		logx(LOG_ERR, "Cannot open %s: %s", src, strerror(errno));
+		return -1;
+	}
+
+	if (fseek(fin, 0, SEEK_END) == 0) {
+		long len = ftell(fin);
+
+		if (len >= 0 && (buf = malloc(len ? : 1))) {
+			rewind(fin);
+			size = fread(buf, 1, len, fin);
+			if (!ferror(fin) && size == (size_t)len)
+				rc = render_commit_buffer(path, buf, size);
+		}
+	}
+
+	fclose(fin);
+	free(buf);
+	unlink(src);
+
+	return rc;
+}
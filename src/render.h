@@ -0,0 +1,38 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __RENDER_H
+#define __RENDER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** initial value of render_hash() */
+#define RENDER_HASH_INIT 0xcbf29ce484222325ULL
+
+/**
+ * A configuration file that is rendered into memory first.
+ *
+ * The file on disk is only replaced (atomically) if the rendered
+ * content differs, so callers can skip service restarts otherwise.
+ */
+struct render_file {
+	const char *path;
+
+	char *buf;
+	size_t size;
+	FILE *fout;
+};
+
+FILE *render_open(struct render_file *rf, const char *path);
+int render_commit(struct render_file *rf);
+void render_abort(struct render_file *rf);
+
+int render_commit_buffer(const char *path, const char *buf, size_t size);
+int render_commit_file(const char *path, const char *src);
+
+uint64_t render_hash(uint64_t hash, const void *buf, size_t size);
+
+#endif
@@ -0,0 +1,147 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "render.h"
+#include "snapshot.h"
+#include "log.h"
+
+#define SNAPSHOT_MAGIC   0x4d4d534e	/* "MMSN" */
+#define SNAPSHOT_VERSION 1
+
+/**
+ * On-disk snapshot.
+ *
+ * The file is only read by the same build that wrote it, so it uses
+ * the host's byte order. A hash of 0 means that the subsystem has
+ * not been applied yet.
+ */
+struct snapshot_file {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t hash[SNAPSHOT_SUBSYSTEMS];
+};
+
+static struct snapshot_file snapshot = {
+	.magic = SNAPSHOT_MAGIC,
+	.version = SNAPSHOT_VERSION
+};
+
+/** subsystems whose first configuration may be skipped */
+static bool warm[SNAPSHOT_SUBSYSTEMS];
+
+/**
+ * Load the snapshot written by a previous instance of the agent.
+ *
+ * Without a valid snapshot, all subsystems are applied as usual.
+ */
+void snapshot_load(void)
+{
+	struct snapshot_file file;
+	FILE *fin;
+	bool valid;
+
+	if (!(fin = fopen(SNAPSHOT_PATH, "r"))) {
+		if (errno != ENOENT)
+			logx(LOG_WARNING, "Cannot read " SNAPSHOT_PATH ": %s", strerror(errno));
+		return;
+	}
+
+	valid = fread(&file, sizeof(file), 1, fin) == 1 && fgetc(fin) == EOF &&
+	        file.magic == SNAPSHOT_MAGIC && file.version == SNAPSHOT_VERSION;
+	fclose(fin);
+
+	if (!valid) {
+		logx(LOG_WARNING, "Ignoring invalid " SNAPSHOT_PATH);
+		return;
+	}
+
+	snapshot = file;
+	snapshot_rearm();
+
+	logx(LOG_INFO, "Warm start from " SNAPSHOT_PATH);
+}
+
+/**
+ * Allow skipping the first configuration of every subsystem again.
+ *
+ * After a reconnect, mand sends the complete configuration again,
+ * and subsystems whose configuration was applied since need not be
+ * applied a second time.
+ */
+void snapshot_rearm(void)
+{
+	for (int i = 0; i < SNAPSHOT_SUBSYSTEMS; i++)
+		warm[i] = snapshot.hash[i] != 0;
+}
+
+/**
+ * Check whether a configuration was already applied by a previous
+ * instance of the agent.
+ *
+ * Only the first configuration of every subsystem is checked.
+ * Once a subsystem has been (re-)applied, all later configurations
+ * are applied again, so changes made outside the agent are still
+ * corrected by the next configuration change.
+ *
+ * @param subsystem The subsystem.
+ * @param hash Hash of the configuration.
+ * @returns true if applying the configuration may be skipped.
+ */
+bool snapshot_unchanged(enum snapshot_subsystem subsystem, uint64_t hash)
+{
+	bool unchanged = warm[subsystem] && snapshot.hash[subsystem] == hash;
+
+	warm[subsystem] = false;
+	if (unchanged)
+		logx(LOG_INFO, "Subsystem %d unchanged since last start, not applied", subsystem);
+
+	return unchanged;
+}
+
+static void
+snapshot_save(void)
+{
+	/* the file is replaced atomically, so it is never read partially */
+	render_commit_buffer(SNAPSHOT_PATH, (const char *)&snapshot, sizeof(snapshot));
+}
+
+/**
+ * Record that a configuration has been applied.
+ *
+ * @param subsystem The subsystem.
+ * @param hash Hash of the configuration.
+ */
+void snapshot_applied(enum snapshot_subsystem subsystem, uint64_t hash)
+{
+	warm[subsystem] = false;
+
+	if (snapshot.hash[subsystem] == hash)
+		return;
+	snapshot.hash[subsystem] = hash;
+
+	snapshot_save();
+}
+
+/**
+ * Forget the configuration of a subsystem.
+ *
+ * This is necessary whenever a subsystem is configured from anything
+ * but the complete configuration, so the next start applies it again.
+ *
+ * @param subsystem The subsystem.
+ */
+void snapshot_invalidate(enum snapshot_subsystem subsystem)
+{
+	snapshot_applied(subsystem, 0);
+}
@@ -0,0 +1,39 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * File the hashes of the last applied configuration are kept in.
+ * /run does not survive reboots, so a warm start is only possible
+ * after restarts of the agent itself.
+ */
+#ifndef SNAPSHOT_PATH
+#define SNAPSHOT_PATH "/run/mand-metropolisd.snapshot"
+#endif
+
+enum snapshot_subsystem {
+	SNAPSHOT_NTP,
+	SNAPSHOT_PTP,
+	SNAPSHOT_DNS,
+	SNAPSHOT_AUTHENTICATION,
+	SNAPSHOT_INTERFACES,
+	SNAPSHOT_AUTOID,
+	SNAPSHOT_SPARKPLUG,
+	SNAPSHOT_WWAN,
+	SNAPSHOT_WIFI,
+	SNAPSHOT_SUBSYSTEMS
+};
+
+void snapshot_load(void);
+void snapshot_rearm(void);
+bool snapshot_unchanged(enum snapshot_subsystem subsystem, uint64_t hash);
+void snapshot_applied(enum snapshot_subsystem subsystem, uint64_t hash);
+void snapshot_invalidate(enum snapshot_subsystem subsystem);
+
+#endif
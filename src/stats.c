@@ -0,0 +1,147 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "stats.h"
+#include "log.h"
+
+static const char *stats_names[STATS_HANDLERS] = {
+	[STATS_NTP_LIST]             = "ntp-list",
+	[STATS_PTP_GET]              = "ptp-get",
+	[STATS_DNS_LIST]             = "dns-list",
+	[STATS_AUTH_LIST]            = "authentication-list",
+	[STATS_IF_LIST]              = "interfaces-list",
+	[STATS_DHCP_LIST]            = "dhcp-client-list",
+	[STATS_AUTOID_GET]           = "autoid-get",
+	[STATS_SPARKPLUG_LIST]       = "sparkplug-list",
+	[STATS_WWAN_GET]             = "wwan-get",
+	[STATS_WIFI_GET]             = "wifi-get",
+	[STATS_ACTIVE_NOTIFY]        = "active-notify",
+	[STATS_EVENT_BROADCAST]      = "event-broadcast",
+	[STATS_GET_INTERFACE_STATE]  = "get-interface-state",
+	[STATS_GET_INTERFACES_STATE] = "get-interfaces-state",
+	[STATS_EXEC]                 = "exec",
+	[STATS_UNIT_JOB]             = "unit-job"
+};
+
+static struct stats_counter counters[STATS_HANDLERS];
+
+/** innermost active scope */
+static struct stats_scope *current_scope;
+
+/**
+ * Current time of the monotonic clock in nanoseconds.
+ */
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Record a single call of a handler.
+ *
+ * @param handler The handler.
+ * @param start Start of the call as returned by stats_now().
+ * @param error Whether the call failed.
+ */
+void stats_record(enum stats_handler handler, uint64_t start, bool error)
+{
+	struct stats_counter *counter = counters + handler;
+	uint64_t us = (stats_now() - start) / 1000;
+	unsigned int bucket = 0;
+
+	while (bucket < STATS_BUCKETS - 1 && (us >> bucket))
+		bucket++;
+
+	counter->calls++;
+	if (error)
+		counter->errors++;
+	counter->last_us = us > UINT32_MAX ? UINT32_MAX : us;
+	counter->hist[bucket]++;
+}
+
+void stats_scope_begin(struct stats_scope *scope)
+{
+	scope->start = stats_now();
+	scope->prev = current_scope;
+	current_scope = scope;
+}
+
+void stats_scope_end(struct stats_scope *scope)
+{
+	current_scope = scope->prev;
+	stats_record(scope->handler, scope->start, scope->error);
+}
+
+/**
+ * Mark the innermost handler call as failed.
+ */
+void stats_error(void)
+{
+	if (current_scope)
+		current_scope->error = true;
+}
+
+const char *stats_name(enum stats_handler handler)
+{
+	return stats_names[handler];
+}
+
+const struct stats_counter *stats_get(enum stats_handler handler)
+{
+	return counters + handler;
+}
+
+/**
+ * Estimate a percentile of the call durations.
+ *
+ * @param counter The counter.
+ * @param percent The percentile, e.g. 99.
+ * @returns Upper bound of the percentile in microseconds.
+ */
+uint32_t stats_percentile(const struct stats_counter *counter, unsigned int percent)
+{
+	uint64_t rank = (counter->calls * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	if (!counter->calls)
+		return 0;
+
+	for (unsigned int i = 0; i < STATS_BUCKETS; i++) {
+		seen += counter->hist[i];
+		if (seen >= rank)
+			return i < STATS_BUCKETS - 1 ? (uint32_t)1 << i : UINT32_MAX;
+	}
+
+	return UINT32_MAX;
+}
+
+/**
+ * Logs the counters of all handlers that have been called.
+ */
+void stats_log(void)
+{
+	for (int i = 0; i < STATS_HANDLERS; i++) {
+		const struct stats_counter *counter = counters + i;
+
+		if (!counter->calls)
+			continue;
+
+		logx(LOG_INFO, "%s: %" PRIu64 " calls, %" PRIu64 " errors, "
+		     "last %" PRIu32 " us, p50 < %" PRIu32 " us, p99 < %" PRIu32 " us",
+		     stats_names[i], counter->calls, counter->errors, counter->last_us,
+		     stats_percentile(counter, 50), stats_percentile(counter, 99));
+	}
+}
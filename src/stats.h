@@ -0,0 +1,78 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum stats_handler {
+	STATS_NTP_LIST,
+	STATS_PTP_GET,
+	STATS_DNS_LIST,
+	STATS_AUTH_LIST,
+	STATS_IF_LIST,
+	STATS_DHCP_LIST,
+	STATS_AUTOID_GET,
+	STATS_SPARKPLUG_LIST,
+	STATS_WWAN_GET,
+	STATS_WIFI_GET,
+	STATS_ACTIVE_NOTIFY,
+	STATS_EVENT_BROADCAST,
+	STATS_GET_INTERFACE_STATE,
+	STATS_GET_INTERFACES_STATE,
+	STATS_EXEC,
+	STATS_UNIT_JOB,
+	STATS_HANDLERS
+};
+
+/**
+ * Number of latency histogram buckets.
+ * Bucket n counts durations below 2^n microseconds.
+ */
+#define STATS_BUCKETS 32
+
+struct stats_counter {
+	uint64_t calls;
+	uint64_t errors;
+	/** duration of the last call in microseconds */
+	uint32_t last_us;
+	uint32_t hist[STATS_BUCKETS];
+};
+
+/**
+ * Measurement of a handler invocation, see STATS_SCOPE().
+ */
+struct stats_scope {
+	enum stats_handler handler;
+	uint64_t start;
+	bool error;
+	struct stats_scope *prev;
+};
+
+/**
+ * Measures the enclosing block as one call of @p h.
+ *
+ * The call is recorded when the block is left, including early returns.
+ * Errors are recorded with stats_error().
+ */
+#define STATS_SCOPE(h)							\
+	struct stats_scope stats_scope					\
+		__attribute__((cleanup(stats_scope_end))) = { .handler = (h) }; \
+	stats_scope_begin(&stats_scope)
+
+uint64_t stats_now(void);
+void stats_record(enum stats_handler handler, uint64_t start, bool error);
+
+void stats_scope_begin(struct stats_scope *scope);
+void stats_scope_end(struct stats_scope *scope);
+void stats_error(void);
+
+const char *stats_name(enum stats_handler handler);
+const struct stats_counter *stats_get(enum stats_handler handler);
+uint32_t stats_percentile(const struct stats_counter *counter, unsigned int percent);
+void stats_log(void);
+
+#endif
@@ -0,0 +1,423 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/queue.h>
+#include <sys/wait.h>
+
+#include <ev.h>
+
+#ifdef HAVE_SD_BUS
+#include <systemd/sd-bus.h>
+#endif
+
+#include "exec.h"
+#include "systemd.h"
+#include "stats.h"
+#include "log.h"
+
+/**
+ * A pending unit job.
+ */
+struct unit_job {
+	TAILQ_ENTRY(unit_job) entry;
+
+	char *unit;
+	char *path;	/* D-Bus job object path */
+	UNIT_JOB_CB cb;
+	void *data;
+
+	/** time the job was requested, see stats_now() */
+	uint64_t start;
+};
+
+static TAILQ_HEAD(unit_job_list, unit_job) unit_jobs = TAILQ_HEAD_INITIALIZER(unit_jobs);
+
+static const struct {
+	const char *method;	/* org.freedesktop.systemd1.Manager method */
+	const char *verb;	/* systemctl verb */
+} unit_job_types[] = {
+	[UNIT_START]             = {"StartUnit",            "start"},
+	[UNIT_STOP]              = {"StopUnit",             "stop"},
+	[UNIT_RESTART]           = {"RestartUnit",          "restart"},
+	[UNIT_RELOAD_OR_RESTART] = {"ReloadOrRestartUnit",  "reload-or-restart"},
+};
+
+static struct unit_job *
+unit_job_new(const char *unit, UNIT_JOB_CB cb, void *data)
+{
+	struct unit_job *job;
+
+	if (!(job = calloc(1, sizeof(struct unit_job))))
+		return NULL;
+
+	if (!(job->unit = strdup(unit))) {
+		free(job);
+		return NULL;
+	}
+	job->cb = cb;
+	job->data = data;
+	job->start = stats_now();
+
+	return job;
+}
+
+static void
+unit_job_done(struct unit_job *job, const char *result)
+{
+	logx(strcmp(result, "done") ? LOG_WARNING : LOG_INFO,
+	     "unit=[%s], result=%s", job->unit, result);
+	stats_record(STATS_UNIT_JOB, job->start, strcmp(result, "done") != 0);
+
+	if (job->cb)
+		job->cb(job->unit, result, job->data);
+
+	free(job->path);
+	free(job->unit);
+	free(job);
+}
+
+/*
+ * Fallback using systemctl, if the system bus is not available.
+ */
+
+static void
+systemctl_cb(int status, void *data)
+{
+	unit_job_done(data, status == 0 ? "done" : "failed");
+}
+
+static int
+systemctl_unit_job(enum unit_job_type type, struct unit_job *job)
+{
+	char cmd[256];
+
+	snprintf(cmd, sizeof(cmd), "systemctl %s %s",
+	         unit_job_types[type].verb, job->unit);
+
+	/* jobs of different units must not wait for each other */
+	return exec_async_lane(job->unit, cmd, systemctl_cb, job);
+}
+
+#ifdef HAVE_SD_BUS
+
+static sd_bus *bus;
+
+static struct ev_loop *bus_loop;
+static ev_io bus_io;
+static ev_timer bus_timer;
+static ev_prepare bus_prepare;
+
+/**
+ * Drop the bus connection, e.g. after it has been closed by the peer.
+ * Pending jobs are failed and future jobs use systemctl.
+ */
+static void
+bus_close(void)
+{
+	struct unit_job *job;
+
+	ev_io_stop(bus_loop, &bus_io);
+	ev_timer_stop(bus_loop, &bus_timer);
+	ev_prepare_stop(bus_loop, &bus_prepare);
+
+	bus = sd_bus_flush_close_unref(bus);
+
+	while ((job = TAILQ_FIRST(&unit_jobs))) {
+		TAILQ_REMOVE(&unit_jobs, job, entry);
+		unit_job_done(job, "failed");
+	}
+}
+
+static void
+bus_process(void)
+{
+	int r;
+
+	while ((r = sd_bus_process(bus, NULL)) > 0);
+	if (r < 0) {
+		logx(LOG_ERR, "Cannot process D-Bus messages: %s", strerror(-r));
+		bus_close();
+	}
+}
+
+static void
+bus_io_cb(EV_P_ ev_io *w, int revents)
+{
+	bus_process();
+}
+
+static void
+bus_timer_cb(EV_P_ ev_timer *w, int revents)
+{
+	bus_process();
+}
+
+/**
+ * Update the I/O and timeout watchers according to sd-bus' needs
+ * before the event loop blocks.
+ */
+static void
+bus_prepare_cb(EV_P_ ev_prepare *w, int revents)
+{
+	int events = sd_bus_get_events(bus);
+	int ev_events = 0;
+	uint64_t usec;
+
+	if (events < 0)
+		return;
+
+	if (events & POLLIN)
+		ev_events |= EV_READ;
+	if (events & POLLOUT)
+		ev_events |= EV_WRITE;
+
+	if (ev_events != bus_io.events) {
+		ev_io_stop(EV_A_ &bus_io);
+		ev_io_set(&bus_io, bus_io.fd, ev_events);
+		ev_io_start(EV_A_ &bus_io);
+	}
+
+	ev_timer_stop(EV_A_ &bus_timer);
+	if (sd_bus_get_timeout(bus, &usec) >= 0 && usec != UINT64_MAX) {
+		struct timespec now;
+		uint64_t now_usec;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		now_usec = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+		ev_timer_set(&bus_timer, usec > now_usec ? (usec - now_usec) / 1e6 : 0., 0.);
+		ev_timer_start(EV_A_ &bus_timer);
+	}
+}
+
+static int
+job_removed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	uint32_t id;
+	const char *path, *unit, *result;
+	struct unit_job *job, *next;
+
+	if (sd_bus_message_read(m, "uoss", &id, &path, &unit, &result) < 0)
+		return 0;
+
+	/* systemd merges requests into existing jobs, so a job may have several owners */
+	for (job = TAILQ_FIRST(&unit_jobs); job; job = next) {
+		next = TAILQ_NEXT(job, entry);
+
+		if (job->path && !strcmp(job->path, path)) {
+			TAILQ_REMOVE(&unit_jobs, job, entry);
+			unit_job_done(job, result);
+		}
+	}
+
+	return 0;
+}
+
+static int
+unit_job_reply_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	struct unit_job *job = userdata;
+	const sd_bus_error *error;
+	const char *path;
+
+	if ((error = sd_bus_message_get_error(m))) {
+		logx(LOG_ERR, "unit=[%s], error=%s", job->unit, error->message);
+		TAILQ_REMOVE(&unit_jobs, job, entry);
+		unit_job_done(job, "failed");
+		return 0;
+	}
+
+	if (sd_bus_message_read(m, "o", &path) < 0 ||
+	    !(job->path = strdup(path))) {
+		TAILQ_REMOVE(&unit_jobs, job, entry);
+		unit_job_done(job, "failed");
+	}
+
+	return 0;
+}
+
+static int
+timedate_reply_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	const sd_bus_error *error;
+
+	if ((error = sd_bus_message_get_error(m)))
+		logx(LOG_ERR, "Cannot configure NTP: %s", error->message);
+
+	return 0;
+}
+
+#endif
+
+/**
+ * Enqueue a systemd unit job.
+ *
+ * Jobs are enqueued in systemd in the order of the calls.
+ * The callback is invoked once the job has finished.
+ *
+ * @param type Type of job.
+ * @param unit Full unit name, e.g. "mosquitto.service".
+ * @param cb Completion callback or NULL.
+ * @param data User data for the callback.
+ * @returns 0 if the job has been requested, -1 otherwise.
+ */
+int systemd_unit_job(enum unit_job_type type, const char *unit,
+                     UNIT_JOB_CB cb, void *data)
+{
+	struct unit_job *job;
+
+	if (!(job = unit_job_new(unit, cb, data)))
+		return -1;
+
+	logx(LOG_INFO, "unit=[%s], job=%s", unit, unit_job_types[type].verb);
+
+#ifdef HAVE_SD_BUS
+	if (bus) {
+		int r;
+
+		r = sd_bus_call_method_async(bus, NULL,
+		                             "org.freedesktop.systemd1",
+		                             "/org/freedesktop/systemd1",
+		                             "org.freedesktop.systemd1.Manager",
+		                             unit_job_types[type].method,
+		                             unit_job_reply_cb, job,
+		                             "ss", unit, "replace");
+		if (r < 0) {
+			logx(LOG_ERR, "unit=[%s], error=%s", unit, strerror(-r));
+			free(job->unit);
+			free(job);
+			return -1;
+		}
+
+		TAILQ_INSERT_TAIL(&unit_jobs, job, entry);
+		return 0;
+	}
+#endif
+
+	if (systemctl_unit_job(type, job) < 0) {
+		logx(LOG_ERR, "unit=[%s], error=cannot queue systemctl", unit);
+		free(job->unit);
+		free(job);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Enable or disable NTP synchronization via systemd-timedated.
+ *
+ * @param enabled Whether to enable NTP.
+ * @returns 0 if the request has been sent, -1 otherwise.
+ */
+int systemd_set_ntp(bool enabled)
+{
+#ifdef HAVE_SD_BUS
+	if (bus) {
+		int r;
+
+		r = sd_bus_call_method_async(bus, NULL,
+		                             "org.freedesktop.timedate1",
+		                             "/org/freedesktop/timedate1",
+		                             "org.freedesktop.timedate1",
+		                             "SetNTP", timedate_reply_cb, NULL,
+		                             "bb", enabled, false);
+		return r < 0 ? -1 : 0;
+	}
+#endif
+
+	return exec_async(enabled ? "timedatectl set-ntp 1" : "timedatectl set-ntp 0",
+	                  NULL, NULL);
+}
+
+/**
+ * Get the configured timezone from systemd-timedated.
+ *
+ * NOTE: This is a synchronous call.
+ *
+ * @returns Timezone name that must be freed with free() or NULL.
+ */
+char *systemd_get_timezone(void)
+{
+#ifdef HAVE_SD_BUS
+	if (bus) {
+		sd_bus_error error = SD_BUS_ERROR_NULL;
+		char *tz = NULL;
+		int r;
+
+		r = sd_bus_get_property_string(bus,
+		                               "org.freedesktop.timedate1",
+		                               "/org/freedesktop/timedate1",
+		                               "org.freedesktop.timedate1",
+		                               "Timezone", &error, &tz);
+		if (r < 0)
+			logx(LOG_WARNING, "Cannot get timezone: %s",
+			     error.message ? : strerror(-r));
+		sd_bus_error_free(&error);
+
+		return tz;
+	}
+#endif
+
+	return NULL;
+}
+
+/**
+ * Connect to the system bus and integrate it into the event loop.
+ *
+ * If the system bus is not available, unit jobs fall back
+ * to systemctl.
+ *
+ * @param loop The event loop.
+ */
+void init_systemd(struct ev_loop *loop)
+{
+#ifdef HAVE_SD_BUS
+	int r;
+
+	if ((r = sd_bus_open_system(&bus)) < 0) {
+		logx(LOG_WARNING, "Cannot connect to system bus: %s", strerror(-r));
+		bus = NULL;
+		return;
+	}
+
+	/* sd_bus_match_signal() requires libsystemd 237 */
+	if ((r = sd_bus_add_match(bus, NULL,
+	                          "type='signal',"
+	                          "sender='org.freedesktop.systemd1',"
+	                          "path='/org/freedesktop/systemd1',"
+	                          "interface='org.freedesktop.systemd1.Manager',"
+	                          "member='JobRemoved'",
+	                          job_removed_cb, NULL)) < 0 ||
+	    (r = sd_bus_call_method_async(bus, NULL,
+	                                  "org.freedesktop.systemd1",
+	                                  "/org/freedesktop/systemd1",
+	                                  "org.freedesktop.systemd1.Manager",
+	                                  "Subscribe", NULL, NULL, "")) < 0) {
+		logx(LOG_WARNING, "Cannot subscribe to systemd job events: %s", strerror(-r));
+		bus = sd_bus_flush_close_unref(bus);
+		return;
+	}
+
+	bus_loop = loop;
+
+	ev_io_init(&bus_io, bus_io_cb, sd_bus_get_fd(bus), EV_READ);
+	ev_io_start(bus_loop, &bus_io);
+	ev_init(&bus_timer, bus_timer_cb);
+	ev_prepare_init(&bus_prepare, bus_prepare_cb);
+	ev_prepare_start(bus_loop, &bus_prepare);
+#endif
+}
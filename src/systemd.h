@@ -0,0 +1,35 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __SYSTEMD_H
+#define __SYSTEMD_H
+
+#include <stdbool.h>
+#include <ev.h>
+
+enum unit_job_type {
+	UNIT_START,
+	UNIT_STOP,
+	UNIT_RESTART,
+	UNIT_RELOAD_OR_RESTART,
+};
+
+/**
+ * Completion callback of a unit job.
+ *
+ * @param unit The unit name.
+ * @param result The job result as reported by systemd,
+ *               e.g. "done" or "failed".
+ * @param data User data passed to systemd_unit_job().
+ */
+typedef void (*UNIT_JOB_CB)(const char *unit, const char *result, void *data);
+
+void init_systemd(struct ev_loop *loop);
+
+int systemd_unit_job(enum unit_job_type type, const char *unit,
+                     UNIT_JOB_CB cb, void *data);
+int systemd_set_ntp(bool enabled);
+char *systemd_get_timezone(void);
+
+#endif
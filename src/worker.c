@@ -0,0 +1,208 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/queue.h>
+
+#include <ev.h>
+
+#include "worker.h"
+#include "log.h"
+
+#ifndef WORKER_THREADS
+#define WORKER_THREADS 2
+#endif
+
+/**
+ * A job executed by the worker pool.
+ *
+ * Jobs of the same lane are executed one after another in the order
+ * they were submitted and their completion callbacks are invoked in
+ * the same order.
+ * Different lanes run concurrently, limited by the number of threads.
+ */
+struct worker_job {
+	TAILQ_ENTRY(worker_job) entry;
+
+	const char *lane;
+	WORKER_FN work;
+	WORKER_CB done;
+	void *data;
+};
+
+TAILQ_HEAD(worker_queue, worker_job);
+
+/*
+ * The queues and the running lanes are protected by worker_lock.
+ */
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+
+static struct worker_queue worker_pending = TAILQ_HEAD_INITIALIZER(worker_pending);
+static struct worker_queue worker_finished = TAILQ_HEAD_INITIALIZER(worker_finished);
+
+/** lane of the job each thread is executing, NULL if idle */
+static const char *worker_running[WORKER_THREADS];
+
+/** number of threads started, only used by the loop thread */
+static unsigned int worker_threads;
+
+static struct ev_loop *worker_loop;
+static ev_async worker_async;
+
+static bool
+worker_lane_busy(const char *lane)
+{
+	for (unsigned int i = 0; i < WORKER_THREADS; i++)
+		if (worker_running[i] && !strcmp(worker_running[i], lane))
+			return true;
+
+	return false;
+}
+
+/**
+ * Take the first pending job whose lane is idle.
+ *
+ * Must be called with worker_lock held.
+ */
+static struct worker_job *
+worker_next(void)
+{
+	struct worker_job *job;
+
+	TAILQ_FOREACH(job, &worker_pending, entry)
+		if (!worker_lane_busy(job->lane)) {
+			TAILQ_REMOVE(&worker_pending, job, entry);
+			return job;
+		}
+
+	return NULL;
+}
+
+static void *
+worker_thread(void *arg)
+{
+	unsigned int slot = (uintptr_t)arg;
+	struct worker_job *job;
+
+	pthread_mutex_lock(&worker_lock);
+	for (;;) {
+		if (!(job = worker_next())) {
+			pthread_cond_wait(&worker_cond, &worker_lock);
+			continue;
+		}
+
+		worker_running[slot] = job->lane;
+		pthread_mutex_unlock(&worker_lock);
+
+		if (job->work)
+			job->work(job->data);
+
+		pthread_mutex_lock(&worker_lock);
+		worker_running[slot] = NULL;
+		TAILQ_INSERT_TAIL(&worker_finished, job, entry);
+
+		/* another thread may be waiting for this lane */
+		pthread_cond_broadcast(&worker_cond);
+		ev_async_send(worker_loop, &worker_async);
+	}
+
+	return NULL;
+}
+
+static void
+worker_async_cb(EV_P_ ev_async *w __attribute__((unused)),
+                int revents __attribute__((unused)))
+{
+	struct worker_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&worker_lock);
+		if ((job = TAILQ_FIRST(&worker_finished)))
+			TAILQ_REMOVE(&worker_finished, job, entry);
+		pthread_mutex_unlock(&worker_lock);
+
+		if (!job)
+			break;
+
+		if (job->done)
+			job->done(job->data);
+		free(job);
+	}
+}
+
+/**
+ * Execute a job by the worker pool.
+ *
+ * If no worker thread is available, the job is executed synchronously.
+ *
+ * @param lane Name of the lane, must remain valid until the job is done.
+ * @param work Function executed by a worker thread, may be NULL to
+ *             only order @p done after the other jobs of the lane.
+ * @param done Function executed by the loop thread after @p work,
+ *             may be NULL.
+ * @param data User data passed to @p work and @p done.
+ */
+void
+worker_submit(const char *lane, WORKER_FN work, WORKER_CB done, void *data)
+{
+	struct worker_job *job;
+
+	if (!worker_threads || !(job = calloc(1, sizeof(struct worker_job)))) {
+		if (work)
+			work(data);
+		if (done)
+			done(data);
+		return;
+	}
+
+	job->lane = lane;
+	job->work = work;
+	job->done = done;
+	job->data = data;
+
+	pthread_mutex_lock(&worker_lock);
+	TAILQ_INSERT_TAIL(&worker_pending, job, entry);
+	pthread_cond_signal(&worker_cond);
+	pthread_mutex_unlock(&worker_lock);
+}
+
+void
+init_worker(struct ev_loop *loop)
+{
+	sigset_t all, old;
+
+	worker_loop = loop;
+	ev_async_init(&worker_async, worker_async_cb);
+	ev_async_start(loop, &worker_async);
+
+	/* signals are handled by the event loop */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while (worker_threads < WORKER_THREADS) {
+		pthread_t thread;
+		int rc;
+
+		rc = pthread_create(&thread, NULL, worker_thread,
+		                    (void *)(uintptr_t)worker_threads);
+		if (rc != 0) {
+			logx(LOG_ERR, "Cannot start worker thread: %s", strerror(rc));
+			break;
+		}
+		pthread_detach(thread);
+		worker_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
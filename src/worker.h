@@ -0,0 +1,30 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __WORKER_H
+#define __WORKER_H
+
+#include <ev.h>
+
+/**
+ * Blocking part of a job, executed by a worker thread.
+ *
+ * This must not touch the event loop, the libdmconfig context
+ * or any other state that is owned by the loop thread.
+ *
+ * @param data User data passed to worker_submit().
+ */
+typedef void (*WORKER_FN)(void *data);
+
+/**
+ * Completion callback of a job, executed by the loop thread.
+ *
+ * @param data User data passed to worker_submit().
+ */
+typedef void (*WORKER_CB)(void *data);
+
+void init_worker(struct ev_loop *loop);
+void worker_submit(const char *lane, WORKER_FN work, WORKER_CB done, void *data);
+
+#endif
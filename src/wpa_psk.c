@@ -0,0 +1,276 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define HAVE_ARMV8_SHA1 1
+#include <arm_neon.h>
+#endif
+
+#include "render.h"
+#include "wpa_psk.h"
+
+#define SHA1_BLOCK_LEN  64
+#define SHA1_DIGEST_LEN 20
+
+/** rounds of the WPA-PSK key derivation, IEEE 802.11i */
+#define WPA_PSK_ITERATIONS 4096
+
+static const uint32_t sha1_init[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+#ifdef HAVE_ARMV8_SHA1
+
+/**
+ * SHA-1 block function using the ARMv8 cryptography extension.
+ *
+ * Every iteration processes four rounds. The message schedule is kept
+ * in a ring of four vectors, each replaced by the group of words
+ * four iterations ahead once it has been consumed.
+ */
+static void
+sha1_compress(uint32_t state[5], const uint8_t block[SHA1_BLOCK_LEN])
+{
+	static const uint32_t k[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+	uint32x4_t abcd = vld1q_u32(state);
+	uint32x4_t abcd_saved = abcd;
+	uint32_t e = state[4];
+	uint32x4_t w[4];
+
+	for (int i = 0; i < 4; i++)
+		w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16 * i)));
+
+	for (int i = 0; i < 20; i++) {
+		uint32x4_t wk = vaddq_u32(w[i & 3], vdupq_n_u32(k[i / 5]));
+		uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+		if (i < 5)
+			abcd = vsha1cq_u32(abcd, e, wk);
+		else if (i >= 10 && i < 15)
+			abcd = vsha1mq_u32(abcd, e, wk);
+		else
+			abcd = vsha1pq_u32(abcd, e, wk);
+		e = e_next;
+
+		if (i < 16)
+			w[i & 3] = vsha1su1q_u32(vsha1su0q_u32(w[i & 3], w[(i + 1) & 3], w[(i + 2) & 3]),
+			                         w[(i + 3) & 3]);
+	}
+
+	vst1q_u32(state, vaddq_u32(abcd, abcd_saved));
+	state[4] += e;
+}
+
+#else
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_compress(uint32_t state[5], const uint8_t block[SHA1_BLOCK_LEN])
+{
+	uint32_t w[16];
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+		       (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, t;
+
+		if (i >= 16) {
+			t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+			w[i & 15] = ROL(t, 1);
+		}
+
+		if (i < 20)
+			f = ((b & c) | (~b & d)) + 0x5a827999;
+		else if (i < 40)
+			f = (b ^ c ^ d) + 0x6ed9eba1;
+		else if (i < 60)
+			f = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+		else
+			f = (b ^ c ^ d) + 0xca62c1d6;
+
+		t = ROL(a, 5) + f + e + w[i & 15];
+		e = d;
+		d = c;
+		c = ROL(b, 30);
+		b = a;
+		a = t;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+#endif
+
+/**
+ * SHA-1 of data following a single, already compressed block.
+ *
+ * This is all HMAC needs: the key block has been compressed before,
+ * see hmac_sha1_init(), and the remaining data is short.
+ */
+static void
+sha1_finish(const uint32_t prefix[5], const uint8_t *data, size_t len,
+            uint8_t digest[SHA1_DIGEST_LEN])
+{
+	uint32_t state[5];
+	uint8_t block[SHA1_BLOCK_LEN];
+	uint64_t bits = (uint64_t)(SHA1_BLOCK_LEN + len) * 8;
+	size_t pos;
+
+	memcpy(state, prefix, sizeof(state));
+
+	for (; len >= SHA1_BLOCK_LEN; data += SHA1_BLOCK_LEN, len -= SHA1_BLOCK_LEN)
+		sha1_compress(state, data);
+
+	memcpy(block, data, len);
+	block[len] = 0x80;
+	pos = len + 1;
+	if (pos > SHA1_BLOCK_LEN - 8) {
+		memset(block + pos, 0, SHA1_BLOCK_LEN - pos);
+		sha1_compress(state, block);
+		pos = 0;
+	}
+	memset(block + pos, 0, SHA1_BLOCK_LEN - 8 - pos);
+	for (int i = 0; i < 8; i++)
+		block[SHA1_BLOCK_LEN - 1 - i] = bits >> (8 * i);
+	sha1_compress(state, block);
+
+	for (int i = 0; i < 5; i++) {
+		digest[4 * i]     = state[i] >> 24;
+		digest[4 * i + 1] = state[i] >> 16;
+		digest[4 * i + 2] = state[i] >> 8;
+		digest[4 * i + 3] = state[i];
+	}
+}
+
+/**
+ * Precompute the inner and outer HMAC-SHA1 states of a key.
+ *
+ * Keys longer than a block are not supported, which is fine for
+ * WPA passphrases (at most 63 characters).
+ */
+static void
+hmac_sha1_init(const void *key, size_t key_len, uint32_t inner[5], uint32_t outer[5])
+{
+	uint8_t pad[SHA1_BLOCK_LEN];
+
+	memset(pad, 0x36, sizeof(pad));
+	for (size_t i = 0; i < key_len; i++)
+		pad[i] ^= ((const uint8_t *)key)[i];
+	memcpy(inner, sha1_init, sizeof(sha1_init));
+	sha1_compress(inner, pad);
+
+	for (size_t i = 0; i < sizeof(pad); i++)
+		pad[i] ^= 0x36 ^ 0x5c;
+	memcpy(outer, sha1_init, sizeof(sha1_init));
+	sha1_compress(outer, pad);
+}
+
+static void
+hmac_sha1(const uint32_t inner[5], const uint32_t outer[5],
+          const uint8_t *data, size_t len, uint8_t mac[SHA1_DIGEST_LEN])
+{
+	uint8_t digest[SHA1_DIGEST_LEN];
+
+	sha1_finish(inner, data, len, digest);
+	sha1_finish(outer, digest, sizeof(digest), mac);
+}
+
+/**
+ * Derive a key from a password with PBKDF2-HMAC-SHA1 (RFC 8018).
+ *
+ * The HMAC key states are computed once, so every iteration costs
+ * two SHA-1 block compressions instead of four.
+ *
+ * @param password The password, at most 64 bytes.
+ * @param password_len Length of @p password.
+ * @param salt The salt, at most 60 bytes.
+ * @param salt_len Length of @p salt.
+ * @param iterations Iteration count.
+ * @param out Buffer for the derived key.
+ * @param out_len Length of the derived key.
+ */
+void pbkdf2_sha1(const void *password, size_t password_len,
+                 const void *salt, size_t salt_len, unsigned int iterations,
+                 uint8_t *out, size_t out_len)
+{
+	uint32_t inner[5], outer[5];
+	uint8_t buf[SHA1_BLOCK_LEN];
+
+	hmac_sha1_init(password, password_len, inner, outer);
+	memcpy(buf, salt, salt_len);
+
+	for (uint32_t block = 1; out_len; block++) {
+		uint8_t u[SHA1_DIGEST_LEN], t[SHA1_DIGEST_LEN];
+		size_t len = out_len < sizeof(t) ? out_len : sizeof(t);
+
+		buf[salt_len]     = block >> 24;
+		buf[salt_len + 1] = block >> 16;
+		buf[salt_len + 2] = block >> 8;
+		buf[salt_len + 3] = block;
+
+		hmac_sha1(inner, outer, buf, salt_len + 4, u);
+		memcpy(t, u, sizeof(t));
+
+		for (unsigned int i = 1; i < iterations; i++) {
+			hmac_sha1(inner, outer, u, sizeof(u), u);
+			for (size_t j = 0; j < sizeof(t); j++)
+				t[j] ^= u[j];
+		}
+
+		memcpy(out, t, len);
+		out += len;
+		out_len -= len;
+	}
+}
+
+/**
+ * Derive the WPA pre-shared key of a network, like wpa_passphrase.
+ *
+ * The key of the last network is cached, so unchanged credentials
+ * are not derived again.
+ *
+ * @param ssid The SSID, at most 32 bytes.
+ * @param passphrase The passphrase, 8 to 63 characters.
+ * @param psk Buffer for the key.
+ */
+void wpa_psk(const char *ssid, const char *passphrase, uint8_t psk[WPA_PSK_LEN])
+{
+	static struct {
+		bool valid;
+		uint64_t hash;
+		uint8_t psk[WPA_PSK_LEN];
+	} cache;
+	size_t ssid_len = strlen(ssid);
+	size_t passphrase_len = strlen(passphrase);
+	uint64_t hash;
+
+	/* the terminating NUL separates both strings */
+	hash = render_hash(RENDER_HASH_INIT, ssid, ssid_len + 1);
+	hash = render_hash(hash, passphrase, passphrase_len);
+
+	if (!cache.valid || cache.hash != hash) {
+		pbkdf2_sha1(passphrase, passphrase_len, ssid, ssid_len > 32 ? 32 : ssid_len,
+		            WPA_PSK_ITERATIONS, cache.psk, sizeof(cache.psk));
+		cache.hash = hash;
+		cache.valid = true;
+	}
+
+	memcpy(psk, cache.psk, WPA_PSK_LEN);
+}
@@ -0,0 +1,18 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __WPA_PSK_H
+#define __WPA_PSK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WPA_PSK_LEN 32
+
+void pbkdf2_sha1(const void *password, size_t password_len,
+                 const void *salt, size_t salt_len, unsigned int iterations,
+                 uint8_t *out, size_t out_len);
+void wpa_psk(const char *ssid, const char *passphrase, uint8_t psk[WPA_PSK_LEN]);
+
+#endif
@@ -0,0 +1,104 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Known-answer test of the key derivation in wpa_psk.c, run by "make check".
+ *
+ * The PSK vectors are those of IEEE 802.11i, Annex H.4, the PBKDF2
+ * vectors those of RFC 6070.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wpa_psk.h"
+
+static const struct {
+	const char *passphrase;
+	const char *ssid;
+	const char *psk;
+} psk_vectors[] = {
+	{ "password", "IEEE",
+	  "f42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e" },
+	{ "ThisIsAPassword", "ThisIsASSID",
+	  "0dc0d6eb90555ed6419756b9a15ec3e3209b63df707dd508d14581f8982721af" },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ",
+	  "becb93866bb8c3832cb777c2f559807c8c59afcb6eae734885001300a981cc62" }
+};
+
+static const struct {
+	const char *password;
+	const char *salt;
+	unsigned int iterations;
+	size_t len;
+	const char *key;
+} pbkdf2_vectors[] = {
+	{ "password", "salt", 1, 20,
+	  "0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+	{ "password", "salt", 4096, 20,
+	  "4b007901b765489abead49d926f721d065a429c1" },
+	{ "passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 25,
+	  "3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038" }
+};
+
+#define VECTORS(v) (sizeof(v)/sizeof(v[0]))
+
+/**
+ * Compare a key to its hexadecimal known answer.
+ *
+ * @returns 0 if they match, 1 otherwise.
+ */
+static int
+check_key(const char *name, const uint8_t *key, size_t len, const char *expected)
+{
+	char hex[2 * 64 + 1];
+
+	for (size_t i = 0; i < len; i++)
+		sprintf(hex + 2 * i, "%02x", key[i]);
+
+	if (strcmp(hex, expected) != 0) {
+		fprintf(stderr, "FAIL %s\n  got      %s\n  expected %s\n", name, hex, expected);
+		return 1;
+	}
+
+	printf("PASS %s\n", name);
+	return 0;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	for (size_t i = 0; i < VECTORS(pbkdf2_vectors); i++) {
+		uint8_t key[64];
+		char name[64];
+
+		pbkdf2_sha1(pbkdf2_vectors[i].password, strlen(pbkdf2_vectors[i].password),
+		            pbkdf2_vectors[i].salt, strlen(pbkdf2_vectors[i].salt),
+		            pbkdf2_vectors[i].iterations, key, pbkdf2_vectors[i].len);
+
+		snprintf(name, sizeof(name), "pbkdf2_sha1 #%zu", i + 1);
+		failed += check_key(name, key, pbkdf2_vectors[i].len, pbkdf2_vectors[i].key);
+	}
+
+	for (size_t i = 0; i < VECTORS(psk_vectors); i++)
+		/* the second key of a network is served from the cache */
+		for (int cached = 0; cached < 2; cached++) {
+			uint8_t psk[WPA_PSK_LEN];
+			char name[64];
+
+			wpa_psk(psk_vectors[i].ssid, psk_vectors[i].passphrase, psk);
+
+			snprintf(name, sizeof(name), "wpa_psk \"%s\"%s",
+			         psk_vectors[i].ssid, cached ? " (cached)" : "");
+			failed += check_key(name, psk, sizeof(psk), psk_vectors[i].psk);
+		}
+
+	return failed ? 1 : 0;
+}